@@ -2,6 +2,7 @@
 #ifndef __cplusplus
 #define RootSig "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT), "\
                 "CBV(b0), CBV(b1), CBV(b2), DescriptorTable(SRV(t0), visibility=SHADER_VISIBILITY_PIXEL),"\
+                "SRV(t1, visibility=SHADER_VISIBILITY_VERTEX),"\
                 "StaticSampler(s0, MinLOD=0, MaxLOD=3.402823466e+38f)"
 
 #define LightingRootSig "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT), "\
@@ -19,11 +20,12 @@
                         "borderColor=STATIC_BORDER_COLOR_OPAQUE_BLACK)"
 
 #define LightingRootSig2 "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT),"\
-"CBV(b0), DescriptorTable(SRV(t0)),"\
+"CBV(b0), DescriptorTable(SRV(t0), SRV(t7)),"\
 "DescriptorTable(SRV(t1), visibility=SHADER_VISIBILITY_PIXEL),"\
 "DescriptorTable(SRV(t2), visibility=SHADER_VISIBILITY_PIXEL),"\
 "DescriptorTable(SRV(t3), visibility=SHADER_VISIBILITY_PIXEL),"\
-"DescriptorTable(SRV(t4), visibility=SHADER_VISIBILITY_PIXEL)"
+"DescriptorTable(SRV(t4), visibility=SHADER_VISIBILITY_PIXEL),"\
+"DescriptorTable(SRV(t5, numDescriptors=2), visibility=SHADER_VISIBILITY_PIXEL)"
 #endif
 
 #ifdef __cplusplus
@@ -33,6 +35,7 @@ namespace ShaderData {
     using float3 = DirectX::SimpleMath::Vector3;
     using float2 = DirectX::SimpleMath::Vector2;
     using matrix = DirectX::SimpleMath::Matrix;
+    using uint = unsigned int;
     struct Object
 #else
 cbuffer Object : register(b2)
@@ -60,6 +63,13 @@ cbuffer Constants : register(b0)
     float4 hammersley[20];
     float momentBias;
     float depthBias;
+    float clusterScale;     // Emulator::LightClusters::Pack
+    float clusterBias;
+    float4 irradianceSH[7]; // Emulator::IrradianceSH::Pack
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    int clusterTileSize;
 };
 
 #ifdef __cplusplus
@@ -78,6 +88,54 @@ struct Light
     float range;
 };
 
+// The lighting pass's split of Light: what every light needs, read per
+// pixel, and the shadow parameters only shadowed lights have, indexed
+// by shadow (-1 for none).  See Emulator::LightStore.
+struct LightData
+{
+    float3 lightPos;
+    float range;
+    float3 lightColor;
+    int shadow;
+};
+
+struct ShadowData
+{
+    matrix ShadowView;
+    matrix ShadowProj;
+    float ShadowMin;
+    float ShadowMax;
+    float2 padding;
+};
+
+// Emulator::ToneMapper's parameters and the GPU tone mapper's state,
+// which ToneMapShader.hlsl keeps from frame to frame
+#define ToneMapBins 128 // Emulator::ToneMapper::Bins
+struct ToneMapData
+{
+    float minLog2;      // Emulator::ToneMapper::MinLog2 and MaxLog2
+    float maxLog2;
+    float key;
+    float compensation;
+    float lowPercentile;
+    float highPercentile;
+    float adaptDarker;
+    float adaptBrighter;
+    float seconds;      // Since the last frame
+    int reset;          // Take the target exposure straight away
+    int enabled;        // Otherwise the resolve only copies
+    int lutSize;        // Emulator::ToneMapper::LutSize
+};
+
+struct ToneMapState
+{
+    uint histogram[ToneMapBins];
+    float exposure;
+    float targetExposure;
+    float averageLog2;
+    int adapted;
+};
+
 #define WIDTH 50
 #ifdef AO
 #define gwidth 32
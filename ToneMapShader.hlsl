@@ -0,0 +1,168 @@
+#define ToneMapRootSig "CBV(b0), DescriptorTable(SRV(t0)), SRV(t1), UAV(u0)"
+
+#define ResolveRootSig "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT), "\
+                "CBV(b0), DescriptorTable(SRV(t0)), SRV(t1), UAV(u0)"
+#include "ShaderData.h"
+
+// Auto-exposure and filmic tone mapping of the lighting pass's HDR
+// output, as Emulator::ToneMapper does it on the CPU (see tonemap.h):
+//   HistogramMain bins log2 luminance, each group into a histogram of
+//     its own in group shared memory, which it then adds to State's.
+//   ExposureMain, a single group with a thread per bin, takes the mean
+//     of the bins between the percentiles, moves the exposure toward
+//     the one that maps it to the key, and clears the histogram.
+//   VSMain and PSMain draw the exposed frame through the curve's table
+//     onto the back buffer.
+
+ConstantBuffer<ToneMapData> Tone : register(b0);
+Texture2D<float4> HDR : register(t0);
+StructuredBuffer<float> Lut : register(t1); // Emulator::ToneMapper::BuildLut
+RWStructuredBuffer<ToneMapState> State : register(u0);
+
+static const float3 Luma = float3(0.2126f, 0.7152f, 0.0722f); // Rec. 709
+
+// Exposed values are clamped to this before x / (x + 1), which would
+// make infinity NaN
+static const float MaxExposed = 1e30f;
+
+float BinsPerStop()
+{
+    return (ToneMapBins - 1) / (Tone.maxLog2 - Tone.minLog2);
+}
+
+groupshared uint GroupHistogram[ToneMapBins];
+
+[RootSignature(ToneMapRootSig)]
+[numthreads(16, 16, 1)]
+void HistogramMain(uint3 _dti : SV_DispatchThreadID, uint _index : SV_GroupIndex)
+{
+    if (_index < ToneMapBins)
+        GroupHistogram[_index] = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    uint width, height;
+    HDR.GetDimensions(width, height);
+    if (_dti.x < width && _dti.y < height)
+    {
+        // Bin 0 holds everything darker than minLog2, NaN included
+        float luminance = dot(HDR[_dti.xy].xyz, Luma);
+        uint bin = 0;
+        if (luminance > 0)
+        {
+            float position = (log2(luminance) - Tone.minLog2) * BinsPerStop() + 1.0f;
+            bin = uint(clamp(position, 0.0f, ToneMapBins - 1.0f));
+        }
+        InterlockedAdd(GroupHistogram[bin], 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (_index < ToneMapBins && GroupHistogram[_index] != 0)
+        InterlockedAdd(State[0].histogram[_index], GroupHistogram[_index]);
+}
+
+groupshared uint Scan[ToneMapBins];
+groupshared float Sum[ToneMapBins];
+groupshared float Weight[ToneMapBins];
+
+[RootSignature(ToneMapRootSig)]
+[numthreads(ToneMapBins, 1, 1)]
+void ExposureMain(uint _index : SV_GroupIndex)
+{
+    // Bin 0 is left out of the mean
+    uint count = _index == 0 ? 0 : State[0].histogram[_index];
+    State[0].histogram[_index] = 0;
+    Scan[_index] = count;
+    GroupMemoryBarrierWithGroupSync();
+
+    // Pixels in this bin and those before it
+    for (uint offset = 1; offset < ToneMapBins; offset *= 2)
+    {
+        uint before = 0;
+        if (_index >= offset)
+            before = Scan[_index - offset];
+        GroupMemoryBarrierWithGroupSync();
+        Scan[_index] += before;
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    // The part of this bin between the percentiles, counting bins partly
+    // inside in part
+    float counted = Scan[ToneMapBins - 1];
+    float below = Scan[_index] - count;
+    float low = Tone.lowPercentile * counted;
+    float high = max(Tone.highPercentile * counted, low + 1.0f);
+    float weight = max(min(below + count, high) - max(below, low), 0.0f);
+    float center = Tone.minLog2 + (_index - 0.5f) / BinsPerStop();
+    Sum[_index] = center * weight;
+    Weight[_index] = weight;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint stride = ToneMapBins / 2; stride > 0; stride /= 2)
+    {
+        if (_index < stride)
+        {
+            Sum[_index] += Sum[_index + stride];
+            Weight[_index] += Weight[_index + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+    if (_index != 0)
+        return;
+
+    // With nothing brighter than bin 0, the target is left as it was
+    if (Weight[0] > 0)
+    {
+        State[0].averageLog2 = Sum[0] / Weight[0];
+        State[0].targetExposure = exp2(log2(Tone.key) - State[0].averageLog2 + Tone.compensation);
+    }
+    float target = log2(State[0].targetExposure);
+    float current = target;
+    if (State[0].adapted && !Tone.reset && Tone.seconds > 0)
+    {
+        current = log2(State[0].exposure);
+        float rate = target < current ? Tone.adaptDarker : Tone.adaptBrighter;
+        current += (target - current) * (1.0f - exp2(-rate * Tone.seconds));
+    }
+    State[0].exposure = exp2(current);
+    State[0].adapted = 1;
+}
+
+struct VertexInput
+{
+    float3 vertex : SV_Position;
+    float3 normal : NORMAL;
+    float2 texCoords : TEXCOORD;
+};
+
+struct VertexOut
+{
+    float4 position : SV_Position;
+};
+
+[RootSignature(ResolveRootSig)]
+VertexOut VSMain(VertexInput _input)
+{
+    VertexOut vout;
+    vout.position = float4(_input.vertex, 1);
+    return vout;
+}
+
+// Entry i of the table is the curve at x / (x + 1) = i / (lutSize - 1),
+// followed by a copy of the last for interpolating
+float Map(float _value, float _exposure)
+{
+    float x = min(max(0.0f, _value * _exposure), MaxExposed);
+    float position = x / (x + 1.0f) * (Tone.lutSize - 1);
+    uint i = uint(position);
+    return lerp(Lut[i], Lut[i + 1], position - i);
+}
+
+float4 PSMain(VertexOut _input) : SV_Target
+{
+    float3 hdr = HDR[uint2(_input.position.xy)].xyz;
+    if (!Tone.enabled)
+        return float4(hdr, 1);
+
+    float exposure = State[0].exposure;
+    return float4(Map(hdr.x, exposure), Map(hdr.y, exposure), Map(hdr.z, exposure), 1);
+}
@@ -15,15 +15,24 @@ struct VertexOut
     float2 texCoord : TEXCOORD;
 };
 
+#ifdef INSTANCED
+// Compiled with INSTANCED for the light proxies: one instance per
+// visible light, moved to its position.
+StructuredBuffer<float4> InstancePositions : register(t1);
+#endif
+
 [RootSignature(RootSig)]
-VertexOut main(VertexInput _input)
+VertexOut main(VertexInput _input, uint _instance : SV_InstanceID)
 {
     float3 eye = mul(WorldInverse, float4(0, 0, 0, 1)).xyz;
     VertexOut output;
     output.worldPosition = mul(ModelTr, float4(_input.vertex, 1));
-    output.position = mul(WorldProj, mul(WorldView, mul(ModelTr, float4(_input.vertex, 1))));
+#ifdef INSTANCED
+    output.worldPosition.xyz += InstancePositions[_instance].xyz;
+#endif
+    output.position = mul(WorldProj, mul(WorldView, float4(output.worldPosition.xyz, 1)));
     output.worldPosition.w = output.position.w;
-    float3 worldPos = mul(ModelTr, float4(_input.vertex, 1)).xyz;
+    float3 worldPos = output.worldPosition.xyz;
     output.normalVec = normalize(mul(NormalTr, float4(_input.normal, 0)).xyz);
     output.texCoord = _input.texCoords;
     
@@ -15,7 +15,6 @@ Texture2D Diffuse : register(t3);
 Texture2D SpecularAlpha : register(t4);
 
 //Texture2D<unorm float4> ShadowMap : register(t4);
-//Texture2D IrradianceMap : register(t5);
 //Texture2D SpecularMap : register(t6);
 
 //Texture2D<float> AOMap : register(t7);
@@ -23,7 +22,23 @@ Texture2D SpecularAlpha : register(t4);
 SamplerState PointSampler : register(s0);
 SamplerState AnisoSampler : register(s1);
 
-StructuredBuffer<Light> Lights : register(t0);
+// Emulator::LightStore::m_hot and m_cold; a light's shadow parameters
+// are Shadows[Lights[i].shadow] when shadow >= 0
+StructuredBuffer<LightData> Lights : register(t0);
+StructuredBuffer<ShadowData> Shadows : register(t7);
+
+// Emulator::LightClusters::m_ranges and m_indices
+StructuredBuffer<uint2> ClusterRanges : register(t5);
+StructuredBuffer<uint> ClusterLights : register(t6);
+
+// The lights of the cluster holding pixel, given its view depth, as an
+// offset into ClusterLights and a count
+uint2 ClusterOf(float2 pixel, float depth)
+{
+    int slice = clamp(int(floor(log2(max(depth, 1e-6f)) * clusterScale + clusterBias)), 0, clusterSlices - 1);
+    uint2 tile = uint2(pixel) / clusterTileSize;
+    return ClusterRanges[(slice * clusterTilesY + tile.y) * clusterTilesX + tile.x];
+}
 
 //float4 GetOptimizedDepth(float2 uv)
 //{
@@ -131,10 +146,22 @@ float3 VectorOf(float2 uv)
     return float3(x, y, z);
 }
 
-//float3 Irradiance(float3 N)
-//{
-//    return IrradianceMap.Sample(PointSampler, UVOF(N)).rgb;
-//}
+// Coefficient i of the sky's irradiance, three floats of irradianceSH
+float3 SHCoefficient(int i)
+{
+    int r = 3 * i, g = r + 1, b = r + 2;
+    return float3(irradianceSH[r / 4][r % 4], irradianceSH[g / 4][g % 4], irradianceSH[b / 4][b % 4]);
+}
+
+// Evaluated as in Emulator::IrradianceSH::Irradiance
+float3 Irradiance(float3 N)
+{
+    return SHCoefficient(0)
+        + SHCoefficient(1) * N.y + SHCoefficient(2) * N.z + SHCoefficient(3) * N.x
+        + SHCoefficient(4) * (N.x * N.y) + SHCoefficient(5) * (N.y * N.z)
+        + SHCoefficient(6) * (3.f * N.z * N.z - 1.f) + SHCoefficient(7) * (N.x * N.z)
+        + SHCoefficient(8) * (N.x * N.x - N.y * N.y);
+}
 
 float Skew(float r2, float roughness)
 {
@@ -285,7 +312,8 @@ float4 main(PixelIn _input) : SV_TARGET
         //    return 0;
        return float4(diffuse, 1);
     }
-    float3 worldPosition = WorldPosition.mips[0][_input.position.xy].xyz;//WorldPosition.Sample(PointSampler, _input.texCoord).xyz;
+    float4 positionDepth = WorldPosition.mips[0][_input.position.xy];
+    float3 worldPosition = positionDepth.xyz;//WorldPosition.Sample(PointSampler, _input.texCoord).xyz;
     float3 normal = Normal.mips[0][_input.position.xy].xyz;//Normal.Sample(PointSampler, _input.texCoord).xyz;
     //matrix ShadowProj = Lights[_input.instance].ShadowProj;
     //matrix ShadowView = Lights[_input.instance].ShadowView;
@@ -295,8 +323,10 @@ float4 main(PixelIn _input) : SV_TARGET
     float3 V = normalize(CameraPos - worldPosition);
     float3 Kd = diffuse;
     float3 finalColor = 0;
-    for (int i  = 0; i < 1025; i++)
+    uint2 cluster = ClusterOf(_input.position.xy, positionDepth.w);
+    for (uint j = 0; j < cluster.y; j++)
     {
+        uint i = ClusterLights[cluster.x + j];
         float3 lightPos = Lights[i].lightPos;
         float3 lightColor = Lights[i].lightColor;
         float range = Lights[i].range;
@@ -357,8 +387,7 @@ float4 main(PixelIn _input) : SV_TARGET
     //    finalColor += IBLDiffuse * ao;
     
     
-    //float3 eC = e * finalColor;
-    //finalColor = pow(eC / (eC + float3(1, 1, 1)), 1.f / 2.2f);
+    // Linear HDR; ToneMapShader.hlsl exposes and tone maps it
 
     return float4(finalColor, 1);
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////
+// Screen-space ambient occlusion on the CPU; see ao.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "ao.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+using Target = Emulator::GBuffer::Target;
+
+static const float pi = 3.14159f; // As in AOShader.hlsl
+static const double TwoPi = 6.283185307179586;
+static const float Sigma = 0.001f; // PSMain's depth bias per sample
+
+// Depth difference, relative to the pixel's depth, at which a half
+// resolution neighbour counts half as much as one at the same depth
+static const float DepthFalloff = 0.02f;
+
+void Emulator::AmbientOcclusion::Resolve(const GBuffer& _gbuffer, const ShaderData::AoData& _data) {
+    m_width = _gbuffer.m_width;
+    m_height = _gbuffer.m_height;
+    m_ao.resize(static_cast<size_t>(m_width) * m_height);
+
+    // PSMain loops while i < n, and n is a float slider
+    const int count = std::max(static_cast<int>(std::ceil(_data.n)), 0);
+    m_samples.resize(count);
+    for (int i = 0; i < count; i++) {
+        float alpha = (i + 0.5f) / _data.n;
+        float theta = 2.0f * pi * alpha * (7.0f * _data.n / 9.0f);
+        m_samples[i] = { alpha * _data.R, std::cos(theta), std::sin(theta) };
+    }
+    const float c = 0.1f * _data.R;
+    m_radius = _data.R;
+    m_scale = (pi * 2 * c) / _data.n;
+    m_strength = _data.s;
+    m_exponent = _data.k;
+
+    // Samples land anywhere within R of the pixel, so the positions are
+    // gathered into one texel per pixel first, one cache line a sample
+    // rather than one per plane.
+    m_positions.resize(static_cast<size_t>(m_width) * m_height);
+    ThreadPool::Get().ParallelFor(m_height, [&](uint32_t _y) {
+        const float* x = _gbuffer.Row(Target::WorldPosition, 0, _y);
+        const float* y = _gbuffer.Row(Target::WorldPosition, 1, _y);
+        const float* z = _gbuffer.Row(Target::WorldPosition, 2, _y);
+        const float* w = _gbuffer.Row(Target::WorldPosition, 3, _y);
+        Vector4* out = &m_positions[static_cast<size_t>(_y) * m_width];
+        for (int i = 0; i < m_width; i++)
+            out[i] = Vector4(x[i], y[i], z[i], w[i]);
+    });
+
+    auto shade = [&](int _width, int _height, int _step, float* _out) {
+        const int tilesX = (_width + TileSize - 1) / TileSize;
+        const int tilesY = (_height + TileSize - 1) / TileSize;
+        ThreadPool::Get().ParallelFor(tilesX * tilesY, [&](uint32_t _tile) {
+            const int x0 = (_tile % tilesX) * TileSize;
+            const int y0 = (_tile / tilesX) * TileSize;
+            for (int y = y0; y < std::min(y0 + TileSize, _height); y++)
+                for (int x = x0; x < std::min(x0 + TileSize, _width); x++)
+                    _out[static_cast<size_t>(y) * _width + x] = Occlusion(_gbuffer, x * _step, y * _step);
+        });
+    };
+
+    if (!m_halfResolution) {
+        shade(m_width, m_height, 1, m_ao.data());
+        return;
+    }
+    m_halfWidth = (m_width + 1) / 2;
+    m_halfHeight = (m_height + 1) / 2;
+    m_half.resize(static_cast<size_t>(m_halfWidth) * m_halfHeight);
+    shade(m_halfWidth, m_halfHeight, 2, m_half.data());
+    Upsample(_gbuffer);
+}
+
+// PSMain for pixel (_x, _y).  Pixels the geometry pass never wrote have
+// no normal and are left unoccluded, as are samples that land on the
+// pixel's own position.
+float Emulator::AmbientOcclusion::Occlusion(const GBuffer& _gbuffer, int _x, int _y) const {
+    Vector3 N(
+        _gbuffer.Row(Target::Normal, 0, _y)[_x],
+        _gbuffer.Row(Target::Normal, 1, _y)[_x],
+        _gbuffer.Row(Target::Normal, 2, _y)[_x]
+    );
+    const Vector4& Pd = m_positions[static_cast<size_t>(_y) * m_width + _x];
+    const float d = Pd.w;
+    if (N == Vector3::Zero || !(d > 0))
+        return 1.0f;
+    N.Normalize();
+    const Vector3 P(Pd.x, Pd.y, Pd.z);
+
+    // The spiral is turned by phi, and its offsets are in uv, so they
+    // scale by the size of the buffer in pixels.  phi runs into the
+    // millions, so it is reduced to one turn in double first; the float
+    // sin and cos of large arguments are slow.
+    const float phi = static_cast<float>(((30 * _x) ^ _y) + 10 * _x * _y);
+    const double turns = phi * (1.0 / TwoPi);
+    const float angle = static_cast<float>((turns - std::floor(turns)) * TwoPi);
+    const float cosPhi = std::cos(angle), sinPhi = std::sin(angle);
+    const float centerX = _x + 0.5f, centerY = _y + 0.5f;
+    const float scaleX = m_width / d, scaleY = m_height / d;
+    const float c = 0.1f * m_radius;
+
+    // Wrap addressing, without a division for offsets within a screen
+    auto wrap = [](int _i, int _size) {
+        if (_i >= 0 && _i < _size)
+            return _i;
+        _i %= _size;
+        return _i < 0 ? _i + _size : _i;
+    };
+
+    float sum = 0;
+    for (const Sample& sample : m_samples) {
+        float dx = sample.cosine * cosPhi - sample.sine * sinPhi;
+        float dy = sample.sine * cosPhi + sample.cosine * sinPhi;
+        int sx = wrap(static_cast<int>(std::floor(centerX + sample.radius * dx * scaleX)), m_width);
+        int sy = wrap(static_cast<int>(std::floor(centerY + sample.radius * dy * scaleY)), m_height);
+
+        const Vector4& Pid = m_positions[static_cast<size_t>(sy) * m_width + sx];
+        Vector3 Wi = Vector3(Pid.x, Pid.y, Pid.z) - P;
+        float lengthSquared = Wi.LengthSquared();
+        if (!(lengthSquared > 0))
+            continue;
+        float length = std::sqrt(lengthSquared);
+        if (m_radius - length < 0)
+            continue;
+        float num = std::max(0.0f, N.Dot(Wi) / length - Sigma * Pid.w);
+        sum += num / std::max(c * c, lengthSquared);
+    }
+
+    float S = m_scale * sum;
+    return std::pow(std::max(0.0f, 1.0f - m_strength * S), m_exponent);
+}
+
+// Shaded pixel (i, j) of m_half sits on full resolution pixel (2i, 2j),
+// so even pixels copy it and odd ones blend two or four of them.
+void Emulator::AmbientOcclusion::Upsample(const GBuffer& _gbuffer) {
+    ThreadPool::Get().ParallelFor(m_height, [&](uint32_t _y) {
+        const int y = static_cast<int>(_y);
+        const int j0 = y / 2, j1 = std::min(j0 + (y & 1), m_halfHeight - 1);
+        const float* depth = _gbuffer.Row(Target::WorldPosition, 3, y);
+        const float* depth0 = _gbuffer.Row(Target::WorldPosition, 3, 2 * j0);
+        const float* depth1 = _gbuffer.Row(Target::WorldPosition, 3, std::min(2 * j1, m_height - 1));
+        const float* half0 = &m_half[static_cast<size_t>(j0) * m_halfWidth];
+        const float* half1 = &m_half[static_cast<size_t>(j1) * m_halfWidth];
+        float* out = &m_ao[static_cast<size_t>(y) * m_width];
+
+        for (int x = 0; x < m_width; x++) {
+            if (!(x & 1) && !(y & 1)) {
+                out[x] = half0[x / 2];
+                continue;
+            }
+            const int i0 = x / 2, i1 = std::min(i0 + (x & 1), m_halfWidth - 1);
+            const int x0 = 2 * i0, x1 = std::min(2 * i1, m_width - 1);
+            const float d = depth[x];
+            const float tolerance = DepthFalloff * std::max(std::abs(d), 1e-6f);
+            auto weight = [&](float _depth) { return 1.0f / (1.0f + std::abs(_depth - d) / tolerance); };
+
+            // Equal bilinear weights, since odd pixels are halfway
+            float w00 = weight(depth0[x0]), w10 = weight(depth0[x1]);
+            float w01 = weight(depth1[x0]), w11 = weight(depth1[x1]);
+            float sum = w00 * half0[i0] + w10 * half0[i1] + w01 * half1[i0] + w11 * half1[i1];
+            out[x] = sum / (w00 + w10 + w01 + w11);
+        }
+    });
+}
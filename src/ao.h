@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of the ambient occlusion pass: AOShader.hlsl's
+// PSMain run over the emulated G-buffer.
+//
+// PSMain walks n samples along a spiral whose angle it works out with
+// cos and sin per sample, turned by a per-pixel hash phi.  Here the
+// spiral is tabulated once per Resolve from AoData's R and n, and each
+// pixel only rotates the table by its own phi.  Samples are point
+// lookups with wrap addressing, like the shader's StaticSampler.
+//
+// Tiles of the screen are shaded in parallel.  At half resolution
+// every other pixel of every other row is shaded, and the rest are
+// filled in from their four nearest shaded neighbours, weighted by
+// distance and by how close their depths are, so occlusion does not
+// leak across silhouettes.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <vector>
+
+// AoData is only declared with AO defined
+#define AO
+#include "../ShaderData.h"
+#include "gbuffer.h"
+
+namespace Emulator {
+    class AmbientOcclusion {
+    public:
+        static constexpr int TileSize = 16; // Pixels on a side of a work item
+
+        bool m_halfResolution = false;
+
+        int m_width = 0, m_height = 0;
+        std::vector<float> m_ao; // m_width * m_height, row major, 1 unoccluded
+
+        // Occlusion of every pixel of _gbuffer with the parameters of _data.
+        // Its weights are not used.
+        void Resolve(const GBuffer& _gbuffer, const ShaderData::AoData& _data);
+
+        float At(int _x, int _y) const { return m_ao[static_cast<size_t>(_y) * m_width + _x]; }
+
+    private:
+        // A spiral sample before the per-pixel rotation
+        struct Sample {
+            float radius;           // alpha * R, divided by depth per pixel
+            float cosine, sine;     // Of theta without phi
+        };
+
+        float Occlusion(const GBuffer& _gbuffer, int _x, int _y) const;
+        void Upsample(const GBuffer& _gbuffer);
+
+        std::vector<Sample> m_samples;
+        std::vector<DirectX::SimpleMath::Vector4> m_positions; // The WorldPosition target, xyzw per pixel
+        float m_radius = 0;     // R
+        float m_scale = 0;      // 2 pi c / n, from the sum to S
+        float m_strength = 0;   // s
+        float m_exponent = 0;   // k
+
+        int m_halfWidth = 0, m_halfHeight = 0;
+        std::vector<float> m_half; // Shaded pixels at half resolution
+    };
+}
@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////
+// Bilateral ambient occlusion blur on the CPU; see aoblur.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "aoblur.h"
+#include "blur.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using Target = Emulator::GBuffer::Target;
+
+static const float Log2e = 1.442695041f;
+
+void Emulator::AOBlur::Blur(AmbientOcclusion& _ao, const GBuffer& _gbuffer) {
+    Blur(_ao.m_ao.data(), _ao.m_width, _ao.m_height, _gbuffer);
+}
+
+void Emulator::AOBlur::Blur(float* _ao, int _width, int _height, const GBuffer& _gbuffer) {
+    if (_width <= 0 || _height <= 0)
+        return;
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+    m_weights = MomentBlur::GaussianWeights(Width);
+    m_horizontal.resize(static_cast<size_t>(_width) * _height);
+
+    // Horizontal: rows in parallel.  Each row is copied into lines with
+    // Width clamped texels on either end, so tap j of output k is just
+    // line[k + j].
+    ThreadPool::Get().ParallelFor(_height, [&](uint32_t _y) {
+        thread_local std::vector<float> lines;
+        const size_t length = static_cast<size_t>(_width) + 2 * Width;
+        lines.resize(length * 5);
+        const float* sources[5] = {
+            _ao + static_cast<size_t>(_y) * _width,
+            _gbuffer.Row(Target::Normal, 0, _y),
+            _gbuffer.Row(Target::Normal, 1, _y),
+            _gbuffer.Row(Target::Normal, 2, _y),
+            _gbuffer.Row(Target::WorldPosition, 3, _y),
+        };
+        for (int i = 0; i < 5; i++) {
+            float* line = &lines[i * length];
+            std::fill(line, line + Width, sources[i][0]);
+            std::copy(sources[i], sources[i] + _width, line + Width);
+            std::fill(line + Width + _width, line + length, sources[i][_width - 1]);
+        }
+
+        TapRows taps;
+        for (int j = 0; j < Taps; j++) {
+            taps.ao[j] = &lines[0 * length + j];
+            taps.nx[j] = &lines[1 * length + j];
+            taps.ny[j] = &lines[2 * length + j];
+            taps.nz[j] = &lines[3 * length + j];
+            taps.depth[j] = &lines[4 * length + j];
+        }
+        Filter(taps, &m_horizontal[static_cast<size_t>(_y) * _width], _width);
+    });
+
+    // Vertical: strips of columns in parallel, each run top to bottom
+    // so the rows its taps reach stay in cache from one output row to
+    // the next.
+    const uint32_t strips = (_width + StripWidth - 1) / StripWidth;
+    ThreadPool::Get().ParallelFor(strips, [&](uint32_t _strip) {
+        const int x0 = _strip * StripWidth;
+        const int columns = std::min(StripWidth, _width - x0);
+        for (int y = 0; y < _height; y++) {
+            TapRows taps;
+            for (int j = 0; j < Taps; j++) {
+                int row = std::clamp(y + j - Width, 0, _height - 1);
+                taps.ao[j] = &m_horizontal[static_cast<size_t>(row) * _width + x0];
+                taps.nx[j] = _gbuffer.Row(Target::Normal, 0, row) + x0;
+                taps.ny[j] = _gbuffer.Row(Target::Normal, 1, row) + x0;
+                taps.nz[j] = _gbuffer.Row(Target::Normal, 2, row) + x0;
+                taps.depth[j] = _gbuffer.Row(Target::WorldPosition, 3, row) + x0;
+            }
+            Filter(taps, _ao + static_cast<size_t>(y) * _width + x0, columns);
+        }
+    });
+}
+
+void Emulator::AOBlur::Filter(const TapRows& _taps, float* _out, int _count) const {
+    if (m_level == Simd::Level::AVX2)
+        FilterAVX2(_taps, _out, _count);
+    else
+        FilterScalar(_taps, _out, 0, _count);
+}
+
+// Outputs _begin to _end.  A pixel none of whose taps face its way, as
+// where the geometry pass wrote nothing, keeps its own value.
+void Emulator::AOBlur::FilterScalar(const TapRows& _taps, float* _out, int _begin, int _end) const {
+    const float rangeScale = -1.0f / (2.0f * Variance);
+    for (int k = _begin; k < _end; k++) {
+        const float nx = _taps.nx[Width][k], ny = _taps.ny[Width][k], nz = _taps.nz[Width][k];
+        const float depth = _taps.depth[Width][k];
+        float sum = 0, total = 0;
+        for (int j = 0; j < Taps; j++) {
+            float facing = std::max(0.0f, nx * _taps.nx[j][k] + ny * _taps.ny[j][k] + nz * _taps.nz[j][k]);
+            float difference = _taps.depth[j][k] - depth;
+            float weight = m_weights[j] * facing * std::exp(difference * difference * rangeScale);
+            sum += weight * _taps.ao[j][k];
+            total += weight;
+        }
+        _out[k] = total > 0 ? sum / total : _taps.ao[Width][k];
+    }
+}
+
+// Eight outputs per iteration, the rest one at a time.
+SIMD_TARGET_AVX2 void Emulator::AOBlur::FilterAVX2(const TapRows& _taps, float* _out, int _count) const {
+#if SIMD_X86
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 rangeScale = _mm256_set1_ps(-Log2e / (2.0f * Variance));
+
+    int k = 0;
+    for (; k + 8 <= _count; k += 8) {
+        const __m256 nx = _mm256_loadu_ps(_taps.nx[Width] + k);
+        const __m256 ny = _mm256_loadu_ps(_taps.ny[Width] + k);
+        const __m256 nz = _mm256_loadu_ps(_taps.nz[Width] + k);
+        const __m256 depth = _mm256_loadu_ps(_taps.depth[Width] + k);
+        __m256 sum = zero, total = zero;
+        for (int j = 0; j < Taps; j++) {
+            __m256 facing = _mm256_mul_ps(nx, _mm256_loadu_ps(_taps.nx[j] + k));
+            facing = _mm256_fmadd_ps(ny, _mm256_loadu_ps(_taps.ny[j] + k), facing);
+            facing = _mm256_fmadd_ps(nz, _mm256_loadu_ps(_taps.nz[j] + k), facing);
+            facing = _mm256_max_ps(facing, zero);
+            __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(_taps.depth[j] + k), depth);
+            __m256 range = Simd::Exp2(_mm256_mul_ps(_mm256_mul_ps(difference, difference), rangeScale));
+            __m256 weight = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(m_weights[j]), facing), range);
+            sum = _mm256_fmadd_ps(weight, _mm256_loadu_ps(_taps.ao[j] + k), sum);
+            total = _mm256_add_ps(total, weight);
+        }
+        __m256 center = _mm256_loadu_ps(_taps.ao[Width] + k);
+        __m256 result = _mm256_div_ps(sum, total);
+        _mm256_storeu_ps(_out + k, _mm256_blendv_ps(center, result, _mm256_cmp_ps(total, zero, _CMP_GT_OQ)));
+    }
+    FilterScalar(_taps, _out, k, _count);
+#else
+    FilterScalar(_taps, _out, 0, _count);
+#endif
+}
@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of AOBlurmain and AOBlurmainV in AOShader.hlsl: a
+// separable bilateral blur of the ambient occlusion map, horizontal
+// then vertical.
+//
+// Each tap is weighted by the Gaussian of MomentBlur::GaussianWeights,
+// worked out once per blur, times the shader's Rf: the clamped dot of
+// the two normals and a Gaussian of their depth difference.  Rf's
+// normalization cancels between the sum and the total weight, so it is
+// left out, and each tap's Rf is evaluated once rather than twice.
+//
+// Rf reads depth from the w of the Normal target, which the geometry
+// pass leaves at 0, so on the GPU only the normals count.  Here the
+// depth is WorldPosition's w, as it was meant to be.
+//
+// Rows are filtered in parallel, then strips of columns.  Either way
+// eight neighbouring outputs share their taps' offsets, so AVX2 runs
+// eight of them at once with straight loads and a fast exp.  Edges are
+// clamped.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <vector>
+
+#include "ao.h"
+#include "gbuffer.h"
+#include "simd.h"
+
+namespace Emulator {
+    class AOBlur {
+    public:
+        static constexpr int Width = gwidth;    // Taps on each side
+        static constexpr int Taps = 2 * Width + 1;
+        static constexpr int StripWidth = 64;   // Columns per vertical work item
+        static constexpr float Variance = 0.01f; // Rf's s
+
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        // Blurs the _width * _height occlusion values of _ao in place,
+        // guided by _gbuffer of the same size.
+        void Blur(float* _ao, int _width, int _height, const GBuffer& _gbuffer);
+        void Blur(AmbientOcclusion& _ao, const GBuffer& _gbuffer);
+
+    private:
+        // Where each tap of a run of outputs reads: output k's tap j is
+        // at [j][k], and its center at [Width][k].
+        struct TapRows {
+            const float* ao[Taps];
+            const float* nx[Taps];
+            const float* ny[Taps];
+            const float* nz[Taps];
+            const float* depth[Taps];
+        };
+
+        void FilterScalar(const TapRows& _taps, float* _out, int _begin, int _end) const;
+        void FilterAVX2(const TapRows& _taps, float* _out, int _count) const;
+        void Filter(const TapRows& _taps, float* _out, int _count) const;
+
+        std::vector<float> m_weights;
+        std::vector<float> m_horizontal; // After the first pass
+        Simd::Level m_level = Simd::Level::Scalar;
+    };
+}
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////
+// Separable moment map blur on the CPU; see blur.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "blur.h"
+#include "moments.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static const float UnormScale = 65535.0f;
+
+std::vector<float> Emulator::MomentBlur::GaussianWeights(int _width) {
+    // A width of 0 leaves the map as it is
+    if (_width <= 0)
+        return { 1.0f };
+
+    std::vector<float> weights(2 * _width + 1);
+    float sum = 0;
+    for (int i = 0; i < 2 * _width + 1; i++) {
+        float x = (i - _width) / (_width / 2.f);
+        weights[i] = std::exp(-0.5f * x * x);
+        sum += weights[i];
+    }
+    for (float& weight : weights)
+        weight /= sum;
+    return weights;
+}
+
+// Box widths 2r+1 are picked as in "Fast Almost-Gaussian Filtering"
+// (Kovesi 2010): the passes use two neighbouring odd widths, as many of
+// each as brings the summed variance closest to the Gaussian's.
+std::vector<int> Emulator::MomentBlur::BoxRadii(int _width) {
+    if (_width <= 0)
+        return std::vector<int>(BoxPasses, 0);
+
+    const double sigma = _width / 2.0;
+    const double n = BoxPasses;
+    int lower = static_cast<int>(std::floor(std::sqrt(12 * sigma * sigma / n + 1)));
+    if (lower % 2 == 0)
+        lower--;
+    int upper = lower + 2;
+    int lowerCount = static_cast<int>(std::lround(
+        (12 * sigma * sigma - n * lower * lower - 4 * n * lower - 3 * n) / (-4 * lower - 4)
+    ));
+
+    std::vector<int> radii(BoxPasses);
+    for (int i = 0; i < BoxPasses; i++)
+        radii[i] = ((i < lowerCount ? lower : upper) - 1) / 2;
+    return radii;
+}
+
+// One dimension of the blur over _count texels.  _scratch has room for
+// _count texels and may be overwritten.
+void Emulator::MomentBlur::FilterLine(const Vector4* _in, Vector4* _out, Vector4* _scratch, int _count) const {
+    auto at = [&](const Vector4* _line, int _i) { return _line[std::clamp(_i, 0, _count - 1)]; };
+
+    if (!m_boxes) {
+        const int width = static_cast<int>(m_weights.size()) / 2;
+        for (int x = 0; x < _count; x++) {
+            Vector4 sum;
+            if (x >= width && x + width < _count) {
+                const Vector4* window = _in + x - width;
+                for (size_t j = 0; j < m_weights.size(); j++)
+                    sum += window[j] * m_weights[j];
+            }
+            else {
+                for (int j = 0; j < static_cast<int>(m_weights.size()); j++)
+                    sum += at(_in, x + j - width) * m_weights[j];
+            }
+            _out[x] = sum;
+        }
+        return;
+    }
+
+    // Box passes ping-pong between _out and _scratch, arranged so the
+    // last one lands in _out.
+    const Vector4* source = _in;
+    Vector4* target = BoxPasses % 2 ? _out : _scratch;
+    for (int radius : m_radii) {
+        const float scale = 1.0f / (2 * radius + 1);
+        Vector4 sum = source[0] * static_cast<float>(radius + 1);
+        for (int i = 1; i <= radius; i++)
+            sum += at(source, i);
+        for (int x = 0; x < _count; x++) {
+            target[x] = sum * scale;
+            sum += at(source, x + radius + 1) - at(source, x - radius);
+        }
+        source = target;
+        target = target == _out ? _scratch : _out;
+    }
+}
+
+void Emulator::MomentBlur::Blur(uint16_t* _texels, int _width, int _height, int _blurWidth) {
+    if (_blurWidth <= 0 || _width <= 0 || _height <= 0)
+        return;
+    m_weights = GaussianWeights(_blurWidth);
+    m_radii = BoxRadii(_blurWidth);
+    m_boxes = m_mode == Mode::Box && *std::max_element(m_radii.begin(), m_radii.end()) > 0;
+    m_texels.resize(static_cast<size_t>(_width) * _height);
+
+    // Horizontal: rows in parallel, straight from the texels
+    ThreadPool::Get().ParallelFor(_height, [&](uint32_t _y) {
+        thread_local std::vector<Vector4> line, scratch;
+        line.resize(_width);
+        scratch.resize(_width);
+        const uint16_t* in = _texels + static_cast<size_t>(_y) * _width * 4;
+        for (int x = 0; x < _width; x++)
+            line[x] = Vector4(in[x * 4], in[x * 4 + 1], in[x * 4 + 2], in[x * 4 + 3]) * (1.0f / UnormScale);
+        FilterLine(line.data(), &m_texels[static_cast<size_t>(_y) * _width], scratch.data(), _width);
+    });
+
+    // Vertical: strips of columns in parallel.  A strip is copied into
+    // one contiguous line per column, filtered, and written back
+    // saturated like Map2.
+    const uint32_t strips = (_width + StripWidth - 1) / StripWidth;
+    ThreadPool::Get().ParallelFor(strips, [&](uint32_t _strip) {
+        thread_local std::vector<Vector4> lines, filtered, scratch;
+        const int x0 = _strip * StripWidth;
+        const int columns = std::min(StripWidth, _width - x0);
+        lines.resize(static_cast<size_t>(columns) * _height);
+        filtered.resize(static_cast<size_t>(columns) * _height);
+        scratch.resize(_height);
+        for (int y = 0; y < _height; y++) {
+            const Vector4* row = &m_texels[static_cast<size_t>(y) * _width + x0];
+            for (int c = 0; c < columns; c++)
+                lines[static_cast<size_t>(c) * _height + y] = row[c];
+        }
+        for (int c = 0; c < columns; c++)
+            FilterLine(&lines[static_cast<size_t>(c) * _height], &filtered[static_cast<size_t>(c) * _height], scratch.data(), _height);
+        for (int y = 0; y < _height; y++) {
+            uint16_t* out = _texels + (static_cast<size_t>(y) * _width + x0) * 4;
+            for (int c = 0; c < columns; c++) {
+                Vector4 v = filtered[static_cast<size_t>(c) * _height + y];
+                v.Clamp(Vector4(0, 0, 0, 0), Vector4(1, 1, 1, 1));
+                v *= UnormScale;
+                out[c * 4 + 0] = static_cast<uint16_t>(std::nearbyint(v.x));
+                out[c * 4 + 1] = static_cast<uint16_t>(std::nearbyint(v.y));
+                out[c * 4 + 2] = static_cast<uint16_t>(std::nearbyint(v.z));
+                out[c * 4 + 3] = static_cast<uint16_t>(std::nearbyint(v.w));
+            }
+        }
+    });
+}
+
+void Emulator::MomentBlur::Blur(MomentShadowMap& _map, int _blurWidth) {
+    Blur(_map.m_moments.data(), _map.m_width, _map.m_height, _blurWidth);
+}
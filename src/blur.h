@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of ComputeShader.hlsl: a separable blur of a
+// moment shadow map, horizontal then vertical.
+//
+// Exact mode convolves with the same truncated Gaussian the shader
+// uses (standard deviation half the blur width), so its cost grows with
+// the width.  Box mode approximates that Gaussian with three box
+// filters of matching variance, each run as a sliding window sum, so a
+// texel costs the same at any width.  Widths too small for any box
+// fall back to the exact kernel, which is then only a few taps.
+//
+// Rows are filtered in parallel, then strips of columns.  Edges are
+// clamped.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+namespace Emulator {
+    class MomentShadowMap;
+
+    class MomentBlur {
+    public:
+        enum class Mode {
+            Exact,
+            Box
+        };
+
+        static constexpr int BoxPasses = 3;
+        static constexpr int StripWidth = 16; // Columns per vertical work item
+
+        Mode m_mode = Mode::Box;
+
+        // The normalized weights of a blur of half width _width, as
+        // Scene::SetBlurWidth uploads them for the compute shader.
+        static std::vector<float> GaussianWeights(int _width);
+
+        // Radii of the BoxPasses box filters whose sum approximates the
+        // Gaussian of GaussianWeights(_width).
+        static std::vector<int> BoxRadii(int _width);
+
+        // Blurs _width * _height RGBA16 unorm texels in place.
+        void Blur(uint16_t* _texels, int _width, int _height, int _blurWidth);
+        void Blur(MomentShadowMap& _map, int _blurWidth);
+
+    private:
+        using Vector4 = DirectX::SimpleMath::Vector4;
+
+        void FilterLine(const Vector4* _in, Vector4* _out, Vector4* _scratch, int _count) const;
+
+        std::vector<float> m_weights;
+        std::vector<int> m_radii;
+        bool m_boxes = false; // Box passes for this Blur call, or m_weights
+        std::vector<Vector4> m_texels; // The map as floats between passes
+    };
+}
@@ -0,0 +1,175 @@
+////////////////////////////////////////////////////////////////////////
+// GGX terms and the split-sum table on the CPU; see brdf.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "brdf.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static const float pi = 3.14159f; // As in lightingPhongPixel.hlsl
+
+// With tan^2 = (1 - NH^2) / NH^2, the shader's
+// a^2 / (pi NH^4 (a^2 + tan^2)^2) is a^2 / (pi (NH^2 (a^2 - 1) + 1)^2).
+float Emulator::GGX::Distribution(float _NH, float _roughness) {
+    float a2 = _roughness * _roughness;
+    float d = _NH * _NH * (a2 - 1.0f) + 1.0f;
+    return a2 / (pi * d * d);
+}
+
+// The shader's 2 / (1 + sqrt(1 + a^2 tan^2)), multiplied through by the
+// cosine.
+float Emulator::GGX::G1(float _cosine, float _roughness) {
+    float a2 = _roughness * _roughness;
+    return 2.0f * _cosine / (_cosine + std::sqrt(a2 + (1.0f - a2) * _cosine * _cosine));
+}
+
+float Emulator::GGX::Geometry(float _NL, float _NV, float _roughness) {
+    return G1(_NL, _roughness) * G1(_NV, _roughness);
+}
+
+float Emulator::GGX::FresnelWeight(float _LH) {
+    float m = 1.0f - _LH;
+    float m2 = m * m;
+    return m2 * m2 * m;
+}
+
+Vector2 Emulator::GGX::Hammersley(uint32_t _i, uint32_t _count) {
+    uint32_t bits = _i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return Vector2(static_cast<float>(_i) / static_cast<float>(_count), static_cast<float>(bits) * 2.3283064365386963e-10f);
+}
+
+Vector3 Emulator::GGX::ImportanceSample(const Vector2& _u, float _roughness) {
+    float a2 = _roughness * _roughness;
+    float phi = 2.0f * pi * _u.y;
+    float cosTheta = std::sqrt((1.0f - _u.x) / (1.0f + (a2 - 1.0f) * _u.x));
+    float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+    return Vector3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+
+void Emulator::GGX::Evaluate(
+    const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+    float* _specular, float* _fresnel, int _count
+) const {
+    static const Simd::Level supported = Simd::Detect();
+    if (std::min(m_simdLevel, supported) == Simd::Level::AVX2)
+        EvaluateAVX2(_NL, _NV, _NH, _LH, _roughness, _specular, _fresnel, _count);
+    else
+        EvaluateScalar(_NL, _NV, _NH, _LH, _roughness, _specular, _fresnel, 0, _count);
+}
+
+// G / (4 N.L N.V) cancels down to 1 / ((N.L + root L) (N.V + root V)),
+// leaving one division per sample.
+void Emulator::GGX::EvaluateScalar(
+    const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+    float* _specular, float* _fresnel, int _begin, int _end
+) const {
+    for (int i = _begin; i < _end; i++) {
+        float NL = _NL[i], NV = _NV[i], NH = _NH[i], LH = _LH[i];
+        if (!(NL > MinCosine && NV > MinCosine && NH > MinCosine && LH > MinCosine)) {
+            _specular[i] = 0;
+            _fresnel[i] = 0;
+            continue;
+        }
+        float a2 = _roughness[i] * _roughness[i];
+        float d = NH * NH * (a2 - 1.0f) + 1.0f;
+        float rootL = std::sqrt(a2 + (1.0f - a2) * NL * NL);
+        float rootV = std::sqrt(a2 + (1.0f - a2) * NV * NV);
+        _specular[i] = a2 / (pi * d * d * (NL + rootL) * (NV + rootV));
+        _fresnel[i] = FresnelWeight(LH);
+    }
+}
+
+// Eight samples per iteration, the rest one at a time.
+SIMD_TARGET_AVX2 void Emulator::GGX::EvaluateAVX2(
+    const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+    float* _specular, float* _fresnel, int _count
+) const {
+#if SIMD_X86
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minCosine = _mm256_set1_ps(MinCosine);
+    const __m256 piv = _mm256_set1_ps(pi);
+
+    int i = 0;
+    for (; i + 8 <= _count; i += 8) {
+        __m256 NL = _mm256_loadu_ps(_NL + i);
+        __m256 NV = _mm256_loadu_ps(_NV + i);
+        __m256 NH = _mm256_loadu_ps(_NH + i);
+        __m256 LH = _mm256_loadu_ps(_LH + i);
+        __m256 roughness = _mm256_loadu_ps(_roughness + i);
+        __m256 valid = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(NL, minCosine, _CMP_GT_OQ), _mm256_cmp_ps(NV, minCosine, _CMP_GT_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(NH, minCosine, _CMP_GT_OQ), _mm256_cmp_ps(LH, minCosine, _CMP_GT_OQ))
+        );
+
+        __m256 a2 = _mm256_mul_ps(roughness, roughness);
+        __m256 oneMinusA2 = _mm256_sub_ps(one, a2);
+        __m256 d = _mm256_fmadd_ps(_mm256_mul_ps(NH, NH), _mm256_sub_ps(a2, one), one);
+        __m256 rootL = _mm256_sqrt_ps(_mm256_fmadd_ps(oneMinusA2, _mm256_mul_ps(NL, NL), a2));
+        __m256 rootV = _mm256_sqrt_ps(_mm256_fmadd_ps(oneMinusA2, _mm256_mul_ps(NV, NV), a2));
+        __m256 denominator = _mm256_mul_ps(_mm256_mul_ps(piv, _mm256_mul_ps(d, d)),
+            _mm256_mul_ps(_mm256_add_ps(NL, rootL), _mm256_add_ps(NV, rootV)));
+        __m256 specular = _mm256_div_ps(a2, denominator);
+
+        __m256 m = _mm256_sub_ps(one, LH);
+        __m256 m2 = _mm256_mul_ps(m, m);
+        __m256 fresnel = _mm256_mul_ps(_mm256_mul_ps(m2, m2), m);
+
+        _mm256_storeu_ps(_specular + i, _mm256_and_ps(specular, valid));
+        _mm256_storeu_ps(_fresnel + i, _mm256_and_ps(fresnel, valid));
+    }
+    EvaluateScalar(_NL, _NV, _NH, _LH, _roughness, _specular, _fresnel, i, _count);
+#else
+    EvaluateScalar(_NL, _NV, _NH, _LH, _roughness, _specular, _fresnel, 0, _count);
+#endif
+}
+
+// Karis' integration, with V in the xz plane about N = +z.  Each sample
+// weighs G V.H / (N.H N.V), the BRDF times N.L over the pdf of L.
+Vector2 Emulator::SplitSumTable::Integrate(float _NV, float _roughness, int _samples) {
+    const Vector3 V(std::sqrt(std::max(0.0f, 1.0f - _NV * _NV)), 0, _NV);
+    double scale = 0, bias = 0;
+    for (int i = 0; i < _samples; i++) {
+        Vector3 H = GGX::ImportanceSample(GGX::Hammersley(i, _samples), _roughness);
+        float VH = V.Dot(H);
+        Vector3 L = 2.0f * VH * H - V;
+        float NL = L.z;
+        if (NL <= 0 || VH <= 0)
+            continue;
+        float visibility = GGX::Geometry(NL, _NV, _roughness) * VH / (H.z * _NV);
+        float fresnel = GGX::FresnelWeight(VH);
+        scale += (1.0f - fresnel) * visibility;
+        bias += fresnel * visibility;
+    }
+    return Vector2(static_cast<float>(scale / _samples), static_cast<float>(bias / _samples));
+}
+
+void Emulator::SplitSumTable::Bake(int _size, int _samples) {
+    m_table = Image(_size, _size);
+    ThreadPool::Get().ParallelFor(_size, [&](uint32_t _y) {
+        float roughness = (_y + 0.5f) / _size;
+        for (int x = 0; x < _size; x++) {
+            Vector2 entry = Integrate((x + 0.5f) / _size, roughness, _samples);
+            m_table.At(x, _y) = Vector4(entry.x, entry.y, 0, 1);
+        }
+    });
+}
+
+Vector2 Emulator::SplitSumTable::Lookup(float _NV, float _roughness) const {
+    float x = std::clamp(_NV * m_table.m_width - 0.5f, 0.0f, m_table.m_width - 1.0f);
+    float y = std::clamp(_roughness * m_table.m_height - 0.5f, 0.0f, m_table.m_height - 1.0f);
+    int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, m_table.m_width - 1), y1 = std::min(y0 + 1, m_table.m_height - 1);
+    float tx = x - x0, ty = y - y0;
+    Vector4 top = m_table.At(x0, y0) * (1 - tx) + m_table.At(x1, y0) * tx;
+    Vector4 bottom = m_table.At(x0, y1) * (1 - tx) + m_table.At(x1, y1) * tx;
+    Vector4 entry = top * (1 - ty) + bottom * ty;
+    return Vector2(entry.x, entry.y);
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////
+// The GGX microfacet terms of lightingPhongPixel.hlsl on the CPU, and
+// the split-sum table that folds them out of image based lighting.
+//
+// GGX evaluates Distribution, Geometry and the Schlick Fresnel weight
+// for batches of samples given as the usual dot products.  The shader's
+// forms go through tan(theta) with a sqrt and a division each; these
+// are the same functions rewritten in the cosines, which AVX2 runs
+// eight samples at a time.  Roughness is the GGX alpha, as in the
+// shader.
+//
+// SplitSumTable bakes Karis' environment BRDF: for each N.V and
+// roughness, the scale and bias to F0 of the specular BRDF integrated
+// over the hemisphere, from Hammersley points importance sampled like
+// the shader's Importance.  Prefiltered radiance times F0 * scale +
+// bias then stands in for the whole sample loop.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+
+#include "image.h"
+#include "simd.h"
+
+namespace Emulator {
+    class GGX {
+    public:
+        // Below this, the shader treats a dot product as grazing and
+        // leaves the specular term out.
+        static constexpr float MinCosine = 0.0001f;
+
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        static float Distribution(float _NH, float _roughness);
+        static float G1(float _cosine, float _roughness);
+        static float Geometry(float _NL, float _NV, float _roughness);
+        static float FresnelWeight(float _LH); // (1 - L.H)^5; F = Ks + (1 - Ks) * weight
+
+        // The Hammersley point i of _count, as in the shader.
+        static DirectX::SimpleMath::Vector2 Hammersley(uint32_t _i, uint32_t _count);
+
+        // The shader's Importance: a half vector drawn from the GGX
+        // distribution for uniform _u, about +z.
+        static DirectX::SimpleMath::Vector3 ImportanceSample(const DirectX::SimpleMath::Vector2& _u, float _roughness);
+
+        // For _count samples, writes D * G / (4 N.L N.V) to _specular and
+        // the Fresnel weight to _fresnel.  Grazing samples get 0 for both.
+        void Evaluate(
+            const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+            float* _specular, float* _fresnel, int _count
+        ) const;
+
+    private:
+        void EvaluateScalar(
+            const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+            float* _specular, float* _fresnel, int _begin, int _end
+        ) const;
+        void EvaluateAVX2(
+            const float* _NL, const float* _NV, const float* _NH, const float* _LH, const float* _roughness,
+            float* _specular, float* _fresnel, int _count
+        ) const;
+    };
+
+    class SplitSumTable {
+    public:
+        static constexpr int DefaultSize = 64;
+        static constexpr int DefaultSamples = 1024;
+
+        // x is N.V and y roughness, both at texel centers; the texels
+        // hold the scale in x and the bias in y.
+        Image m_table;
+
+        // Integrates one entry.
+        static DirectX::SimpleMath::Vector2 Integrate(float _NV, float _roughness, int _samples);
+
+        // Rows in parallel.
+        void Bake(int _size = DefaultSize, int _samples = DefaultSamples);
+
+        // Bilinear, clamped to the table.
+        DirectX::SimpleMath::Vector2 Lookup(float _NV, float _roughness) const;
+    };
+}
@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////
+// Clustered light assignment; see cluster.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "cluster.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+// Slice boundaries are widened by this fraction of their depth, so a
+// pixel whose depth rounds into the next slice still finds its lights
+static const float SliceSlack = 0.001f;
+
+int Emulator::LightClusters::Slice(float _depth) const {
+    if (!(_depth > m_near))
+        return 0;
+    return std::clamp(static_cast<int>(std::floor(std::log2(_depth) * m_scale + m_bias)), 0, Slices - 1);
+}
+
+void Emulator::LightClusters::Build(
+    const std::vector<ShaderData::Light>& _lights,
+    const Matrix& _worldView,
+    const Matrix& _worldProj,
+    int _width, int _height, float _near, float _far,
+    const LightBVH* _bvh
+) {
+    m_width = _width;
+    m_height = _height;
+    m_tilesX = (_width + TileSize - 1) / TileSize;
+    m_tilesY = (_height + TileSize - 1) / TileSize;
+    m_near = _near;
+    m_far = _far;
+    m_scale = Slices / std::log2(_far / _near);
+    m_bias = -std::log2(_near) * m_scale;
+    m_projX = _worldProj._11;
+    m_projY = _worldProj._22;
+    const int clusters = m_tilesX * m_tilesY * Slices;
+
+    // View space x / depth at a pixel's left edge, and y / depth at its
+    // top edge
+    auto tanX = [&](int _pixel) { return (2.0f * _pixel / m_width - 1.0f) / m_projX; };
+    auto tanY = [&](int _pixel) { return (1.0f - 2.0f * _pixel / m_height) / m_projY; };
+    auto depthOf = [&](int _slice) { return std::exp2((_slice - m_bias) / m_scale); };
+
+    // Bound each light by the box of its sphere.  x / depth over the box
+    // is extreme at its corners, and likewise y / depth.
+    m_bounds.resize(_lights.size());
+    const uint32_t tasks = static_cast<uint32_t>((_lights.size() + LightsPerTask - 1) / LightsPerTask);
+    ThreadPool::Get().ParallelFor(tasks, [&](uint32_t _task) {
+        const size_t end = std::min(_lights.size(), static_cast<size_t>(_task + 1) * LightsPerTask);
+        for (size_t i = static_cast<size_t>(_task) * LightsPerTask; i < end; i++) {
+            Vector3 view = Vector3::Transform(_lights[i].lightPos, _worldView);
+            Bounds& bounds = m_bounds[i];
+            bounds.center = Vector3(view.x, view.y, -view.z);
+            bounds.radius = _lights[i].range;
+            bounds.x0 = 1;
+            bounds.x1 = 0;
+
+            const float r = bounds.radius;
+            const float nearest = std::max(bounds.center.z - r, m_near), farthest = bounds.center.z + r;
+            if (farthest < m_near || nearest > m_far)
+                continue;
+            float minX = std::min((bounds.center.x - r) / nearest, (bounds.center.x - r) / farthest);
+            float maxX = std::max((bounds.center.x + r) / nearest, (bounds.center.x + r) / farthest);
+            float minY = std::min((bounds.center.y - r) / nearest, (bounds.center.y - r) / farthest);
+            float maxY = std::max((bounds.center.y + r) / nearest, (bounds.center.y + r) / farthest);
+
+            // To pixels, y down
+            float left = (minX * m_projX + 1.0f) * 0.5f * m_width, right = (maxX * m_projX + 1.0f) * 0.5f * m_width;
+            float top = (1.0f - maxY * m_projY) * 0.5f * m_height, bottom = (1.0f - minY * m_projY) * 0.5f * m_height;
+            if (right < 0 || left > m_width || bottom < 0 || top > m_height)
+                continue;
+            bounds.x0 = std::clamp(static_cast<int>(std::floor(left / TileSize)), 0, m_tilesX - 1);
+            bounds.x1 = std::clamp(static_cast<int>(std::floor(right / TileSize)), 0, m_tilesX - 1);
+            bounds.y0 = std::clamp(static_cast<int>(std::floor(top / TileSize)), 0, m_tilesY - 1);
+            bounds.y1 = std::clamp(static_cast<int>(std::floor(bottom / TileSize)), 0, m_tilesY - 1);
+            bounds.z0 = Slice(nearest * (1.0f - SliceSlack));
+            bounds.z1 = Slice(farthest * (1.0f + SliceSlack));
+        }
+    });
+
+    // Cuts need each BVH node's virtual light
+    const bool aggregate = m_aggregate && _bvh && !_bvh->m_nodes.empty();
+    m_virtualLights.resize(aggregate ? _bvh->m_nodes.size() : 0);
+    for (uint32_t n = 0; n < m_virtualLights.size(); n++)
+        m_virtualLights[n] = _bvh->VirtualLight(n);
+
+    // With a BVH, find each slice's candidates all at once: the view
+    // frustum's sides, and planes at the slice's depths, widened as
+    // below.  View depth is -(p * _worldView).z, and _worldView is
+    // rigid, so its column is already a unit normal.
+    if (_bvh && !aggregate) {
+        const LightBVH::Frustum view = LightBVH::FrustumOf(_worldView * _worldProj);
+        const Vector3 forward(-_worldView._13, -_worldView._23, -_worldView._33);
+        m_slabs.assign(Slices, view);
+        for (int z = 0; z < Slices; z++) {
+            const float depth0 = depthOf(z) * (1.0f - SliceSlack), depth1 = depthOf(z + 1) * (1.0f + SliceSlack);
+            m_slabs[z].planes[LightBVH::Frustum::Near] = Vector4(forward.x, forward.y, forward.z, -_worldView._43 - depth0);
+            m_slabs[z].planes[LightBVH::Frustum::Far] = Vector4(-forward.x, -forward.y, -forward.z, _worldView._43 + depth1);
+        }
+        _bvh->Query(_lights, m_slabs, m_candidates);
+    }
+
+    // Each slice fills its own clusters, so no two tasks touch a list
+    m_lists.resize(clusters);
+    ThreadPool::Get().ParallelFor(Slices, [&](uint32_t _slice) {
+        const int z = static_cast<int>(_slice);
+        const float depth0 = depthOf(z) * (1.0f - SliceSlack), depth1 = depthOf(z + 1) * (1.0f + SliceSlack);
+        for (int cluster = Index(0, 0, z); cluster < Index(0, 0, z + 1); cluster++)
+            m_lists[cluster].clear();
+
+        // In view space proper, the cluster's z runs from -depth1 to
+        // -depth0
+        if (aggregate) {
+            for (int y = 0; y < m_tilesY; y++) {
+                const float t0 = tanY(std::min((y + 1) * TileSize, m_height)), t1 = tanY(y * TileSize);
+                const float minY = std::min(t0 * depth0, t0 * depth1), maxY = std::max(t1 * depth0, t1 * depth1);
+                for (int x = 0; x < m_tilesX; x++) {
+                    const float s0 = tanX(x * TileSize), s1 = tanX(std::min((x + 1) * TileSize, m_width));
+                    const float minX = std::min(s0 * depth0, s0 * depth1), maxX = std::max(s1 * depth0, s1 * depth1);
+                    _bvh->Cut(
+                        _lights, _worldView, Vector3(minX, minY, -depth1), Vector3(maxX, maxY, -depth0),
+                        m_maxError, m_minError, m_lists[Index(x, y, z)]
+                    );
+                }
+            }
+            return;
+        }
+
+        const uint32_t count = _bvh ? static_cast<uint32_t>(m_candidates[z].size()) : static_cast<uint32_t>(m_bounds.size());
+        for (uint32_t j = 0; j < count; j++) {
+            const uint32_t i = _bvh ? m_candidates[z][j] : j;
+            const Bounds& bounds = m_bounds[i];
+            if (bounds.x0 > bounds.x1 || z < bounds.z0 || z > bounds.z1)
+                continue;
+            const float distanceZ = std::max({ depth0 - bounds.center.z, bounds.center.z - depth1, 0.0f });
+            const float radius2 = bounds.radius * bounds.radius - distanceZ * distanceZ;
+            if (radius2 < 0)
+                continue;
+            for (int y = bounds.y0; y <= bounds.y1; y++) {
+                // The cluster's box spans both ends of the slice
+                const float t0 = tanY(std::min((y + 1) * TileSize, m_height)), t1 = tanY(y * TileSize);
+                const float minY = std::min(t0 * depth0, t0 * depth1), maxY = std::max(t1 * depth0, t1 * depth1);
+                const float distanceY = std::max({ minY - bounds.center.y, bounds.center.y - maxY, 0.0f });
+                if (distanceY * distanceY > radius2)
+                    continue;
+                for (int x = bounds.x0; x <= bounds.x1; x++) {
+                    const float s0 = tanX(x * TileSize), s1 = tanX(std::min((x + 1) * TileSize, m_width));
+                    const float minX = std::min(s0 * depth0, s0 * depth1), maxX = std::max(s1 * depth0, s1 * depth1);
+                    const float distanceX = std::max({ minX - bounds.center.x, bounds.center.x - maxX, 0.0f });
+                    if (distanceX * distanceX + distanceY * distanceY <= radius2)
+                        m_lists[Index(x, y, z)].push_back(i);
+                }
+            }
+        }
+    });
+
+    m_ranges.resize(clusters);
+    m_statistics = {};
+    uint32_t offset = 0;
+    for (int cluster = 0; cluster < clusters; cluster++) {
+        const uint32_t count = static_cast<uint32_t>(m_lists[cluster].size());
+        m_ranges[cluster] = { offset, count };
+        offset += count;
+        m_statistics.clusters += count > 0;
+        if (aggregate)
+            m_statistics.virtualReferences += m_lists[cluster].end() -
+                std::lower_bound(m_lists[cluster].begin(), m_lists[cluster].end(), static_cast<uint32_t>(_lights.size()));
+    }
+    m_statistics.references = offset;
+
+    m_indices.resize(offset);
+    ThreadPool::Get().ParallelFor(Slices, [&](uint32_t _slice) {
+        const int z = static_cast<int>(_slice);
+        for (int cluster = Index(0, 0, z); cluster < Index(0, 0, z + 1); cluster++)
+            std::copy(m_lists[cluster].begin(), m_lists[cluster].end(), m_indices.begin() + m_ranges[cluster].offset);
+    });
+}
+
+void Emulator::LightClusters::Pack(ShaderData::Constants& _constants) const {
+    _constants.clusterScale = m_scale;
+    _constants.clusterBias = m_bias;
+    _constants.clusterTilesX = m_tilesX;
+    _constants.clusterTilesY = m_tilesY;
+    _constants.clusterSlices = Slices;
+    _constants.clusterTileSize = TileSize;
+}
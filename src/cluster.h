@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////
+// Clustered light assignment: the view frustum is cut into TileSize
+// pixel tiles on screen and Slices depth slices, and every cluster gets
+// the list of lights whose sphere of influence reaches it.  The
+// lighting pass then finds a pixel's cluster from its position and
+// view depth, and only loops over that list.
+//
+// Slices are exponential in view depth between the near and far
+// planes, so clusters stay roughly cube shaped at every distance.  A
+// light is first bounded to a block of clusters by projecting its
+// sphere's box, and each cluster of the block then tests the sphere
+// against its own view space box.
+//
+// Building is three parallel steps: lights are bounded in batches,
+// each slice fills its clusters' lists from the lights that reach it,
+// and, after a prefix sum over the clusters, each slice copies its
+// lists into one compact index array.  Lists keep the lights in order,
+// so the result doesn't depend on the thread count.
+//
+// Given a LightBVH over the same lights, each slice only looks at the
+// lights the BVH finds in its slab of the view frustum, rather than at
+// every light, which is what keeps tens of thousands of lights cheap.
+//
+// With m_aggregate set and a LightBVH, each cluster instead gets the
+// BVH's Lightcuts style cut for its box, so that a distant group of
+// lights costs one virtual light rather than one entry per light.  The
+// virtual lights are m_virtualLights, indexed after the real ones.
+// The error bound holds over the whole cluster, which takes a finer
+// cut than a pixel would need; DeferredLighting cuts for the smaller
+// boxes of its tiles instead.
+//
+// m_ranges and m_indices are laid out as the lighting shader's
+// ClusterRanges and ClusterLights.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+#include "lightbvh.h"
+
+namespace Emulator {
+    class LightClusters {
+    public:
+        static constexpr int TileSize = 64;        // Pixels on a side of a cluster
+        static constexpr int Slices = 24;
+        static constexpr int LightsPerTask = 256;  // Lights bounded per work item
+
+        // A cluster's lights are m_indices[offset] on, count of them
+        struct Range {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        struct Statistics {
+            uint64_t clusters = 0;      // Clusters with at least one light
+            uint64_t references = 0;    // Entries of m_indices
+            uint64_t virtualReferences = 0; // Of those, to virtual lights
+        };
+
+        bool m_aggregate = false;
+        float m_maxError = 0.02f;   // LightBVH::Cut's, for both lighting passes
+        float m_minError = 0.001f;
+
+        // Per BVH node while m_aggregate is in effect, else empty.  Entry
+        // i of m_indices at or past the light count is virtual light
+        // i - light count.
+        std::vector<ShaderData::Light> m_virtualLights;
+
+        int m_tilesX = 0, m_tilesY = 0;
+        float m_scale = 0, m_bias = 0;  // The slice of view depth d is log2(d) * m_scale + m_bias
+        std::vector<Range> m_ranges;    // Cluster (x, y, z) at (z * m_tilesY + y) * m_tilesX + x
+        std::vector<uint32_t> m_indices;
+        Statistics m_statistics;
+
+        // Assigns _lights to the clusters of a _width by _height view
+        // through _worldView and the perspective _worldProj, whose near
+        // and far planes are _near and _far.  _bvh, if given, must be
+        // built or refit over _lights as they are now.
+        void Build(
+            const std::vector<ShaderData::Light>& _lights,
+            const DirectX::SimpleMath::Matrix& _worldView,
+            const DirectX::SimpleMath::Matrix& _worldProj,
+            int _width, int _height, float _near, float _far,
+            const LightBVH* _bvh = nullptr
+        );
+
+        int Slice(float _depth) const;
+        int Index(int _x, int _y, int _z) const { return (_z * m_tilesY + _y) * m_tilesX + _x; }
+
+        // The cluster grid's parameters, for the lighting shader
+        void Pack(ShaderData::Constants& _constants) const;
+
+    private:
+        // The block of clusters a light's sphere may reach, inclusive;
+        // empty when x0 > x1.
+        struct Bounds {
+            DirectX::SimpleMath::Vector3 center; // View space, with z the depth in front of the camera
+            float radius;
+            int x0, x1, y0, y1, z0, z1;
+        };
+
+        std::vector<Bounds> m_bounds;
+        std::vector<std::vector<uint32_t>> m_lists; // Per cluster, while building
+        std::vector<LightBVH::Frustum> m_slabs;      // Per slice, with a LightBVH
+        std::vector<std::vector<uint32_t>> m_candidates;
+        int m_width = 0, m_height = 0;
+        float m_projX = 1, m_projY = 1;
+        float m_near = 0, m_far = 0;
+    };
+}
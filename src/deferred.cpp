@@ -0,0 +1,321 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of the lighting pass: lightingPhongPixel.hlsl's
+// main() run over the emulated G-buffer.
+//
+// The screen is split into small tiles that are lit in parallel.  Each
+// tile first bounds the world positions it holds and keeps only the
+// lights whose range reaches that box, so most of the scene's lights
+// are never looked at per pixel.  Given LightClusters built for the
+// same view, a tile only tests the lights of the clusters it covers,
+// so not even the box test looks at every light.  Pixels are then
+// shaded eight at a time with AVX2, or one at a time where that is not
+// available.
+//
+// When the clusters aggregate distant lights, a tile takes the light
+// BVH's cut for its own box instead, which is far smaller than a
+// cluster's, so fewer virtual lights meet the same error bound.
+////////////////////////////////////////////////////////////////////////
+
+#include "deferred.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+using Target = Emulator::GBuffer::Target;
+
+static const float pi = 3.14159f; // As in lightingPhongPixel.hlsl
+
+void Emulator::DeferredLighting::Resolve(
+    const GBuffer& _gbuffer,
+    const ShaderData::Constants& _constants,
+    const std::vector<ShaderData::Light>& _lights,
+    const LightClusters* _clusters,
+    const LightBVH* _bvh
+) {
+    static_assert(LightClusters::TileSize % TileSize == 0, "tiles must not straddle clusters");
+    const bool fits = _clusters &&
+        _clusters->m_tilesX == (_gbuffer.m_width + LightClusters::TileSize - 1) / LightClusters::TileSize &&
+        _clusters->m_tilesY == (_gbuffer.m_height + LightClusters::TileSize - 1) / LightClusters::TileSize;
+    m_clusters = fits ? _clusters : nullptr;
+    m_bvh = m_clusters && !m_clusters->m_virtualLights.empty() ? _bvh : nullptr;
+    if (m_output.m_width != _gbuffer.m_width || m_output.m_height != _gbuffer.m_height)
+        m_output = Image(_gbuffer.m_width, _gbuffer.m_height);
+
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+
+    // Virtual lights are indexed after the real ones
+    m_lights = {};
+    const size_t virtualLights = m_bvh ? m_clusters->m_virtualLights.size() : 0;
+    for (size_t j = 0; j < _lights.size() + virtualLights; j++) {
+        const ShaderData::Light& light = j < _lights.size() ? _lights[j] : m_clusters->m_virtualLights[j - _lights.size()];
+        m_lights.x.push_back(light.lightPos.x);
+        m_lights.y.push_back(light.lightPos.y);
+        m_lights.z.push_back(light.lightPos.z);
+        m_lights.r.push_back(light.lightColor.x);
+        m_lights.g.push_back(light.lightColor.y);
+        m_lights.b.push_back(light.lightColor.z);
+        m_lights.range.push_back(light.range);
+    }
+
+    m_tilesX = (_gbuffer.m_width + TileSize - 1) / TileSize;
+    m_tilesY = (_gbuffer.m_height + TileSize - 1) / TileSize;
+    m_tileStatistics.assign(static_cast<size_t>(m_tilesX) * m_tilesY, {});
+
+    Vector3 camera = _constants.CameraPos;
+    ThreadPool::Get().ParallelFor(m_tilesX * m_tilesY, [&](uint32_t _tile) {
+        ResolveTile(_tile, _gbuffer, camera, _lights);
+    });
+
+    m_statistics = {};
+    for (auto& tile : m_tileStatistics) {
+        m_statistics.tiles += tile.tiles;
+        m_statistics.tileLights += tile.tileLights;
+    }
+    m_clusters = nullptr;
+    m_bvh = nullptr;
+}
+
+// The lights of the clusters over the tile at (_x0, _y0) between the
+// two depths, each once and in order.
+void Emulator::DeferredLighting::GatherClusterLights(
+    int _x0, int _y0, float _minDepth, float _maxDepth, std::vector<uint32_t>& _candidates
+) const {
+    const int x = _x0 / LightClusters::TileSize, y = _y0 / LightClusters::TileSize;
+    const int z0 = m_clusters->Slice(_minDepth), z1 = m_clusters->Slice(_maxDepth);
+    _candidates.clear();
+    for (int z = z0; z <= z1; z++) {
+        const LightClusters::Range& range = m_clusters->m_ranges[m_clusters->Index(x, y, z)];
+        _candidates.insert(
+            _candidates.end(),
+            m_clusters->m_indices.begin() + range.offset,
+            m_clusters->m_indices.begin() + range.offset + range.count
+        );
+    }
+    if (z1 > z0) {
+        std::sort(_candidates.begin(), _candidates.end());
+        _candidates.erase(std::unique(_candidates.begin(), _candidates.end()), _candidates.end());
+    }
+}
+
+// Keeps the lights whose sphere of influence touches the box, out of
+// _candidates or, without them, all lights.
+void Emulator::DeferredLighting::CullLights(
+    const Vector3& _min, const Vector3& _max, const std::vector<uint32_t>* _candidates, std::vector<uint32_t>& _visible
+) const {
+    _visible.clear();
+    const uint32_t count = _candidates ? static_cast<uint32_t>(_candidates->size()) : static_cast<uint32_t>(m_lights.x.size());
+    for (uint32_t j = 0; j < count; j++) {
+        const uint32_t i = _candidates ? (*_candidates)[j] : j;
+        float dx = std::max({ _min.x - m_lights.x[i], m_lights.x[i] - _max.x, 0.0f });
+        float dy = std::max({ _min.y - m_lights.y[i], m_lights.y[i] - _max.y, 0.0f });
+        float dz = std::max({ _min.z - m_lights.z[i], m_lights.z[i] - _max.z, 0.0f });
+        if (dx * dx + dy * dy + dz * dz <= m_lights.range[i] * m_lights.range[i])
+            _visible.push_back(i);
+    }
+}
+
+void Emulator::DeferredLighting::ResolveTile(
+    uint32_t _tile, const GBuffer& _gbuffer, const Vector3& _camera, const std::vector<ShaderData::Light>& _lights
+) {
+    const int x0 = (_tile % m_tilesX) * TileSize;
+    const int y0 = (_tile / m_tilesX) * TileSize;
+    const int x1 = std::min(x0 + TileSize, _gbuffer.m_width);
+    const int y1 = std::min(y0 + TileSize, _gbuffer.m_height);
+
+    // Bounds of the positions the shader will light.  Pixels with no
+    // specular color just pass their diffuse color through.
+    Vector3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    float minDepth = FLT_MAX, maxDepth = -FLT_MAX;
+    bool anyLit = false;
+    for (int y = y0; y < y1; y++) {
+        const float* sx = _gbuffer.Row(Target::SpecularAlpha, 0, y);
+        const float* sy = _gbuffer.Row(Target::SpecularAlpha, 1, y);
+        const float* sz = _gbuffer.Row(Target::SpecularAlpha, 2, y);
+        const float* px = _gbuffer.Row(Target::WorldPosition, 0, y);
+        const float* py = _gbuffer.Row(Target::WorldPosition, 1, y);
+        const float* pz = _gbuffer.Row(Target::WorldPosition, 2, y);
+        const float* pw = _gbuffer.Row(Target::WorldPosition, 3, y);
+        for (int x = x0; x < x1; x++) {
+            if (sx[x] == 0 && sy[x] == 0 && sz[x] == 0)
+                continue;
+            anyLit = true;
+            lo = Vector3::Min(lo, Vector3(px[x], py[x], pz[x]));
+            hi = Vector3::Max(hi, Vector3(px[x], py[x], pz[x]));
+            minDepth = std::min(minDepth, pw[x]);
+            maxDepth = std::max(maxDepth, pw[x]);
+        }
+    }
+
+    thread_local std::vector<uint32_t> visible, candidates;
+    visible.clear();
+    if (anyLit) {
+        if (m_bvh)
+            m_bvh->Cut(_lights, Matrix::Identity, lo, hi, m_clusters->m_maxError, m_clusters->m_minError, visible);
+        else {
+            if (m_clusters)
+                GatherClusterLights(x0, y0, minDepth, maxDepth, candidates);
+            CullLights(lo, hi, m_clusters ? &candidates : nullptr, visible);
+        }
+        m_tileStatistics[_tile].tiles = 1;
+        m_tileStatistics[_tile].tileLights = visible.size();
+    }
+
+    for (int y = y0; y < y1; y++) {
+        if (m_level == Simd::Level::AVX2) {
+            for (int x = x0; x < x1; x += 8)
+                ShadeAVX2(_gbuffer, _camera, visible, x, y);
+        }
+        else {
+            for (int x = x0; x < x1; x++)
+                ShadeScalar(_gbuffer, _camera, visible, x, y);
+        }
+    }
+}
+
+void Emulator::DeferredLighting::ShadeScalar(
+    const GBuffer& _gbuffer, const Vector3& _camera, const std::vector<uint32_t>& _visible, int _x, int _y
+) {
+    Vector4 specularAlpha = _gbuffer.Load(Target::SpecularAlpha, _x, _y);
+    Vector4 diffuse = _gbuffer.Load(Target::Diffuse, _x, _y);
+    if (specularAlpha.x == 0 && specularAlpha.y == 0 && specularAlpha.z == 0) {
+        m_output.At(_x, _y) = Vector4(diffuse.x, diffuse.y, diffuse.z, 1);
+        return;
+    }
+
+    Vector4 position = _gbuffer.Load(Target::WorldPosition, _x, _y);
+    Vector4 normal = _gbuffer.Load(Target::Normal, _x, _y);
+    Vector3 worldPosition(position.x, position.y, position.z);
+    Vector3 specular(specularAlpha.x, specularAlpha.y, specularAlpha.z);
+    float roughness = specularAlpha.w;
+    Vector3 N(normal.x, normal.y, normal.z);
+    N.Normalize();
+    Vector3 V = _camera - worldPosition;
+    V.Normalize();
+    Vector3 Kd(diffuse.x, diffuse.y, diffuse.z);
+
+    Vector3 finalColor;
+    for (uint32_t i : _visible) {
+        Vector3 lightPos(m_lights.x[i], m_lights.y[i], m_lights.z[i]);
+        Vector3 lightColor(m_lights.r[i], m_lights.g[i], m_lights.b[i]);
+        float range = m_lights.range[i];
+        float dist = (lightPos - worldPosition).Length();
+        if (dist > range)
+            continue;
+        Vector3 L = (lightPos - worldPosition) / dist;
+        Vector3 H = L + V;
+        H.Normalize();
+        float NL = std::max(N.Dot(L), 0.0f);
+        float HN = std::max(H.Dot(N), 0.0f);
+        float att = (10.f / (dist * dist)) - (10.f / (range * range));
+        finalColor += (Kd / pi) * lightColor * std::min(NL, 1.0f) * att;
+        finalColor += lightColor * specular * std::pow(HN, roughness) * att;
+    }
+    m_output.At(_x, _y) = Vector4(finalColor.x, finalColor.y, finalColor.z, 1);
+}
+
+#if SIMD_X86
+SIMD_TARGET_AVX2 static __m256 Dot3(__m256 _ax, __m256 _ay, __m256 _az, __m256 _bx, __m256 _by, __m256 _bz) {
+    return _mm256_fmadd_ps(_ax, _bx, _mm256_fmadd_ps(_ay, _by, _mm256_mul_ps(_az, _bz)));
+}
+#endif
+
+// Eight pixels starting at (_x, _y).  G-buffer rows are padded to a
+// multiple of 16 floats, so the loads never leave the row; only the
+// stores are limited to the image.
+SIMD_TARGET_AVX2 void Emulator::DeferredLighting::ShadeAVX2(
+    const GBuffer& _gbuffer, const Vector3& _camera, const std::vector<uint32_t>& _visible, int _x, int _y
+) {
+#if SIMD_X86
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 sx = _mm256_load_ps(_gbuffer.Row(Target::SpecularAlpha, 0, _y) + _x);
+    __m256 sy = _mm256_load_ps(_gbuffer.Row(Target::SpecularAlpha, 1, _y) + _x);
+    __m256 sz = _mm256_load_ps(_gbuffer.Row(Target::SpecularAlpha, 2, _y) + _x);
+    __m256 dr = _mm256_load_ps(_gbuffer.Row(Target::Diffuse, 0, _y) + _x);
+    __m256 dg = _mm256_load_ps(_gbuffer.Row(Target::Diffuse, 1, _y) + _x);
+    __m256 db = _mm256_load_ps(_gbuffer.Row(Target::Diffuse, 2, _y) + _x);
+    __m256 lit = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(sx, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(sy, zero, _CMP_NEQ_UQ)),
+        _mm256_cmp_ps(sz, zero, _CMP_NEQ_UQ)
+    );
+
+    __m256 outR = dr, outG = dg, outB = db;
+    if (_mm256_movemask_ps(lit)) {
+        __m256 roughness = _mm256_load_ps(_gbuffer.Row(Target::SpecularAlpha, 3, _y) + _x);
+        __m256 px = _mm256_load_ps(_gbuffer.Row(Target::WorldPosition, 0, _y) + _x);
+        __m256 py = _mm256_load_ps(_gbuffer.Row(Target::WorldPosition, 1, _y) + _x);
+        __m256 pz = _mm256_load_ps(_gbuffer.Row(Target::WorldPosition, 2, _y) + _x);
+        __m256 nx = _mm256_load_ps(_gbuffer.Row(Target::Normal, 0, _y) + _x);
+        __m256 ny = _mm256_load_ps(_gbuffer.Row(Target::Normal, 1, _y) + _x);
+        __m256 nz = _mm256_load_ps(_gbuffer.Row(Target::Normal, 2, _y) + _x);
+
+        __m256 scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(Dot3(nx, ny, nz, nx, ny, nz)));
+        nx = _mm256_mul_ps(nx, scale);
+        ny = _mm256_mul_ps(ny, scale);
+        nz = _mm256_mul_ps(nz, scale);
+
+        __m256 vx = _mm256_sub_ps(_mm256_set1_ps(_camera.x), px);
+        __m256 vy = _mm256_sub_ps(_mm256_set1_ps(_camera.y), py);
+        __m256 vz = _mm256_sub_ps(_mm256_set1_ps(_camera.z), pz);
+        scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(Dot3(vx, vy, vz, vx, vy, vz)));
+        vx = _mm256_mul_ps(vx, scale);
+        vy = _mm256_mul_ps(vy, scale);
+        vz = _mm256_mul_ps(vz, scale);
+
+        const __m256 invPi = _mm256_set1_ps(1.0f / pi);
+        __m256 kr = _mm256_mul_ps(dr, invPi), kg = _mm256_mul_ps(dg, invPi), kb = _mm256_mul_ps(db, invPi);
+        __m256 accR = zero, accG = zero, accB = zero;
+
+        for (uint32_t i : _visible) {
+            __m256 lx = _mm256_sub_ps(_mm256_set1_ps(m_lights.x[i]), px);
+            __m256 ly = _mm256_sub_ps(_mm256_set1_ps(m_lights.y[i]), py);
+            __m256 lz = _mm256_sub_ps(_mm256_set1_ps(m_lights.z[i]), pz);
+            __m256 dist2 = Dot3(lx, ly, lz, lx, ly, lz);
+            float range = m_lights.range[i];
+            __m256 mask = _mm256_and_ps(lit, _mm256_cmp_ps(dist2, _mm256_set1_ps(range * range), _CMP_LE_OQ));
+            if (!_mm256_movemask_ps(mask))
+                continue;
+
+            __m256 invDist = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(dist2));
+            lx = _mm256_mul_ps(lx, invDist);
+            ly = _mm256_mul_ps(ly, invDist);
+            lz = _mm256_mul_ps(lz, invDist);
+            __m256 hx = _mm256_add_ps(lx, vx), hy = _mm256_add_ps(ly, vy), hz = _mm256_add_ps(lz, vz);
+            scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(Dot3(hx, hy, hz, hx, hy, hz)));
+
+            __m256 NL = _mm256_min_ps(_mm256_max_ps(Dot3(nx, ny, nz, lx, ly, lz), zero), _mm256_set1_ps(1.0f));
+            __m256 HN = _mm256_max_ps(_mm256_mul_ps(Dot3(hx, hy, hz, nx, ny, nz), scale), zero);
+            __m256 att = _mm256_sub_ps(
+                _mm256_div_ps(_mm256_set1_ps(10.0f), dist2), _mm256_set1_ps(10.0f / (range * range))
+            );
+            att = _mm256_and_ps(att, mask);
+            __m256 diffuseTerm = _mm256_mul_ps(NL, att);
+            __m256 specularTerm = _mm256_mul_ps(Simd::Pow(HN, roughness), att);
+
+            __m256 lr = _mm256_set1_ps(m_lights.r[i]);
+            __m256 lg = _mm256_set1_ps(m_lights.g[i]);
+            __m256 lb = _mm256_set1_ps(m_lights.b[i]);
+            accR = _mm256_fmadd_ps(lr, _mm256_fmadd_ps(kr, diffuseTerm, _mm256_mul_ps(sx, specularTerm)), accR);
+            accG = _mm256_fmadd_ps(lg, _mm256_fmadd_ps(kg, diffuseTerm, _mm256_mul_ps(sy, specularTerm)), accG);
+            accB = _mm256_fmadd_ps(lb, _mm256_fmadd_ps(kb, diffuseTerm, _mm256_mul_ps(sz, specularTerm)), accB);
+        }
+        outR = _mm256_blendv_ps(outR, accR, lit);
+        outG = _mm256_blendv_ps(outG, accG, lit);
+        outB = _mm256_blendv_ps(outB, accB, lit);
+    }
+
+    alignas(32) float r[8], g[8], b[8];
+    _mm256_store_ps(r, outR);
+    _mm256_store_ps(g, outG);
+    _mm256_store_ps(b, outB);
+    int count = std::min(8, m_output.m_width - _x);
+    Vector4* out = &m_output.At(_x, _y);
+    for (int i = 0; i < count; i++)
+        out[i] = Vector4(r[i], g[i], b[i], 1);
+#else
+    for (int i = _x; i < std::min(_x + 8, m_output.m_width); i++)
+        ShadeScalar(_gbuffer, _camera, _visible, i, _y);
+#endif
+}
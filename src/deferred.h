@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of the lighting pass: lightingPhongPixel.hlsl's
+// main() run over the emulated G-buffer.
+//
+// The screen is split into small tiles that are lit in parallel.  Each
+// tile first bounds the world positions it holds and keeps only the
+// lights whose range reaches that box, so most of the scene's lights
+// are never looked at per pixel.  Given LightClusters built for the
+// same view, a tile only tests the lights of the clusters it covers,
+// so not even the box test looks at every light.  Pixels are then
+// shaded eight at a time with AVX2, or one at a time where that is not
+// available.
+//
+// When the clusters aggregate distant lights, a tile takes the light
+// BVH's cut for its own box instead, which is far smaller than a
+// cluster's, so fewer virtual lights meet the same error bound.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+#include "cluster.h"
+#include "gbuffer.h"
+#include "image.h"
+#include "simd.h"
+
+namespace Emulator {
+    class DeferredLighting {
+    public:
+        static constexpr int TileSize = 16; // Pixels on a side of a light culling tile
+
+        struct Statistics {
+            uint64_t tiles = 0;         // Tiles holding at least one lit pixel
+            uint64_t tileLights = 0;    // Light/tile pairs that survived culling
+        };
+
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        Image m_output; // Lit color, alpha 1
+        Statistics m_statistics;
+
+        // Lights _gbuffer as seen from _constants.CameraPos, with the
+        // lights narrowed down by _clusters first if given.  If those
+        // aggregate, _bvh must be the one they were built with.
+        void Resolve(
+            const GBuffer& _gbuffer,
+            const ShaderData::Constants& _constants,
+            const std::vector<ShaderData::Light>& _lights,
+            const LightClusters* _clusters = nullptr,
+            const LightBVH* _bvh = nullptr
+        );
+
+    private:
+        // Light parameters as structure of arrays, for broadcasting
+        struct LightArrays {
+            std::vector<float> x, y, z;
+            std::vector<float> r, g, b;
+            std::vector<float> range;
+        };
+
+        void ResolveTile(
+            uint32_t _tile, const GBuffer& _gbuffer, const DirectX::SimpleMath::Vector3& _camera,
+            const std::vector<ShaderData::Light>& _lights
+        );
+        void GatherClusterLights(int _x0, int _y0, float _minDepth, float _maxDepth, std::vector<uint32_t>& _candidates) const;
+        void CullLights(
+            const DirectX::SimpleMath::Vector3& _min, const DirectX::SimpleMath::Vector3& _max,
+            const std::vector<uint32_t>* _candidates, std::vector<uint32_t>& _visible
+        ) const;
+        void ShadeScalar(
+            const GBuffer& _gbuffer, const DirectX::SimpleMath::Vector3& _camera,
+            const std::vector<uint32_t>& _visible, int _x, int _y
+        );
+        void ShadeAVX2(
+            const GBuffer& _gbuffer, const DirectX::SimpleMath::Vector3& _camera,
+            const std::vector<uint32_t>& _visible, int _x, int _y
+        );
+
+        LightArrays m_lights;
+        const LightClusters* m_clusters = nullptr; // For the Resolve in progress
+        const LightBVH* m_bvh = nullptr;           // Likewise, when cutting
+        int m_tilesX = 0, m_tilesY = 0;
+        Simd::Level m_level = Simd::Level::Scalar;
+        std::vector<Statistics> m_tileStatistics;
+    };
+}
@@ -1,5 +1,1098 @@
-
-
-
-
-// This file is intentionally blank
+////////////////////////////////////////////////////////////////////////
+// A software emulation of the graphics pipeline, used to draw the
+// scene without a GPU.  Objects are submitted exactly as Object::Draw
+// submits them to D3D12: one shape plus one ShaderData::Object per
+// draw, under the ShaderData::Constants of the frame.
+//
+// The pipeline is sort-middle: every draw's triangles are transformed,
+// clipped and set up in parallel chunks, binned into screen tiles, and
+// then each tile is rasterized independently on its own thread.
+// Clipping is limited to the near and far planes and a guard band far
+// outside the screen, and setup handles eight triangles at a time.
+// Within a tile, triangles are walked in 8x8 blocks whose coverage is
+// found with SIMD, so whole blocks are rejected or accepted at once.
+// A min/max depth hierarchy over tiles and blocks rejects occluded
+// triangles and blocks before any per-pixel work.  Surviving pixels run
+// the equivalent of geometryPhongPixel.hlsl into a CPU G-buffer.
+////////////////////////////////////////////////////////////////////////
+
+#include "emulator.h"
+#include "image.h"
+#include "rply.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+using namespace DirectX::SimpleMath;
+
+////////////////////////////////////////////////////////////////////////
+// Mesh
+
+std::shared_ptr<Emulator::Mesh> Emulator::Mesh::CreateCustom(
+    const DirectX::GeometricPrimitive::VertexCollection& _vertices,
+    const DirectX::GeometricPrimitive::IndexCollection& _indices
+) {
+    auto mesh = std::make_shared<Mesh>();
+    mesh->m_positions.reserve(_vertices.size());
+    mesh->m_normals.reserve(_vertices.size());
+    mesh->m_texCoords.reserve(_vertices.size());
+    mesh->m_minP = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+    mesh->m_maxP = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (auto& vertex : _vertices) {
+        mesh->m_positions.push_back(vertex.position);
+        mesh->m_normals.push_back(vertex.normal);
+        mesh->m_texCoords.push_back(vertex.textureCoordinate);
+        mesh->m_minP = Vector3::Min(mesh->m_minP, vertex.position);
+        mesh->m_maxP = Vector3::Max(mesh->m_maxP, vertex.position);
+    }
+    mesh->m_indices.assign(_indices.begin(), _indices.end());
+    return mesh;
+}
+
+namespace {
+    // Filled by the rply callbacks below
+    struct PlyReader {
+        DirectX::GeometricPrimitive::VertexCollection* vertices;
+        DirectX::GeometricPrimitive::IndexCollection* indices;
+        std::vector<uint32_t> face;
+        bool normals = false;
+    };
+
+    int PlyVertex(p_ply_argument _argument) {
+        PlyReader* reader;
+        long component;
+        long index;
+        ply_get_argument_user_data(_argument, reinterpret_cast<void**>(&reader), &component);
+        ply_get_argument_element(_argument, nullptr, &index);
+        auto& vertex = (*reader->vertices)[index];
+        float value = static_cast<float>(ply_get_argument_value(_argument));
+        switch (component) {
+        case 0: vertex.position.x = value; break;
+        case 1: vertex.position.y = value; break;
+        case 2: vertex.position.z = value; break;
+        case 3: vertex.normal.x = value; break;
+        case 4: vertex.normal.y = value; break;
+        case 5: vertex.normal.z = value; break;
+        case 6: vertex.textureCoordinate.x = value; break;
+        case 7: vertex.textureCoordinate.y = value; break;
+        }
+        return 1;
+    }
+
+    // Polygons are split into fans of triangles
+    int PlyFace(p_ply_argument _argument) {
+        PlyReader* reader;
+        long length, slot;
+        ply_get_argument_user_data(_argument, reinterpret_cast<void**>(&reader), nullptr);
+        ply_get_argument_property(_argument, nullptr, &length, &slot);
+        if (slot < 0) {
+            reader->face.clear();
+            return 1;
+        }
+        reader->face.push_back(static_cast<uint32_t>(ply_get_argument_value(_argument)));
+        if (slot == length - 1)
+            for (size_t i = 2; i < reader->face.size(); i++) {
+                reader->indices->push_back(reader->face[0]);
+                reader->indices->push_back(reader->face[i - 1]);
+                reader->indices->push_back(reader->face[i]);
+            }
+        return 1;
+    }
+}
+
+void Emulator::Mesh::ReadPly(
+    const std::string& _filename,
+    DirectX::GeometricPrimitive::VertexCollection& _vertices,
+    DirectX::GeometricPrimitive::IndexCollection& _indices
+) {
+    p_ply ply = ply_open(_filename.c_str(), nullptr, 0, nullptr);
+    if (!ply)
+        throw std::runtime_error("failed to open " + _filename);
+    if (!ply_read_header(ply)) {
+        ply_close(ply);
+        throw std::runtime_error("failed to read the header of " + _filename);
+    }
+
+    PlyReader reader{ &_vertices, &_indices };
+    const char* properties[] = { "x", "y", "z", "nx", "ny", "nz", "s", "t" };
+    long count = 0;
+    for (long i = 0; i < 8; i++) {
+        long found = ply_set_read_cb(ply, "vertex", properties[i], PlyVertex, &reader, i);
+        count = std::max(count, found);
+        reader.normals = reader.normals || (i >= 3 && i <= 5 && found);
+    }
+    ply_set_read_cb(ply, "face", "vertex_indices", PlyFace, &reader, 0);
+
+    _vertices.assign(count, {});
+    _indices.clear();
+    bool read = ply_read(ply);
+    ply_close(ply);
+    if (!read)
+        throw std::runtime_error("failed to read " + _filename);
+
+    // PLY files list faces counterclockwise seen from outside; the
+    // right handed GeometricPrimitive shapes are the other way around.
+    for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+        std::swap(_indices[i + 1], _indices[i + 2]);
+
+    if (reader.normals)
+        return;
+    for (size_t i = 0; i + 2 < _indices.size(); i += 3) {
+        auto& a = _vertices[_indices[i]];
+        auto& b = _vertices[_indices[i + 1]];
+        auto& c = _vertices[_indices[i + 2]];
+        Vector3 ab = Vector3(b.position) - Vector3(a.position);
+        Vector3 ac = Vector3(c.position) - Vector3(a.position);
+        Vector3 n = ac.Cross(ab);
+        for (auto* vertex : { &a, &b, &c })
+            vertex->normal = Vector3(vertex->normal) + n;
+    }
+    for (auto& vertex : _vertices) {
+        Vector3 n = vertex.normal;
+        n.Normalize();
+        vertex.normal = n;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Rasterizer
+
+void Emulator::Rasterizer::Resize(int _width, int _height) {
+    if (_width == m_width && _height == m_height)
+        return;
+    m_width = _width;
+    m_height = _height;
+    m_tilesX = (m_width + TileSize - 1) / TileSize;
+    m_tilesY = (m_height + TileSize - 1) / TileSize;
+    m_blocksX = m_tilesX * (TileSize / BlockSize);
+    m_blocksY = m_tilesY * (TileSize / BlockSize);
+    m_depth.resize(static_cast<size_t>(m_width) * m_height);
+    m_gbuffer.Resize(m_width, m_height);
+    m_blockMin.resize(static_cast<size_t>(m_blocksX) * m_blocksY);
+    m_blockMax.resize(static_cast<size_t>(m_blocksX) * m_blocksY);
+    m_tileMin.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+    m_tileMax.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+    m_tileStatistics.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+}
+
+void Emulator::Rasterizer::Begin(const ShaderData::Constants& _constants) {
+    m_constants = _constants;
+    m_viewProj = m_constants.WorldView * m_constants.WorldProj;
+    m_draws.clear();
+    m_triangleCount = 0;
+    m_statistics = {};
+
+    // Same clear values as Scene::DrawGeometry
+    float clearDepth = m_reverseZ ? 0.0f : 1.0f;
+    m_depthSign = m_reverseZ ? -1.0f : 1.0f;
+    std::fill(m_depth.begin(), m_depth.end(), clearDepth);
+    m_gbuffer.Clear(Vector4(0, 0, 0, 1));
+    std::fill(m_blockMin.begin(), m_blockMin.end(), m_depthSign * clearDepth);
+    std::fill(m_blockMax.begin(), m_blockMax.end(), m_depthSign * clearDepth);
+    std::fill(m_tileMin.begin(), m_tileMin.end(), m_depthSign * clearDepth);
+    std::fill(m_tileMax.begin(), m_tileMax.end(), m_depthSign * clearDepth);
+}
+
+void Emulator::Rasterizer::Submit(const Mesh& _mesh, const ShaderData::Object& _object, const Image* _texture) {
+    if (_mesh.m_indices.empty())
+        return;
+    m_draws.push_back({ &_mesh, _object, _texture, m_triangleCount });
+    m_triangleCount += _mesh.TriangleCount();
+}
+
+void Emulator::Rasterizer::End() {
+    uint32_t chunkCount = static_cast<uint32_t>((m_triangleCount + ChunkSize - 1) / ChunkSize);
+    if (m_chunks.size() < chunkCount)
+        m_chunks.resize(chunkCount);
+
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported);
+
+    ThreadPool& pool = ThreadPool::Get();
+    pool.ParallelFor(chunkCount, [&](uint32_t _chunk) { ProcessChunk(_chunk); });
+
+    m_statistics.submitted = m_triangleCount;
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        m_statistics.clipped += m_chunks[i].clipped;
+        m_statistics.transformed += m_chunks[i].transformed;
+        m_statistics.setup += m_chunks[i].triangles.size();
+    }
+
+    BinTriangles();
+    m_coverage = SelectCoverageKernel();
+    pool.ParallelFor(m_tilesX * m_tilesY, [&](uint32_t _tile) { RasterizeTile(_tile); });
+
+    for (auto& tile : m_tileStatistics) {
+        m_statistics.occludedTriangles += tile.occludedTriangles;
+        m_statistics.occludedBlocks += tile.occludedBlocks;
+    }
+}
+
+// Clips a convex polygon against the plane dot(_plane, v) >= 0.
+template <typename Vertex>
+static int ClipPolygon(const Vertex* _in, int _count, Vertex* _out, const Vector4& _plane) {
+    int outCount = 0;
+    for (int i = 0; i < _count; i++) {
+        const Vertex& a = _in[i];
+        const Vertex& b = _in[(i + 1) % _count];
+        float da = _plane.Dot(a.position);
+        float db = _plane.Dot(b.position);
+        if (da >= 0)
+            _out[outCount++] = a;
+        if ((da >= 0) != (db >= 0)) {
+            // Always step from the inside vertex, so the triangles on both
+            // sides of a shared edge get bit-identical new vertices and the
+            // edge stays watertight after snapping.
+            const Vertex& from = da >= 0 ? a : b;
+            const Vertex& to = da >= 0 ? b : a;
+            float dFrom = da >= 0 ? da : db, dTo = da >= 0 ? db : da;
+            float t = dFrom / (dFrom - dTo);
+            Vertex& v = _out[outCount++];
+            v.position = from.position + (to.position - from.position) * t;
+            for (size_t k = 0; k < std::size(v.attributes); k++)
+                v.attributes[k] = from.attributes[k] + (to.attributes[k] - from.attributes[k]) * t;
+        }
+    }
+    return outCount;
+}
+
+// Inside of the view volume: -w <= x <= w, -w <= y <= w, 0 <= z <= w,
+// followed by the guard band planes -g w <= x <= g w, -g w <= y <= g w.
+static const Vector4 ClipPlanes[10] = {
+    { 1, 0, 0, 1 }, { -1, 0, 0, 1 },
+    { 0, 1, 0, 1 }, { 0, -1, 0, 1 },
+    { 0, 0, 1, 0 }, { 0, 0, -1, 1 },
+    { 1, 0, 0, Emulator::Rasterizer::GuardBand }, { -1, 0, 0, Emulator::Rasterizer::GuardBand },
+    { 0, 1, 0, Emulator::Rasterizer::GuardBand }, { 0, -1, 0, Emulator::Rasterizer::GuardBand },
+};
+static const uint32_t ViewVolumePlanes = 0x3F;
+static const uint32_t ClippedPlanes = 0x3F0; // Near, far and the guard band
+
+void Emulator::Rasterizer::ProcessChunk(uint32_t _chunkIndex) {
+    Chunk& chunk = m_chunks[_chunkIndex];
+    chunk.triangles.clear();
+    chunk.refs.clear();
+    chunk.clipped = 0;
+    chunk.transformed = 0;
+
+    uint64_t first = static_cast<uint64_t>(_chunkIndex) * ChunkSize;
+    uint64_t last = std::min(first + ChunkSize, m_triangleCount);
+
+    // The draw holding the chunk's first triangle
+    auto it = std::upper_bound(m_draws.begin(), m_draws.end(), first,
+        [](uint64_t _triangle, const Draw& _draw) { return _triangle < _draw.firstTriangle; });
+    uint32_t drawIndex = static_cast<uint32_t>(it - m_draws.begin()) - 1;
+
+    thread_local VertexCache cache;
+    SetupBatch batch;
+    for (uint64_t triangle = first; triangle < last;) {
+        while (triangle >= m_draws[drawIndex].firstTriangle + m_draws[drawIndex].mesh->TriangleCount())
+            drawIndex++;
+        const Draw& draw = m_draws[drawIndex];
+        const Mesh& mesh = *draw.mesh;
+
+        // The chunk's triangles from this draw go through the vertex stage
+        // together, once per distinct index
+        uint64_t runEnd = std::min(last, draw.firstTriangle + mesh.TriangleCount());
+        const uint32_t* indices = &mesh.m_indices[(triangle - draw.firstTriangle) * 3];
+        size_t indexCount = static_cast<size_t>(runEnd - triangle) * 3;
+        CacheVertices(cache, mesh, indices, indexCount);
+        if (m_level == Simd::Level::AVX2)
+            TransformVerticesAVX2(draw, cache);
+        else
+            TransformVertices(draw, cache);
+        chunk.transformed += cache.indices.size();
+
+        for (size_t t = 0; t < indexCount; t += 3) {
+            const uint32_t slot[3] = {
+                cache.slot[indices[t]], cache.slot[indices[t + 1]], cache.slot[indices[t + 2]]
+            };
+
+            // Triangles past a side of the view volume but inside the
+            // guard band are left to the bounding box and edge functions;
+            // only the near and far planes and the guard band itself are
+            // clipped against.
+            uint32_t outside[3] = { cache.outside[slot[0]], cache.outside[slot[1]], cache.outside[slot[2]] };
+            if (outside[0] & outside[1] & outside[2] & ViewVolumePlanes)
+                continue;
+            ClipVertex clip[3] = { cache.vertices[slot[0]], cache.vertices[slot[1]], cache.vertices[slot[2]] };
+            uint32_t crossed = (outside[0] | outside[1] | outside[2]) & ClippedPlanes;
+            if (crossed == 0) {
+                QueueTriangle(chunk, batch, clip, drawIndex);
+                continue;
+            }
+
+            // Sutherland-Hodgman against every clipped plane the triangle
+            // crosses, near and far first so w is positive for the rest
+            chunk.clipped++;
+            ClipVertex polygon[2][9];
+            int count = 3;
+            int current = 0;
+            std::copy(clip, clip + 3, polygon[0]);
+            for (int p = 4; p < 10 && count >= 3; p++) {
+                if (crossed & (1u << p)) {
+                    count = ClipPolygon(polygon[current], count, polygon[current ^ 1], ClipPlanes[p]);
+                    current ^= 1;
+                }
+            }
+            for (int i = 1; i + 1 < count; i++) {
+                ClipVertex fan[3] = { polygon[current][0], polygon[current][i], polygon[current][i + 1] };
+                QueueTriangle(chunk, batch, fan, drawIndex);
+            }
+        }
+        triangle = runEnd;
+    }
+    FlushSetup(chunk, batch);
+}
+
+// Gives every distinct index in _indices a slot in the cache, and lists
+// the indices in the order their slots were handed out.
+void Emulator::Rasterizer::CacheVertices(VertexCache& _cache, const Mesh& _mesh, const uint32_t* _indices, size_t _count) {
+    if (_cache.stamp.size() < _mesh.m_positions.size()) {
+        _cache.stamp.resize(_mesh.m_positions.size(), 0);
+        _cache.slot.resize(_mesh.m_positions.size());
+    }
+    if (++_cache.generation == 0) {
+        std::fill(_cache.stamp.begin(), _cache.stamp.end(), 0);
+        _cache.generation = 1;
+    }
+
+    _cache.indices.clear();
+    for (size_t i = 0; i < _count; i++) {
+        uint32_t index = _indices[i];
+        if (_cache.stamp[index] != _cache.generation) {
+            _cache.stamp[index] = _cache.generation;
+            _cache.slot[index] = static_cast<uint32_t>(_cache.indices.size());
+            _cache.indices.push_back(index);
+        }
+    }
+    _cache.vertices.resize(_cache.indices.size());
+    _cache.outside.resize(_cache.indices.size());
+}
+
+// Vertex stage, as geometryPhongVert.hlsl, for every cached index
+void Emulator::Rasterizer::TransformVertices(const Draw& _draw, VertexCache& _cache) {
+    const Mesh& mesh = *_draw.mesh;
+    for (size_t v = 0; v < _cache.indices.size(); v++) {
+        uint32_t index = _cache.indices[v];
+        const Vector3& p = mesh.m_positions[index];
+        Vector4 world = Vector4::Transform(Vector4(p.x, p.y, p.z, 1), _draw.object.ModelTr);
+        Vector3 normal = Vector3::TransformNormal(mesh.m_normals[index], _draw.object.NormalTr);
+        normal.Normalize();
+        const Vector2& uv = mesh.m_texCoords[index];
+        ClipVertex& vertex = _cache.vertices[v];
+        vertex = {
+            Vector4::Transform(world, m_viewProj),
+            { world.x, world.y, world.z, normal.x, normal.y, normal.z, uv.x, uv.y }
+        };
+
+        uint32_t outside = 0;
+        for (int p = 0; p < 10; p++)
+            if (ClipPlanes[p].Dot(vertex.position) < 0)
+                outside |= 1u << p;
+        _cache.outside[v] = outside;
+    }
+}
+
+#if SIMD_X86
+// Row vector times the upper rows of a matrix: _x * m[0] + _y * m[1] + _z * m[2] (+ m[3])
+SIMD_TARGET_AVX2 static __m256 TransformRow(
+    const DirectX::SimpleMath::Matrix& _m, int _column, __m256 _x, __m256 _y, __m256 _z, bool _translate
+) {
+    __m256 result = _mm256_mul_ps(_x, _mm256_set1_ps(_m.m[0][_column]));
+    result = _mm256_add_ps(result, _mm256_mul_ps(_y, _mm256_set1_ps(_m.m[1][_column])));
+    result = _mm256_add_ps(result, _mm256_mul_ps(_z, _mm256_set1_ps(_m.m[2][_column])));
+    if (_translate)
+        result = _mm256_add_ps(result, _mm256_set1_ps(_m.m[3][_column]));
+    return result;
+}
+#endif
+
+// TransformVertices on eight vertices at a time, gathered into structure
+// of arrays.  The last batch repeats its final vertex to fill the lanes.
+SIMD_TARGET_AVX2 void Emulator::Rasterizer::TransformVerticesAVX2(const Draw& _draw, VertexCache& _cache) {
+#if SIMD_X86
+    const Mesh& mesh = *_draw.mesh;
+    const Matrix& model = _draw.object.ModelTr;
+    const Matrix& normalTr = _draw.object.NormalTr;
+    const size_t count = _cache.indices.size();
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 guardBand = _mm256_set1_ps(GuardBand);
+
+    for (size_t v0 = 0; v0 < count; v0 += 8) {
+        alignas(32) float in[8][8]; // px, py, pz, nx, ny, nz, u, v
+        for (int lane = 0; lane < 8; lane++) {
+            uint32_t index = _cache.indices[std::min(v0 + lane, count - 1)];
+            const Vector3& p = mesh.m_positions[index];
+            const Vector3& n = mesh.m_normals[index];
+            const Vector2& uv = mesh.m_texCoords[index];
+            in[0][lane] = p.x;
+            in[1][lane] = p.y;
+            in[2][lane] = p.z;
+            in[3][lane] = n.x;
+            in[4][lane] = n.y;
+            in[5][lane] = n.z;
+            in[6][lane] = uv.x;
+            in[7][lane] = uv.y;
+        }
+        __m256 px = _mm256_load_ps(in[0]), py = _mm256_load_ps(in[1]), pz = _mm256_load_ps(in[2]);
+        __m256 nx = _mm256_load_ps(in[3]), ny = _mm256_load_ps(in[4]), nz = _mm256_load_ps(in[5]);
+
+        // Model space to world, w stays 1 for affine ModelTr
+        __m256 wx = TransformRow(model, 0, px, py, pz, true);
+        __m256 wy = TransformRow(model, 1, px, py, pz, true);
+        __m256 wz = TransformRow(model, 2, px, py, pz, true);
+        __m256 ww = TransformRow(model, 3, px, py, pz, true);
+
+        // World to clip through WorldView * WorldProj
+        __m256 clip[4];
+        for (int c = 0; c < 4; c++)
+            clip[c] = _mm256_add_ps(TransformRow(m_viewProj, c, wx, wy, wz, false),
+                _mm256_mul_ps(ww, _mm256_set1_ps(m_viewProj.m[3][c])));
+
+        // Normal through NormalTr, normalized where it has a length
+        __m256 tx = TransformRow(normalTr, 0, nx, ny, nz, false);
+        __m256 ty = TransformRow(normalTr, 1, nx, ny, nz, false);
+        __m256 tz = TransformRow(normalTr, 2, nx, ny, nz, false);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)),
+            _mm256_mul_ps(tz, tz)));
+        __m256 hasLength = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+        tx = _mm256_blendv_ps(tx, _mm256_div_ps(tx, length), hasLength);
+        ty = _mm256_blendv_ps(ty, _mm256_div_ps(ty, length), hasLength);
+        tz = _mm256_blendv_ps(tz, _mm256_div_ps(tz, length), hasLength);
+
+        // Outcodes, in the order of ClipPlanes
+        __m256 x = clip[0], y = clip[1], z = clip[2], w = clip[3];
+        __m256 gw = _mm256_mul_ps(guardBand, w);
+        __m256 distances[10] = {
+            _mm256_add_ps(x, w), _mm256_sub_ps(w, x),
+            _mm256_add_ps(y, w), _mm256_sub_ps(w, y),
+            z, _mm256_sub_ps(w, z),
+            _mm256_add_ps(x, gw), _mm256_sub_ps(gw, x),
+            _mm256_add_ps(y, gw), _mm256_sub_ps(gw, y),
+        };
+        uint32_t planeMasks[10];
+        for (int p = 0; p < 10; p++)
+            planeMasks[p] = _mm256_movemask_ps(_mm256_cmp_ps(distances[p], zero, _CMP_LT_OQ));
+
+        alignas(32) float out[10][8]; // clip xyzw, world xyz, normal xyz
+        __m256 results[10] = { x, y, z, w, wx, wy, wz, tx, ty, tz };
+        for (int r = 0; r < 10; r++)
+            _mm256_store_ps(out[r], results[r]);
+
+        size_t lanes = std::min<size_t>(8, count - v0);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            ClipVertex& vertex = _cache.vertices[v0 + lane];
+            vertex.position = Vector4(out[0][lane], out[1][lane], out[2][lane], out[3][lane]);
+            vertex.attributes[WorldX] = out[4][lane];
+            vertex.attributes[WorldY] = out[5][lane];
+            vertex.attributes[WorldZ] = out[6][lane];
+            vertex.attributes[NormalX] = out[7][lane];
+            vertex.attributes[NormalY] = out[8][lane];
+            vertex.attributes[NormalZ] = out[9][lane];
+            vertex.attributes[TexU] = in[6][lane];
+            vertex.attributes[TexV] = in[7][lane];
+
+            uint32_t outside = 0;
+            for (int p = 0; p < 10; p++)
+                outside |= ((planeMasks[p] >> lane) & 1u) << p;
+            _cache.outside[v0 + lane] = outside;
+        }
+    }
+#else
+    TransformVertices(_draw, _cache);
+#endif
+}
+
+void Emulator::Rasterizer::QueueTriangle(Chunk& _chunk, SetupBatch& _batch, const ClipVertex* _clip, uint32_t _draw) {
+    int lane = _batch.count++;
+    for (int i = 0; i < 3; i++) {
+        _batch.x[i][lane] = _clip[i].position.x;
+        _batch.y[i][lane] = _clip[i].position.y;
+        _batch.z[i][lane] = _clip[i].position.z;
+        _batch.w[i][lane] = _clip[i].position.w;
+        for (int k = 0; k < AttributeCount; k++)
+            _batch.attributes[i][k][lane] = _clip[i].attributes[k];
+    }
+    _batch.draw[lane] = _draw;
+    if (_batch.count == SetupBatchSize)
+        FlushSetup(_chunk, _batch);
+}
+
+// Sets up the queued triangles, in queue order so each tile still sees
+// them in submission order.
+void Emulator::Rasterizer::FlushSetup(Chunk& _chunk, SetupBatch& _batch) {
+    if (_batch.count == 0)
+        return;
+#if SIMD_X86
+    if (m_level == Simd::Level::AVX2) {
+        SetupBatchAVX2(_chunk, _batch);
+        _batch.count = 0;
+        return;
+    }
+#endif
+    for (int lane = 0; lane < _batch.count; lane++)
+        SetupTriangle(_chunk, _batch, lane);
+    _batch.count = 0;
+}
+
+// Pixel centers are at (x + 0.5, y + 0.5), so a pixel is inside the
+// bounding box when its center is.
+static const int32_t HalfPixel = 1 << (Emulator::Rasterizer::SubPixelBits - 1);
+static const int32_t PixelRound = (1 << Emulator::Rasterizer::SubPixelBits) - 1 - HalfPixel;
+
+void Emulator::Rasterizer::SetupTriangle(Chunk& _chunk, const SetupBatch& _batch, int _lane) {
+    constexpr float SubPixel = static_cast<float>(1 << SubPixelBits);
+
+    // Perspective divide and viewport transform, snapped to the sub-pixel
+    // grid.  The guard band keeps the snapped coordinates well inside 32 bits.
+    int32_t X[3], Y[3];
+    float z[3], invW[3];
+    for (int i = 0; i < 3; i++) {
+        invW[i] = 1.0f / _batch.w[i][_lane];
+        float x = (_batch.x[i][_lane] * invW[i] * 0.5f + 0.5f) * m_width;
+        float y = (0.5f - _batch.y[i][_lane] * invW[i] * 0.5f) * m_height;
+        X[i] = static_cast<int32_t>(std::nearbyint(x * SubPixel));
+        Y[i] = static_cast<int32_t>(std::nearbyint(y * SubPixel));
+        z[i] = m_depthSign * _batch.z[i][_lane] * invW[i];
+    }
+
+    // Twice the signed area; positive is clockwise on screen, which D3D12
+    // treats as front facing.
+    int64_t area = int64_t(X[1] - X[0]) * (Y[2] - Y[0]) - int64_t(X[2] - X[0]) * (Y[1] - Y[0]);
+    if (area == 0)
+        return;
+    if ((m_cullMode == CullMode::Back && area < 0) || (m_cullMode == CullMode::Front && area > 0))
+        return;
+    int v1 = 1, v2 = 2;
+    if (area < 0)
+        std::swap(v1, v2);
+    const int order[3] = { 0, v1, v2 };
+
+    Triangle tri;
+    tri.draw = _batch.draw[_lane];
+
+    tri.minX = std::max((std::min({ X[0], X[1], X[2] }) + PixelRound) >> SubPixelBits, 0);
+    tri.minY = std::max((std::min({ Y[0], Y[1], Y[2] }) + PixelRound) >> SubPixelBits, 0);
+    tri.maxX = std::min((std::max({ X[0], X[1], X[2] }) - HalfPixel) >> SubPixelBits, m_width - 1);
+    tri.maxY = std::min((std::max({ Y[0], Y[1], Y[2] }) - HalfPixel) >> SubPixelBits, m_height - 1);
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return;
+
+    // Edge i runs from vertex order[i] to order[(i + 1) % 3]
+    for (int i = 0; i < 3; i++) {
+        int a = order[i], b = order[(i + 1) % 3];
+        tri.A[i] = Y[a] - Y[b];
+        tri.B[i] = X[b] - X[a];
+        tri.C[i] = -(tri.A[i] * X[a] + tri.B[i] * Y[a]);
+    }
+
+    // Depth, 1 / w and attribute / w are linear in screen space
+    float x0 = X[0] / SubPixel, y0 = Y[0] / SubPixel;
+    float x1 = X[v1] / SubPixel - x0, y1 = Y[v1] / SubPixel - y0;
+    float x2 = X[v2] / SubPixel - x0, y2 = Y[v2] / SubPixel - y0;
+    float invDet = 1.0f / (x1 * y2 - x2 * y1);
+    auto plane = [&](float _a0, float _a1, float _a2) -> Plane {
+        float d1 = _a1 - _a0, d2 = _a2 - _a0;
+        return { _a0, (d1 * y2 - d2 * y1) * invDet, (d2 * x1 - d1 * x2) * invDet };
+    };
+    tri.x0 = x0;
+    tri.y0 = y0;
+    tri.z = plane(z[0], z[v1], z[v2]);
+    tri.zMin = std::min({ z[0], z[1], z[2] });
+    tri.zMax = std::max({ z[0], z[1], z[2] });
+    tri.invW = plane(invW[0], invW[v1], invW[v2]);
+    for (int k = 0; k < AttributeCount; k++)
+        tri.attributes[k] = plane(
+            _batch.attributes[0][k][_lane] * invW[0],
+            _batch.attributes[v1][k][_lane] * invW[v1],
+            _batch.attributes[v2][k][_lane] * invW[v2]
+        );
+    EmitTriangle(_chunk, tri);
+}
+
+#if SIMD_X86
+// Plane equation through three vertices, eight triangles at a time.
+// Same arithmetic as the plane lambda in SetupTriangle.
+SIMD_TARGET_AVX2 static void PlaneAVX2(
+    __m256 _a0, __m256 _a1, __m256 _a2,
+    __m256 _x1, __m256 _y1, __m256 _x2, __m256 _y2, __m256 _invDet,
+    float* _a, float* _dx, float* _dy
+) {
+    __m256 d1 = _mm256_sub_ps(_a1, _a0), d2 = _mm256_sub_ps(_a2, _a0);
+    _mm256_store_ps(_a, _a0);
+    _mm256_store_ps(_dx, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(d1, _y2), _mm256_mul_ps(d2, _y1)), _invDet));
+    _mm256_store_ps(_dy, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(d2, _x1), _mm256_mul_ps(d1, _x2)), _invDet));
+}
+
+// Lane mask of a signed 64 bit area held as two halves of doubles
+SIMD_TARGET_AVX2 static uint32_t AreaSign(__m256d _lo, __m256d _hi, int _predicate) {
+    __m256d zero = _mm256_setzero_pd();
+    uint32_t lo, hi;
+    if (_predicate > 0) {
+        lo = _mm256_movemask_pd(_mm256_cmp_pd(_lo, zero, _CMP_GT_OQ));
+        hi = _mm256_movemask_pd(_mm256_cmp_pd(_hi, zero, _CMP_GT_OQ));
+    }
+    else {
+        lo = _mm256_movemask_pd(_mm256_cmp_pd(_lo, zero, _CMP_LT_OQ));
+        hi = _mm256_movemask_pd(_mm256_cmp_pd(_hi, zero, _CMP_LT_OQ));
+    }
+    return lo | (hi << 4);
+}
+#endif
+
+// SetupTriangle for a whole batch: the snapping, area, culling, bounding
+// box, edge slopes and plane equations are computed for eight triangles
+// at once, then the survivors are finished and binned one by one.
+SIMD_TARGET_AVX2 void Emulator::Rasterizer::SetupBatchAVX2(Chunk& _chunk, const SetupBatch& _batch) {
+#if SIMD_X86
+    constexpr float SubPixel = static_cast<float>(1 << SubPixelBits);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 width = _mm256_set1_ps(static_cast<float>(m_width));
+    const __m256 height = _mm256_set1_ps(static_cast<float>(m_height));
+    const __m256 subPixel = _mm256_set1_ps(SubPixel);
+    const __m256 toPixel = _mm256_set1_ps(1.0f / SubPixel);
+    const __m256 depthSign = _mm256_set1_ps(m_depthSign);
+
+    __m256i X[3], Y[3];
+    __m256 z[3], invW[3];
+    for (int i = 0; i < 3; i++) {
+        invW[i] = _mm256_div_ps(one, _mm256_load_ps(_batch.w[i]));
+        __m256 x = _mm256_mul_ps(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(_batch.x[i]), invW[i]), half), half), width);
+        __m256 y = _mm256_mul_ps(_mm256_sub_ps(
+            half, _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(_batch.y[i]), invW[i]), half)), height);
+        X[i] = _mm256_cvtps_epi32(_mm256_mul_ps(x, subPixel));  // Rounds to nearest even, as nearbyint
+        Y[i] = _mm256_cvtps_epi32(_mm256_mul_ps(y, subPixel));
+        z[i] = _mm256_mul_ps(_mm256_mul_ps(depthSign, _mm256_load_ps(_batch.z[i])), invW[i]);
+    }
+
+    // The area needs more than 32 bits; doubles hold it exactly
+    __m256i dx1 = _mm256_sub_epi32(X[1], X[0]), dy1 = _mm256_sub_epi32(Y[1], Y[0]);
+    __m256i dx2 = _mm256_sub_epi32(X[2], X[0]), dy2 = _mm256_sub_epi32(Y[2], Y[0]);
+    __m256d areaLo = _mm256_sub_pd(
+        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(dx1)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(dy2))),
+        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(dx2)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(dy1)))
+    );
+    __m256d areaHi = _mm256_sub_pd(
+        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(dx1, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(dy2, 1))),
+        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(dx2, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(dy1, 1)))
+    );
+    uint32_t positive = AreaSign(areaLo, areaHi, 1);
+    uint32_t negative = AreaSign(areaLo, areaHi, -1);
+    uint32_t live = (positive | negative) & ((1u << _batch.count) - 1);
+    if (m_cullMode == CullMode::Back)
+        live &= ~negative;
+    if (m_cullMode == CullMode::Front)
+        live &= ~positive;
+
+    // Swap vertices 1 and 2 of counterclockwise triangles
+    const __m256i laneBit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i swap = _mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(negative)), laneBit), laneBit);
+    __m256 swapPs = _mm256_castsi256_ps(swap);
+    __m256i OX[3] = { X[0], _mm256_blendv_epi8(X[1], X[2], swap), _mm256_blendv_epi8(X[2], X[1], swap) };
+    __m256i OY[3] = { Y[0], _mm256_blendv_epi8(Y[1], Y[2], swap), _mm256_blendv_epi8(Y[2], Y[1], swap) };
+
+    // Bounding box, clamped to the screen
+    __m256i minX = _mm256_min_epi32(_mm256_min_epi32(X[0], X[1]), X[2]);
+    __m256i minY = _mm256_min_epi32(_mm256_min_epi32(Y[0], Y[1]), Y[2]);
+    __m256i maxX = _mm256_max_epi32(_mm256_max_epi32(X[0], X[1]), X[2]);
+    __m256i maxY = _mm256_max_epi32(_mm256_max_epi32(Y[0], Y[1]), Y[2]);
+    const __m256i zero = _mm256_setzero_si256();
+    minX = _mm256_max_epi32(_mm256_srai_epi32(_mm256_add_epi32(minX, _mm256_set1_epi32(PixelRound)), SubPixelBits), zero);
+    minY = _mm256_max_epi32(_mm256_srai_epi32(_mm256_add_epi32(minY, _mm256_set1_epi32(PixelRound)), SubPixelBits), zero);
+    maxX = _mm256_min_epi32(_mm256_srai_epi32(_mm256_sub_epi32(maxX, _mm256_set1_epi32(HalfPixel)), SubPixelBits),
+        _mm256_set1_epi32(m_width - 1));
+    maxY = _mm256_min_epi32(_mm256_srai_epi32(_mm256_sub_epi32(maxY, _mm256_set1_epi32(HalfPixel)), SubPixelBits),
+        _mm256_set1_epi32(m_height - 1));
+    __m256i empty = _mm256_or_si256(_mm256_cmpgt_epi32(minX, maxX), _mm256_cmpgt_epi32(minY, maxY));
+    live &= ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(empty)));
+    if (!live)
+        return;
+
+    alignas(32) int32_t boxes[4][SetupBatchSize], vx[3][SetupBatchSize], vy[3][SetupBatchSize];
+    alignas(32) int32_t edgeA[3][SetupBatchSize], edgeB[3][SetupBatchSize];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(boxes[0]), minX);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(boxes[1]), minY);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(boxes[2]), maxX);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(boxes[3]), maxY);
+    for (int i = 0; i < 3; i++) {
+        int b = (i + 1) % 3;
+        _mm256_store_si256(reinterpret_cast<__m256i*>(vx[i]), OX[i]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(vy[i]), OY[i]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(edgeA[i]), _mm256_sub_epi32(OY[i], OY[b]));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(edgeB[i]), _mm256_sub_epi32(OX[b], OX[i]));
+    }
+
+    // Plane equations, with vertices 1 and 2 in edge order
+    __m256 x0 = _mm256_mul_ps(_mm256_cvtepi32_ps(OX[0]), toPixel);
+    __m256 y0 = _mm256_mul_ps(_mm256_cvtepi32_ps(OY[0]), toPixel);
+    __m256 x1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(OX[1]), toPixel), x0);
+    __m256 y1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(OY[1]), toPixel), y0);
+    __m256 x2 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(OX[2]), toPixel), x0);
+    __m256 y2 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(OY[2]), toPixel), y0);
+    __m256 invDet = _mm256_div_ps(one, _mm256_sub_ps(_mm256_mul_ps(x1, y2), _mm256_mul_ps(x2, y1)));
+
+    // Planes 0 and 1 are depth and 1 / w, then the attributes
+    constexpr int PlaneCount = 2 + AttributeCount;
+    alignas(32) float planes[PlaneCount][3][SetupBatchSize];
+    alignas(32) float origin[2][SetupBatchSize], depthRange[2][SetupBatchSize];
+    _mm256_store_ps(origin[0], x0);
+    _mm256_store_ps(origin[1], y0);
+    _mm256_store_ps(depthRange[0], _mm256_min_ps(_mm256_min_ps(z[0], z[1]), z[2]));
+    _mm256_store_ps(depthRange[1], _mm256_max_ps(_mm256_max_ps(z[0], z[1]), z[2]));
+    PlaneAVX2(z[0], _mm256_blendv_ps(z[1], z[2], swapPs), _mm256_blendv_ps(z[2], z[1], swapPs),
+        x1, y1, x2, y2, invDet, planes[0][0], planes[0][1], planes[0][2]);
+    PlaneAVX2(invW[0], _mm256_blendv_ps(invW[1], invW[2], swapPs), _mm256_blendv_ps(invW[2], invW[1], swapPs),
+        x1, y1, x2, y2, invDet, planes[1][0], planes[1][1], planes[1][2]);
+    for (int k = 0; k < AttributeCount; k++) {
+        __m256 a0 = _mm256_mul_ps(_mm256_load_ps(_batch.attributes[0][k]), invW[0]);
+        __m256 a1 = _mm256_mul_ps(_mm256_load_ps(_batch.attributes[1][k]), invW[1]);
+        __m256 a2 = _mm256_mul_ps(_mm256_load_ps(_batch.attributes[2][k]), invW[2]);
+        PlaneAVX2(a0, _mm256_blendv_ps(a1, a2, swapPs), _mm256_blendv_ps(a2, a1, swapPs),
+            x1, y1, x2, y2, invDet, planes[2 + k][0], planes[2 + k][1], planes[2 + k][2]);
+    }
+
+    for (int lane = 0; lane < _batch.count; lane++) {
+        if (!(live & (1u << lane)))
+            continue;
+        Triangle tri;
+        tri.draw = _batch.draw[lane];
+        tri.minX = boxes[0][lane];
+        tri.minY = boxes[1][lane];
+        tri.maxX = boxes[2][lane];
+        tri.maxY = boxes[3][lane];
+        for (int i = 0; i < 3; i++) {
+            tri.A[i] = edgeA[i][lane];
+            tri.B[i] = edgeB[i][lane];
+            tri.C[i] = -(tri.A[i] * vx[i][lane] + tri.B[i] * vy[i][lane]);
+        }
+        tri.x0 = origin[0][lane];
+        tri.y0 = origin[1][lane];
+        tri.zMin = depthRange[0][lane];
+        tri.zMax = depthRange[1][lane];
+        tri.z = { planes[0][0][lane], planes[0][1][lane], planes[0][2][lane] };
+        tri.invW = { planes[1][0][lane], planes[1][1][lane], planes[1][2][lane] };
+        for (int k = 0; k < AttributeCount; k++)
+            tri.attributes[k] = { planes[2 + k][0][lane], planes[2 + k][1][lane], planes[2 + k][2][lane] };
+        EmitTriangle(_chunk, tri);
+    }
+#endif
+}
+
+// Applies the top-left fill rule and bins the triangle into every tile
+// its bounding box touches.
+void Emulator::Rasterizer::EmitTriangle(Chunk& _chunk, const Triangle& _tri) {
+    uint32_t triangleIndex = static_cast<uint32_t>(_chunk.triangles.size());
+    _chunk.triangles.push_back(_tri);
+
+    // Pixels exactly on an edge belong to the triangle only if it is a
+    // top or left edge
+    Triangle& tri = _chunk.triangles.back();
+    for (int i = 0; i < 3; i++) {
+        bool topLeft = tri.A[i] > 0 || (tri.A[i] == 0 && tri.B[i] > 0);
+        if (!topLeft)
+            tri.C[i] -= 1;
+    }
+
+    for (int ty = tri.minY / TileSize; ty <= tri.maxY / TileSize; ty++)
+        for (int tx = tri.minX / TileSize; tx <= tri.maxX / TileSize; tx++)
+            _chunk.refs.push_back({ static_cast<uint32_t>(ty * m_tilesX + tx), triangleIndex });
+}
+
+void Emulator::Rasterizer::BinTriangles() {
+    uint32_t tileCount = m_tilesX * m_tilesY;
+    uint32_t chunkCount = static_cast<uint32_t>((m_triangleCount + ChunkSize - 1) / ChunkSize);
+
+    // Counting sort by tile, keeping submission order within each tile
+    m_binOffsets.assign(tileCount + 1, 0);
+    for (uint32_t c = 0; c < chunkCount; c++)
+        for (auto& ref : m_chunks[c].refs)
+            m_binOffsets[ref.first + 1]++;
+    for (uint32_t t = 0; t < tileCount; t++)
+        m_binOffsets[t + 1] += m_binOffsets[t];
+
+    m_binRefs.resize(m_binOffsets[tileCount]);
+    std::vector<uint32_t> cursor(m_binOffsets.begin(), m_binOffsets.end() - 1);
+    for (uint32_t c = 0; c < chunkCount; c++)
+        for (auto& ref : m_chunks[c].refs)
+            m_binRefs[cursor[ref.first]++] = (c << 16) | ref.second;
+    m_statistics.binned = m_binRefs.size();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Coverage of an 8x8 block.  _e holds the three edge functions at the
+// block's first pixel center, _a and _b their steps one pixel right and
+// one pixel down.  Returns a mask with bit (y * 8 + x) set for every
+// covered pixel.  Only edges that cross the block are passed in, so all
+// values fit in 32 bits.
+
+static uint64_t CoverageScalar(const int32_t* _e, const int32_t* _a, const int32_t* _b) {
+    uint64_t mask = 0;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            int32_t e0 = _e[0] + _a[0] * x + _b[0] * y;
+            int32_t e1 = _e[1] + _a[1] * x + _b[1] * y;
+            int32_t e2 = _e[2] + _a[2] * x + _b[2] * y;
+            if ((e0 | e1 | e2) >= 0)
+                mask |= uint64_t(1) << (y * 8 + x);
+        }
+    }
+    return mask;
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE41 static uint64_t CoverageSSE41(const int32_t* _e, const int32_t* _a, const int32_t* _b) {
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i left[3], right[3], down[3];
+    for (int i = 0; i < 3; i++) {
+        __m128i a = _mm_set1_epi32(_a[i]);
+        left[i] = _mm_add_epi32(_mm_set1_epi32(_e[i]), _mm_mullo_epi32(lane, a));
+        right[i] = _mm_add_epi32(left[i], _mm_slli_epi32(a, 2));
+        down[i] = _mm_set1_epi32(_b[i]);
+    }
+
+    uint64_t mask = 0;
+    for (int y = 0; y < 8; y++) {
+        // The sign bit is set where any edge function is negative
+        __m128i outL = _mm_or_si128(_mm_or_si128(left[0], left[1]), left[2]);
+        __m128i outR = _mm_or_si128(_mm_or_si128(right[0], right[1]), right[2]);
+        uint32_t bits = _mm_movemask_ps(_mm_castsi128_ps(outL)) | (_mm_movemask_ps(_mm_castsi128_ps(outR)) << 4);
+        mask |= static_cast<uint64_t>(~bits & 0xFF) << (y * 8);
+        for (int i = 0; i < 3; i++) {
+            left[i] = _mm_add_epi32(left[i], down[i]);
+            right[i] = _mm_add_epi32(right[i], down[i]);
+        }
+    }
+    return mask;
+}
+
+SIMD_TARGET_AVX2 static uint64_t CoverageAVX2(const int32_t* _e, const int32_t* _a, const int32_t* _b) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i row[3], down[3];
+    for (int i = 0; i < 3; i++) {
+        row[i] = _mm256_add_epi32(_mm256_set1_epi32(_e[i]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(_a[i])));
+        down[i] = _mm256_set1_epi32(_b[i]);
+    }
+
+    uint64_t mask = 0;
+    for (int y = 0; y < 8; y++) {
+        __m256i out = _mm256_or_si256(_mm256_or_si256(row[0], row[1]), row[2]);
+        uint32_t bits = _mm256_movemask_ps(_mm256_castsi256_ps(out));
+        mask |= static_cast<uint64_t>(~bits & 0xFF) << (y * 8);
+        for (int i = 0; i < 3; i++)
+            row[i] = _mm256_add_epi32(row[i], down[i]);
+    }
+    return mask;
+}
+#endif
+
+Emulator::Rasterizer::CoverageKernel Emulator::Rasterizer::SelectCoverageKernel() const {
+#if SIMD_X86
+    if (m_level == Simd::Level::AVX2)
+        return CoverageAVX2;
+    if (m_level == Simd::Level::SSE41)
+        return CoverageSSE41;
+#endif
+    return CoverageScalar;
+}
+
+// Mask of the pixels of an 8x8 block inside the columns [_x0, _x1] and
+// rows [_y0, _y1], given relative to the block.
+static uint64_t RectMask(int _x0, int _x1, int _y0, int _y1) {
+    uint64_t row = ((uint64_t(1) << (_x1 + 1)) - 1) & ~((uint64_t(1) << _x0) - 1);
+    uint64_t mask = 0;
+    for (int y = _y0; y <= _y1; y++)
+        mask |= row << (y * 8);
+    return mask;
+}
+
+// Range of a triangle's depth key over the pixel centers of the
+// rectangle [_x0, _x1] x [_y0, _y1].  The plane is clamped to the
+// vertex range and widened slightly so the bounds stay conservative
+// against the per-pixel evaluation.
+void Emulator::Rasterizer::DepthRange(
+    const Triangle& _tri, int _x0, int _x1, int _y0, int _y1, float& _lo, float& _hi
+) {
+    constexpr float Slack = 1.0e-5f;
+    float corner = _tri.z.a + _tri.z.dx * (_x0 + 0.5f - _tri.x0) + _tri.z.dy * (_y0 + 0.5f - _tri.y0);
+    float spanX = _tri.z.dx * (_x1 - _x0);
+    float spanY = _tri.z.dy * (_y1 - _y0);
+    _lo = std::max(corner + std::min(spanX, 0.0f) + std::min(spanY, 0.0f), _tri.zMin) - Slack;
+    _hi = std::min(corner + std::max(spanX, 0.0f) + std::max(spanY, 0.0f), _tri.zMax) + Slack;
+}
+
+// Recomputes the depth bounds of one 8x8 block from the depth buffer.
+void Emulator::Rasterizer::UpdateBlockDepth(int _bx, int _by) {
+    int x1 = std::min(_bx + BlockSize, m_width);
+    int y1 = std::min(_by + BlockSize, m_height);
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    for (int y = _by; y < y1; y++) {
+        const float* row = &m_depth[static_cast<size_t>(y) * m_width];
+        for (int x = _bx; x < x1; x++) {
+            float key = m_depthSign * row[x];
+            lo = std::min(lo, key);
+            hi = std::max(hi, key);
+        }
+    }
+    size_t block = static_cast<size_t>(_by / BlockSize) * m_blocksX + _bx / BlockSize;
+    m_blockMin[block] = lo;
+    m_blockMax[block] = hi;
+}
+
+void Emulator::Rasterizer::RasterizeTile(uint32_t _tile) {
+    const int tileX0 = (_tile % m_tilesX) * TileSize;
+    const int tileY0 = (_tile / m_tilesX) * TileSize;
+    const int tileX1 = std::min(tileX0 + TileSize, m_width) - 1;
+    const int tileY1 = std::min(tileY0 + TileSize, m_height) - 1;
+    const int64_t step = 1 << SubPixelBits;
+    const int64_t half = step / 2;
+    const int64_t blockSpan = (BlockSize - 1) * step; // First to last pixel center of a block
+    const uint64_t fullBlock = ~uint64_t(0);
+    Statistics& statistics = m_tileStatistics[_tile];
+    statistics = {};
+
+    for (uint32_t r = m_binOffsets[_tile]; r < m_binOffsets[_tile + 1]; r++) {
+        uint32_t ref = m_binRefs[r];
+        const Triangle& tri = m_chunks[ref >> 16].triangles[ref & 0xFFFF];
+        int x0 = std::max(tri.minX, tileX0), x1 = std::min(tri.maxX, tileX1);
+        int y0 = std::max(tri.minY, tileY0), y1 = std::min(tri.maxY, tileY1);
+
+        // Whole triangle behind everything already in the tile?
+        float lo, hi;
+        DepthRange(tri, x0, x1, y0, y1, lo, hi);
+        if (lo > m_tileMax[_tile]) {
+            statistics.occludedTriangles++;
+            continue;
+        }
+        bool tileInFront = hi < m_tileMin[_tile];
+        bool wrote = false;
+
+        // Walk the 8x8 blocks (aligned to the tile) the triangle's box touches
+        for (int by = (y0 - tileY0) / BlockSize * BlockSize + tileY0; by <= y1; by += BlockSize) {
+            for (int bx = (x0 - tileX0) / BlockSize * BlockSize + tileX0; bx <= x1; bx += BlockSize) {
+                int64_t px = bx * step + half;
+                int64_t py = by * step + half;
+
+                // Test each edge at the block corner where it is smallest and
+                // where it is largest.
+                int32_t e[3], a[3], b[3];
+                bool crossing = false;
+                bool outside = false;
+                for (int i = 0; i < 3; i++) {
+                    int64_t value = tri.A[i] * px + tri.B[i] * py + tri.C[i];
+                    int64_t lo = value + std::min<int64_t>(tri.A[i], 0) * blockSpan + std::min<int64_t>(tri.B[i], 0) * blockSpan;
+                    int64_t hi = value + std::max<int64_t>(tri.A[i], 0) * blockSpan + std::max<int64_t>(tri.B[i], 0) * blockSpan;
+                    if (hi < 0) {
+                        outside = true;
+                        break;
+                    }
+                    if (lo >= 0) {
+                        // Entirely inside this edge
+                        e[i] = 0;
+                        a[i] = b[i] = 0;
+                    }
+                    else {
+                        crossing = true;
+                        e[i] = static_cast<int32_t>(value);
+                        a[i] = static_cast<int32_t>(tri.A[i] * step);
+                        b[i] = static_cast<int32_t>(tri.B[i] * step);
+                    }
+                }
+                if (outside)
+                    continue;
+
+                // Early Z against the block's depth bounds, before coverage
+                int cx0 = std::max(x0 - bx, 0), cx1 = std::min(x1 - bx, BlockSize - 1);
+                int cy0 = std::max(y0 - by, 0), cy1 = std::min(y1 - by, BlockSize - 1);
+                size_t block = static_cast<size_t>(by / BlockSize) * m_blocksX + bx / BlockSize;
+                bool inFront = tileInFront;
+                if (!tileInFront) {
+                    float blockLo, blockHi;
+                    DepthRange(tri, bx + cx0, bx + cx1, by + cy0, by + cy1, blockLo, blockHi);
+                    if (blockLo > m_blockMax[block]) {
+                        statistics.occludedBlocks++;
+                        continue;
+                    }
+                    inFront = blockHi < m_blockMin[block];
+                }
+
+                uint64_t mask = crossing ? m_coverage(e, a, b) : fullBlock;
+                mask &= RectMask(cx0, cx1, cy0, cy1);
+                if (mask == 0)
+                    continue;
+                bool written = false;
+
+                while (mask) {
+                    int bit = std::countr_zero(mask);
+                    mask &= mask - 1;
+                    int x = bx + (bit & 7);
+                    int y = by + (bit >> 3);
+                    size_t pixel = static_cast<size_t>(y) * m_width + x;
+                    float z = tri.z.a + tri.z.dx * (x + 0.5f - tri.x0) + tri.z.dy * (y + 0.5f - tri.y0);
+                    // DepthDefault is D3D12_COMPARISON_FUNC_LESS_EQUAL, which
+                    // is GREATER_EQUAL on the depth under reverse Z.
+                    if (inFront || z <= m_depthSign * m_depth[pixel]) {
+                        m_depth[pixel] = m_depthSign * z;
+                        ShadePixel(tri, x, y);
+                        written = true;
+                    }
+                }
+
+                if (written) {
+                    UpdateBlockDepth(bx, by);
+                    wrote = true;
+                }
+            }
+        }
+
+        if (wrote) {
+            // Refresh the tile bounds from its blocks
+            size_t firstBlock = static_cast<size_t>(tileY0 / BlockSize) * m_blocksX + tileX0 / BlockSize;
+            int blocksX = (tileX1 - tileX0) / BlockSize + 1;
+            int blocksY = (tileY1 - tileY0) / BlockSize + 1;
+            float tileMin = FLT_MAX, tileMax = -FLT_MAX;
+            for (int y = 0; y < blocksY; y++) {
+                for (int x = 0; x < blocksX; x++) {
+                    size_t block = firstBlock + static_cast<size_t>(y) * m_blocksX + x;
+                    tileMin = std::min(tileMin, m_blockMin[block]);
+                    tileMax = std::max(tileMax, m_blockMax[block]);
+                }
+            }
+            m_tileMin[_tile] = tileMin;
+            m_tileMax[_tile] = tileMax;
+        }
+    }
+}
+
+// geometryPhongPixel.hlsl for one pixel that passed the depth test.
+void Emulator::Rasterizer::ShadePixel(const Triangle& _tri, int _x, int _y) {
+    const Draw& draw = m_draws[_tri.draw];
+    const ShaderData::Object& object = draw.object;
+
+    // Perspective correct attributes
+    float dx = _x + 0.5f - _tri.x0;
+    float dy = _y + 0.5f - _tri.y0;
+    float w = 1.0f / (_tri.invW.a + _tri.invW.dx * dx + _tri.invW.dy * dy);
+    float attributes[AttributeCount];
+    for (int k = 0; k < AttributeCount; k++) {
+        const Plane& plane = _tri.attributes[k];
+        attributes[k] = (plane.a + plane.dx * dx + plane.dy * dy) * w;
+    }
+
+    Vector4 diffuse(object.diffuse.x, object.diffuse.y, object.diffuse.z, 0);
+    if (object.Textured && draw.texture)
+        diffuse = draw.texture->Sample(Vector2(attributes[TexU], attributes[TexV]));
+
+    using Target = GBuffer::Target;
+    m_gbuffer.Store(Target::WorldPosition, _x, _y, Vector4(attributes[WorldX], attributes[WorldY], attributes[WorldZ], w));
+    m_gbuffer.Store(Target::Normal, _x, _y, Vector4(attributes[NormalX], attributes[NormalY], attributes[NormalZ], 0));
+    m_gbuffer.Store(Target::Diffuse, _x, _y, diffuse);
+    m_gbuffer.Store(Target::SpecularAlpha, _x, _y, Vector4(object.specular.x, object.specular.y, object.specular.z, object.roughness));
+}
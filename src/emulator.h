@@ -1,3 +1,232 @@
-
-
-// This file is intentionally blank
+////////////////////////////////////////////////////////////////////////
+// A software emulation of the graphics pipeline, used to draw the
+// scene without a GPU.  Objects are submitted exactly as Object::Draw
+// submits them to D3D12: one shape plus one ShaderData::Object per
+// draw, under the ShaderData::Constants of the frame.
+//
+// The pipeline is sort-middle: every draw's triangles are transformed,
+// clipped and set up in parallel chunks, binned into screen tiles, and
+// then each tile is rasterized independently on its own thread.
+// Within a tile, triangles are walked in 8x8 blocks whose coverage is
+// found with SIMD, so whole blocks are rejected or accepted at once.
+// A min/max depth hierarchy over tiles and blocks rejects occluded
+// triangles and blocks before any per-pixel work.  Surviving pixels run
+// the equivalent of geometryPhongPixel.hlsl into a CPU G-buffer.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <directxtk12/GeometricPrimitive.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ShaderData.h"
+#include "gbuffer.h"
+#include "simd.h"
+
+class Image;
+
+namespace Emulator {
+    // A CPU side copy of a shape's polygons, made by CreateCustom from
+    // the same vertices SceneGraph::BuildSceneGraph gives the GPU, so
+    // both pipelines see the same triangles.
+    class Mesh {
+    public:
+        std::vector<DirectX::SimpleMath::Vector3> m_positions;
+        std::vector<DirectX::SimpleMath::Vector3> m_normals;
+        std::vector<DirectX::SimpleMath::Vector2> m_texCoords;
+        std::vector<uint32_t> m_indices;
+
+        // Object space bounding box
+        DirectX::SimpleMath::Vector3 m_minP, m_maxP;
+
+        uint32_t TriangleCount() const { return static_cast<uint32_t>(m_indices.size() / 3); }
+
+        static std::shared_ptr<Mesh> CreateCustom(
+            const DirectX::GeometricPrimitive::VertexCollection& _vertices,
+            const DirectX::GeometricPrimitive::IndexCollection& _indices
+        );
+
+        // Reads the triangles of a PLY file, such as bunny.ply, in the same
+        // form the GeometricPrimitive generators produce, so the result can
+        // go to both CreateCustom and GeometricPrimitive::CreateCustom.
+        // Files without normals get area weighted vertex normals.
+        static void ReadPly(
+            const std::string& _filename,
+            DirectX::GeometricPrimitive::VertexCollection& _vertices,
+            DirectX::GeometricPrimitive::IndexCollection& _indices
+        );
+    };
+
+    class Rasterizer {
+    public:
+        static constexpr int TileSize = 64;     // Pixels on a side of a screen tile
+        static constexpr int BlockSize = 8;     // Pixels on a side of a coverage block
+        static constexpr int SubPixelBits = 4;  // Fixed point precision of snapped vertices
+        static constexpr uint32_t ChunkSize = 4096; // Triangles per geometry work item
+        static constexpr float GuardBand = 16.0f; // Clip space |x|, |y| up to GuardBand * w are not clipped
+
+        enum class CullMode {
+            None,
+            Back,
+            Front
+        };
+
+        // Counters from the last End(), handy when tuning.
+        struct Statistics {
+            uint64_t submitted = 0; // Triangles submitted
+            uint64_t transformed = 0; // Vertices run through the vertex stage
+            uint64_t clipped = 0;   // Triangles that needed clipping
+            uint64_t setup = 0;     // Triangles that survived culling and clipping
+            uint64_t binned = 0;    // Triangle/tile pairs produced by binning
+            uint64_t occludedTriangles = 0; // Triangle/tile pairs rejected by the tile depth bounds
+            uint64_t occludedBlocks = 0;    // 8x8 blocks rejected by the block depth bounds
+        };
+
+        CullMode m_cullMode = CullMode::Back;
+
+        // Instruction set used by triangle setup and the coverage
+        // kernel.  Defaults to the best the processor supports; lower it
+        // to compare paths.
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        // Depth convention.  Standard depth clears to 1 and keeps nearer
+        // fragments with LESS_EQUAL, like DepthDefault.  Reverse Z, as
+        // produced by PerspectiveReverseZ, clears to 0 and keeps them
+        // with GREATER_EQUAL.  Latched by Begin().
+        bool m_reverseZ = false;
+        int m_width = 0, m_height = 0;
+        int m_tilesX = 0, m_tilesY = 0;
+
+        // Render targets: depth is row major m_width * m_height
+        std::vector<float> m_depth; // Device depth, in the m_reverseZ convention
+        GBuffer m_gbuffer;
+
+        Statistics m_statistics;
+
+        void Resize(int _width, int _height);
+
+        // Starts a frame: clears the targets and latches the frame constants.
+        void Begin(const ShaderData::Constants& _constants);
+
+        // Queues one draw.  The mesh and texture must stay alive until
+        // End() returns; the texture is sampled when _object.Textured.
+        void Submit(const Mesh& _mesh, const ShaderData::Object& _object, const Image* _texture = nullptr);
+
+        // Runs the queued draws through the pipeline.
+        void End();
+
+    private:
+        struct Draw {
+            const Mesh* mesh;
+            ShaderData::Object object;
+            const Image* texture;
+            uint64_t firstTriangle; // Index of the draw's first triangle in the frame
+        };
+
+        // Outputs of geometryPhongVert.hlsl besides the position
+        enum Attribute {
+            WorldX, WorldY, WorldZ,     // worldPosition.xyz
+            NormalX, NormalY, NormalZ,  // normalVec
+            TexU, TexV,                 // texCoord
+            AttributeCount
+        };
+
+        struct ClipVertex {
+            DirectX::SimpleMath::Vector4 position;
+            float attributes[AttributeCount];
+        };
+
+        // Screen space plane equation: value = a + dx * (x - x0) + dy * (y - y0)
+        struct Plane {
+            float a, dx, dy;
+        };
+
+        // Depth is handled internally as a key where smaller is always
+        // nearer: the depth itself, or its negation under reverse Z.
+        // The hierarchy below stores keys.
+
+        // A triangle after clipping and setup, in fixed point screen space.
+        struct Triangle {
+            int32_t minX, minY, maxX, maxY; // Pixel bounding box, inclusive
+            int64_t A[3], B[3], C[3];       // Edge functions, >= 0 inside
+            float x0, y0;                   // Origin of the plane equations
+            Plane z;                        // Depth key
+            float zMin, zMax;               // Depth key range of the vertices
+            Plane invW;                     // 1 / w
+            Plane attributes[AttributeCount]; // Attribute / w
+            uint32_t draw;
+        };
+
+        // Post-transform vertices of the draw being processed, keyed by
+        // mesh index, so a vertex shared by several triangles of a chunk
+        // is only transformed once.
+        struct VertexCache {
+            std::vector<uint32_t> stamp;    // Per mesh index, the generation it was last cached in
+            std::vector<uint32_t> slot;     // Per mesh index, its position in vertices
+            std::vector<uint32_t> indices;  // Mesh index of every cached vertex
+            std::vector<ClipVertex> vertices;
+            std::vector<uint32_t> outside;  // Per cached vertex, a bit per ClipPlanes entry it is outside of
+            uint32_t generation = 0;
+        };
+
+        // Clipped triangles waiting for setup, as structure of arrays so
+        // that a batch of eight can be set up at once.
+        static constexpr int SetupBatchSize = 8;
+        struct alignas(32) SetupBatch {  // For SetupBatchAVX2's aligned loads
+            float x[3][SetupBatchSize], y[3][SetupBatchSize], z[3][SetupBatchSize], w[3][SetupBatchSize];
+            float attributes[3][AttributeCount][SetupBatchSize];
+            uint32_t draw[SetupBatchSize];
+            int count = 0;
+        };
+
+        struct Chunk {
+            std::vector<Triangle> triangles;
+            std::vector<std::pair<uint32_t, uint32_t>> refs; // (tile, triangle)
+            uint64_t clipped = 0;
+            uint64_t transformed = 0;
+        };
+
+        // Covered pixels of an 8x8 block, see CoverageScalar in emulator.cpp
+        using CoverageKernel = uint64_t(*)(const int32_t* _e, const int32_t* _a, const int32_t* _b);
+
+        CoverageKernel SelectCoverageKernel() const;
+        static void DepthRange(const Triangle& _tri, int _x0, int _x1, int _y0, int _y1, float& _lo, float& _hi);
+        void UpdateBlockDepth(int _bx, int _by);
+        void ProcessChunk(uint32_t _chunk);
+        void CacheVertices(VertexCache& _cache, const Mesh& _mesh, const uint32_t* _indices, size_t _count);
+        void TransformVertices(const Draw& _draw, VertexCache& _cache);
+        void TransformVerticesAVX2(const Draw& _draw, VertexCache& _cache);
+        void QueueTriangle(Chunk& _chunk, SetupBatch& _batch, const ClipVertex* _clip, uint32_t _draw);
+        void FlushSetup(Chunk& _chunk, SetupBatch& _batch);
+        void SetupTriangle(Chunk& _chunk, const SetupBatch& _batch, int _lane);
+        void SetupBatchAVX2(Chunk& _chunk, const SetupBatch& _batch);
+        void EmitTriangle(Chunk& _chunk, const Triangle& _tri);
+        void ShadePixel(const Triangle& _tri, int _x, int _y);
+        void BinTriangles();
+        void RasterizeTile(uint32_t _tile);
+
+        ShaderData::Constants m_constants{};
+        DirectX::SimpleMath::Matrix m_viewProj;
+        std::vector<Draw> m_draws;
+        uint64_t m_triangleCount = 0;
+
+        Simd::Level m_level = Simd::Level::Scalar; // m_simdLevel as far as supported, latched by End()
+        CoverageKernel m_coverage = nullptr;
+        float m_depthSign = 1;  // Converts between depth and depth key
+
+        // Depth hierarchy: nearest and farthest depth key of every 8x8
+        // block and every tile.  Blocks are aligned to tiles, so a row of
+        // tiles holds TileSize / BlockSize rows of blocks.
+        int m_blocksX = 0, m_blocksY = 0;
+        std::vector<float> m_blockMin, m_blockMax;
+        std::vector<float> m_tileMin, m_tileMax;
+        std::vector<Statistics> m_tileStatistics; // Per tile counters, summed by End()
+
+        std::vector<Chunk> m_chunks;
+        std::vector<uint32_t> m_binOffsets; // m_tilesX * m_tilesY + 1 offsets into m_binRefs
+        std::vector<uint32_t> m_binRefs;    // (chunk << 16) | triangle, in submission order
+    };
+}
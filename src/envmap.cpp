@@ -0,0 +1,158 @@
+////////////////////////////////////////////////////////////////////////
+// Prefiltered specular environment maps; see envmap.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "envmap.h"
+#include "brdf.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static const float pi = 3.14159f; // As in lightingPhongPixel.hlsl
+
+Vector2 Emulator::PrefilteredEnvironment::UVOf(const Vector3& _direction) {
+    float u = 0.5f + std::atan2(_direction.x, -_direction.z) / (2.0f * pi);
+    return Vector2(u, std::acos(std::clamp(_direction.y, -1.0f, 1.0f)) / pi);
+}
+
+Vector3 Emulator::PrefilteredEnvironment::DirectionOf(const Vector2& _uv) {
+    float phi = (_uv.x - 0.5f) * 2.0f * pi;
+    float theta = _uv.y * pi;
+    float sinTheta = std::sin(theta);
+    return Vector3(sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi));
+}
+
+// Each level averages 2x2 texels of the one before, the last of an odd
+// row or column counting twice.
+std::vector<Image> Emulator::PrefilteredEnvironment::BuildMips(const Image& _image) {
+    std::vector<Image> mips{ _image };
+    while (mips.back().m_width > 1 || mips.back().m_height > 1) {
+        const Image& source = mips.back();
+        Image level(std::max(1, source.m_width / 2), std::max(1, source.m_height / 2));
+        ThreadPool::Get().ParallelFor(level.m_height, [&](uint32_t _y) {
+            int y0 = std::min(2 * static_cast<int>(_y), source.m_height - 1), y1 = std::min(y0 + 1, source.m_height - 1);
+            for (int x = 0; x < level.m_width; x++) {
+                int x0 = std::min(2 * x, source.m_width - 1), x1 = std::min(x0 + 1, source.m_width - 1);
+                level.At(x, _y) = (source.At(x0, y0) + source.At(x1, y0) + source.At(x0, y1) + source.At(x1, y1)) * 0.25f;
+            }
+        });
+        mips.push_back(std::move(level));
+    }
+    return mips;
+}
+
+// Bilinear, wrapping around in longitude but clamped at the poles,
+// where Image::Sample would blend in the opposite pole.
+Vector4 Emulator::PrefilteredEnvironment::SampleLevel(const Image& _image, const Vector2& _uv) {
+    float x = _uv.x * _image.m_width - 0.5f;
+    float y = std::clamp(_uv.y * _image.m_height - 0.5f, 0.0f, _image.m_height - 1.0f);
+    float fx = std::floor(x);
+    float tx = x - fx;
+    int x0 = static_cast<int>(fx) % _image.m_width;
+    x0 += x0 < 0 ? _image.m_width : 0;
+    int x1 = x0 + 1 == _image.m_width ? 0 : x0 + 1;
+    int y0 = static_cast<int>(y), y1 = std::min(y0 + 1, _image.m_height - 1);
+    float ty = y - y0;
+
+    Vector4 top = _image.At(x0, y0) * (1 - tx) + _image.At(x1, y0) * tx;
+    Vector4 bottom = _image.At(x0, y1) * (1 - tx) + _image.At(x1, y1) * tx;
+    return top * (1 - ty) + bottom * ty;
+}
+
+Vector4 Emulator::PrefilteredEnvironment::SampleMips(const std::vector<Image>& _mips, const Vector2& _uv, float _lod) {
+    _lod = std::clamp(_lod, 0.0f, static_cast<float>(_mips.size() - 1));
+    int level = static_cast<int>(_lod);
+    float t = _lod - level;
+    Vector4 sample = SampleLevel(_mips[level], _uv);
+    if (t > 0)
+        sample = sample * (1 - t) + SampleLevel(_mips[level + 1], _uv) * t;
+    return sample;
+}
+
+void Emulator::PrefilteredEnvironment::Bake(const Image& _sky, int _width, int _levels, int _samples) {
+    const std::vector<Image> mips = BuildMips(_sky);
+
+    // Equirectangular texels vary with latitude; the average will do
+    // for picking mips.
+    const float texelSolidAngle = 4.0f * pi / (static_cast<float>(_sky.m_width) * _sky.m_height);
+
+    m_levels.clear();
+    for (int level = 0; level < _levels; level++) {
+        const int width = std::max(1, _width >> level);
+        const int height = std::max(1, width / 2);
+        const float roughness = _levels > 1 ? static_cast<float>(level) / (_levels - 1) : 0.0f;
+        Image image(width, height);
+
+        // A mirror only needs the source brought down to this size
+        if (roughness == 0) {
+            const float lod = std::max(0.0f, std::log2(static_cast<float>(_sky.m_width) / width));
+            ThreadPool::Get().ParallelFor(height, [&](uint32_t _y) {
+                for (int x = 0; x < width; x++)
+                    image.At(x, _y) = SampleMips(mips, Vector2((x + 0.5f) / width, (_y + 0.5f) / height), lod);
+            });
+            m_levels.push_back(std::move(image));
+            continue;
+        }
+
+        // With N = V, N.H and V.H are equal and the pdf of L is D / 4.
+        // A sample then stands for 1 / (count pdf) steradians, and reads
+        // the mip whose texels cover about that much, one finer for a
+        // little extra sharpness.
+        std::vector<Sample> samples;
+        for (int i = 0; i < _samples; i++) {
+            Vector3 H = GGX::ImportanceSample(GGX::Hammersley(i, _samples), roughness);
+            Vector3 L = 2.0f * H.z * H - Vector3(0, 0, 1);
+            if (L.z <= 0)
+                continue;
+            float pdf = GGX::Distribution(H.z, roughness) / 4.0f;
+            float sampleSolidAngle = 1.0f / (_samples * pdf + 0.0001f);
+            float lod = std::max(0.0f, 0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f);
+            samples.push_back({ L, L.z, lod });
+        }
+
+        ThreadPool::Get().ParallelFor(height, [&](uint32_t _y) {
+            for (int x = 0; x < width; x++) {
+                Vector3 R = DirectionOf(Vector2((x + 0.5f) / width, (_y + 0.5f) / height));
+                Vector3 up = std::abs(R.y) < 0.999f ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+                Vector3 T = up.Cross(R);
+                T.Normalize();
+                Vector3 B = R.Cross(T);
+
+                Vector4 sum;
+                float total = 0;
+                for (const Sample& sample : samples) {
+                    Vector3 L = T * sample.direction.x + B * sample.direction.y + R * sample.direction.z;
+                    sum += SampleMips(mips, UVOf(L), sample.lod) * sample.weight;
+                    total += sample.weight;
+                }
+                image.At(x, _y) = total > 0 ? sum * (1.0f / total) : Vector4();
+                image.At(x, _y).w = 1;
+            }
+        });
+        m_levels.push_back(std::move(image));
+    }
+}
+
+Vector4 Emulator::PrefilteredEnvironment::Lookup(const Vector3& _direction, float _roughness) const {
+    if (m_levels.empty())
+        return Vector4();
+    const Vector2 uv = UVOf(_direction);
+    float level = std::clamp(_roughness, 0.0f, 1.0f) * (m_levels.size() - 1);
+    int lower = static_cast<int>(level);
+    float t = level - lower;
+    Vector4 sample = SampleLevel(m_levels[lower], uv);
+    if (t > 0)
+        sample = sample * (1 - t) + SampleLevel(m_levels[lower + 1], uv) * t;
+    return sample;
+}
+
+std::string Emulator::PrefilteredEnvironment::LevelFilename(const std::string& _base, int _level) {
+    return _base + ".spec" + std::to_string(_level) + ".hdr";
+}
+
+void Emulator::PrefilteredEnvironment::Write(const std::string& _base) const {
+    for (size_t level = 0; level < m_levels.size(); level++)
+        m_levels[level].WriteRGBE(LevelFilename(_base, static_cast<int>(level)));
+}
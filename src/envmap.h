@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////
+// An offline baker for prefiltered specular environment maps, the
+// precomputed replacement for SpecularIrradiance in
+// lightingPhongPixel.hlsl.
+//
+// The source is an equirectangular sky laid out as the shader's UVOF
+// reads it, such as the .hdr files in skys/.  Level i of the result is
+// the sky convolved with the GGX lobe of roughness i / (levels - 1),
+// under the usual assumption that N, V and R coincide, at half the
+// size of the level before.  A shader or Lookup then takes the
+// reflected direction and roughness to one filtered fetch.
+//
+// Each level draws its Hammersley samples once, importance sampled
+// like the shader's Importance, and works out which mip of the source
+// each should read from the solid angle it stands for ("GPU-Based
+// Importance Sampling", Colbert and Krivanek 2007), so a few hundred
+// samples come out smooth.  Rows are baked in parallel.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+namespace Emulator {
+    class PrefilteredEnvironment {
+    public:
+        static constexpr int DefaultWidth = 512;
+        static constexpr int DefaultLevels = 6;
+        static constexpr int DefaultSamples = 512;
+
+        std::vector<Image> m_levels; // Roughness 0 first
+
+        // The shader's UVOF and its inverse.
+        static DirectX::SimpleMath::Vector2 UVOf(const DirectX::SimpleMath::Vector3& _direction);
+        static DirectX::SimpleMath::Vector3 DirectionOf(const DirectX::SimpleMath::Vector2& _uv);
+
+        // _width is that of level 0, which is _width / 2 high.
+        void Bake(
+            const Image& _sky,
+            int _width = DefaultWidth, int _levels = DefaultLevels, int _samples = DefaultSamples
+        );
+
+        // Trilinear, between the two levels nearest _roughness.
+        DirectX::SimpleMath::Vector4 Lookup(const DirectX::SimpleMath::Vector3& _direction, float _roughness) const;
+
+        // Level i goes to <_base>.spec<i>.hdr, next to the .irr.hdr
+        // irradiance maps.
+        static std::string LevelFilename(const std::string& _base, int _level);
+        void Write(const std::string& _base) const;
+
+    private:
+        // A sample direction about +z, its N.L weight and the source mip
+        // it reads.
+        struct Sample {
+            DirectX::SimpleMath::Vector3 direction;
+            float weight;
+            float lod;
+        };
+
+        static std::vector<Image> BuildMips(const Image& _image);
+        static DirectX::SimpleMath::Vector4 SampleLevel(const Image& _image, const DirectX::SimpleMath::Vector2& _uv);
+        static DirectX::SimpleMath::Vector4 SampleMips(
+            const std::vector<Image>& _mips, const DirectX::SimpleMath::Vector2& _uv, float _lod
+        );
+    };
+}
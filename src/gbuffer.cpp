@@ -0,0 +1,45 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU copy of the G-buffer written by the emulated geometry pass.
+// It holds the same four targets as PixelOut in
+// geometryPhongPixel.hlsl, in the order of Scene::FBOIndex.
+////////////////////////////////////////////////////////////////////////
+
+#include "gbuffer.h"
+#include <algorithm>
+
+using namespace DirectX::SimpleMath;
+
+void Emulator::GBuffer::Resize(int _width, int _height) {
+    if (_width == m_width && _height == m_height)
+        return;
+    m_width = _width;
+    m_height = _height;
+    m_stride = (static_cast<size_t>(m_width) + RowAlignment - 1) / RowAlignment * RowAlignment;
+    m_data.assign(static_cast<size_t>(Target::Count) * 4 * m_stride * m_height, 0.0f);
+}
+
+void Emulator::GBuffer::Clear(const Vector4& _color) {
+    const float channels[4] = { _color.x, _color.y, _color.z, _color.w };
+    for (int target = 0; target < static_cast<int>(Target::Count); target++) {
+        for (int channel = 0; channel < 4; channel++) {
+            float* plane = Row(static_cast<Target>(target), channel, 0);
+            std::fill(plane, plane + m_stride * m_height, channels[channel]);
+        }
+    }
+}
+
+Vector4 Emulator::GBuffer::Load(Target _target, int _x, int _y) const {
+    return Vector4(
+        Row(_target, 0, _y)[_x],
+        Row(_target, 1, _y)[_x],
+        Row(_target, 2, _y)[_x],
+        Row(_target, 3, _y)[_x]
+    );
+}
+
+void Emulator::GBuffer::Store(Target _target, int _x, int _y, const Vector4& _value) {
+    Row(_target, 0, _y)[_x] = _value.x;
+    Row(_target, 1, _y)[_x] = _value.y;
+    Row(_target, 2, _y)[_x] = _value.z;
+    Row(_target, 3, _y)[_x] = _value.w;
+}
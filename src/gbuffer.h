@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU copy of the G-buffer written by the emulated geometry pass.
+// It holds the same four targets as PixelOut in
+// geometryPhongPixel.hlsl, in the order of Scene::FBOIndex.
+//
+// Storage is structure of arrays: every channel of every target is its
+// own plane of floats, and every row starts on a 64 byte boundary, so
+// the CPU passes that read the G-buffer can stream whole vectors.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstddef>
+
+#include "simd.h"
+
+namespace Emulator {
+    class GBuffer {
+    public:
+        enum class Target {
+            WorldPosition,  // xyz world position, w clip space w
+            Normal,         // xyz world normal, w 0
+            Diffuse,        // Kd, or the texture sample
+            SpecularAlpha,  // xyz Ks, w roughness
+            Count
+        };
+
+        static constexpr size_t RowAlignment = 64 / sizeof(float); // Floats per aligned row unit
+
+        int m_width = 0, m_height = 0;
+        size_t m_stride = 0; // Floats between rows of a plane
+
+        void Resize(int _width, int _height);
+
+        // Sets every channel of every target, like ClearRenderTargetView.
+        void Clear(const DirectX::SimpleMath::Vector4& _color);
+
+        float* Row(Target _target, int _channel, int _y) {
+            return &m_data[PlaneOffset(_target, _channel) + static_cast<size_t>(_y) * m_stride];
+        }
+        const float* Row(Target _target, int _channel, int _y) const {
+            return &m_data[PlaneOffset(_target, _channel) + static_cast<size_t>(_y) * m_stride];
+        }
+
+        DirectX::SimpleMath::Vector4 Load(Target _target, int _x, int _y) const;
+        void Store(Target _target, int _x, int _y, const DirectX::SimpleMath::Vector4& _value);
+
+    private:
+        size_t PlaneOffset(Target _target, int _channel) const {
+            return (static_cast<size_t>(_target) * 4 + _channel) * m_stride * m_height;
+        }
+
+        Simd::AlignedVector<float> m_data;
+    };
+}
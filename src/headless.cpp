@@ -0,0 +1,608 @@
+///////////////////////////////////////////////////////////////////////
+// A headless entry point: builds the same scene graph as the
+// interactive program, but with no window, device or swapchain.  A
+// fixed camera and light script is run through the software pipeline,
+// each frame is written to disk, and the per-pass times are printed.
+// With --ao the ambient occlusion map of each frame is written too, and
+// with --tonemap each frame is also auto-exposed and tone mapped as if
+// played at FrameRate, and written as a .ppm.
+//
+// With --regress it instead renders a fixed set of canned scenes and
+// camera poses, compares each image against a reference image of the
+// same name, and writes the per-pass times and results as JSON.  Run
+// once with --update to record the references.  Those in reference/
+// are at 160x90, as CTest runs it.
+//
+// With --self-test it only runs checks of parts the canned scenes don't
+// exercise, and exits nonzero if any fails.
+//
+// With --brdf-table it only bakes the split-sum GGX table and writes it
+// as an .hdr, scale in red and bias in green.  With --bake-env it only
+// bakes the prefiltered specular levels of an .hdr sky, written next to
+// it as <sky>.spec<i>.hdr, and with --irradiance it only projects an
+// .hdr sky's irradiance onto spherical harmonics, printing the 27
+// coefficients and writing their reconstruction as <sky>.sh.hdr.
+//
+// Usage: Headless [--frames n] [--width w] [--height h] [--out dir]
+//                 [--occlusion] [--shadow size] [--blur width] [--ao] [--ao-half] [--tonemap]
+//        Headless --regress [--reference dir] [--update] [--tolerance t]
+//                 [--repeat n] [--report file], and any of the above but --frames
+//        Headless --self-test
+//        Headless --brdf-table file
+//        Headless --bake-env sky.hdr
+//        Headless --irradiance sky.hdr
+////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "scenegraph.h"
+#include "brdf.h"
+#include "envmap.h"
+#include "irradiance.h"
+#include "sat.h"
+#include "shadow.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace {
+    struct Options {
+        int frames = 8;
+        int width = 1920;
+        int height = 1080;
+        std::string out = "headless";
+        bool occlusion = false;
+        int shadow = 0;             // Moment shadow map size, 0 for none
+        int blur = -1;              // Shadow blur width, -1 for the scene's default
+        bool ao = false;
+        bool aoHalf = false;        // Ambient occlusion at half resolution
+        bool tonemap = false;
+
+        bool regress = false;
+        std::string reference = "reference";
+        bool update = false;
+        double tolerance = 0.001;   // Fraction of pixels allowed to differ
+        int repeat = 5;             // Timed renders per pose, of which the median is kept
+        std::string report;         // Defaults to <out>/report.json
+
+        bool selfTest = false;
+
+        std::string brdfTable;      // Where to write the split-sum table, if baking it
+        std::string environment;    // The sky to prefilter, if baking one
+        std::string irradiance;     // The sky to project, if projecting one
+    };
+
+    Options ParseOptions(int argc, char** argv) {
+        Options options;
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "--occlusion")) {
+                options.occlusion = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--ao")) {
+                options.ao = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--ao-half")) {
+                options.ao = options.aoHalf = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--tonemap")) {
+                options.tonemap = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--regress")) {
+                options.regress = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--self-test")) {
+                options.selfTest = true;
+                continue;
+            }
+            if (!strcmp(argv[i], "--update")) {
+                options.update = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+                throw std::runtime_error(std::string("missing value for ") + argv[i]);
+            if (!strcmp(argv[i], "--frames"))
+                options.frames = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--width"))
+                options.width = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--height"))
+                options.height = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--out"))
+                options.out = argv[++i];
+            else if (!strcmp(argv[i], "--shadow"))
+                options.shadow = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--blur"))
+                options.blur = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--reference"))
+                options.reference = argv[++i];
+            else if (!strcmp(argv[i], "--tolerance"))
+                options.tolerance = atof(argv[++i]);
+            else if (!strcmp(argv[i], "--repeat"))
+                options.repeat = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--report"))
+                options.report = argv[++i];
+            else if (!strcmp(argv[i], "--brdf-table"))
+                options.brdfTable = argv[++i];
+            else if (!strcmp(argv[i], "--bake-env"))
+                options.environment = argv[++i];
+            else if (!strcmp(argv[i], "--irradiance"))
+                options.irradiance = argv[++i];
+            else
+                throw std::runtime_error(std::string("unknown option ") + argv[i]);
+        }
+        if (options.frames <= 0 || options.width <= 0 || options.height <= 0 || options.repeat <= 0)
+            throw std::runtime_error("frames, width, height and repeat must be positive");
+        if (options.report.empty())
+            options.report = (std::filesystem::path(options.out) / "report.json").string();
+        return options;
+    }
+
+    // The camera circles the teapot looking at it from above, while
+    // the main light circles the other way.  Frame _frame of _count
+    // always gets the same view, so runs can be compared.
+    void ScriptFrame(SceneGraph& _scene, const int _frame, const int _count) {
+        using namespace DirectX::SimpleMath;
+        const float PI = 3.14159f;
+        float t = 2.0f * PI * _frame / _count;
+        _scene.cameraPos = Vector3(12.0f * std::sin(t), 8.0f, 12.0f * std::cos(t));
+        _scene.cameraForward = -_scene.cameraPos;
+        _scene.cameraForward.Normalize();
+        _scene.m_lightPos = Vector3(9.0f * std::sin(-t), 6.0f, 9.0f * std::cos(-t));
+        _scene.UpdateTransforms();
+    }
+
+    // Frames per second of the scripted camera, for exposure adaptation
+    const float FrameRate = 30.0f;
+
+    double Milliseconds(std::chrono::steady_clock::duration _duration) {
+        return std::chrono::duration<double, std::milli>(_duration).count();
+    }
+
+    // Times of one render, per pass
+    struct PassTimes {
+        double shadow = 0;
+        double occlusion = 0;
+        double geometry = 0;
+        double ao = 0;
+        double lighting = 0;
+    };
+
+    PassTimes RenderFrame(SceneGraph& _scene) {
+        PassTimes times;
+        auto start = std::chrono::steady_clock::now();
+        if (_scene.m_emulateShadow)
+            _scene.EmulateShadow();
+        auto shadowEnd = std::chrono::steady_clock::now();
+        if (_scene.m_occlusionCulling)
+            _scene.BuildOcclusion();
+        auto occlusionEnd = std::chrono::steady_clock::now();
+        _scene.EmulateGeometry();
+        auto geometryEnd = std::chrono::steady_clock::now();
+        if (_scene.m_emulateAO)
+            _scene.EmulateAO();
+        auto aoEnd = std::chrono::steady_clock::now();
+        _scene.EmulateLighting();
+        auto lightingEnd = std::chrono::steady_clock::now();
+        times.shadow = Milliseconds(shadowEnd - start);
+        times.occlusion = Milliseconds(occlusionEnd - shadowEnd);
+        times.geometry = Milliseconds(geometryEnd - occlusionEnd);
+        times.ao = Milliseconds(aoEnd - geometryEnd);
+        times.lighting = Milliseconds(lightingEnd - aoEnd);
+        return times;
+    }
+
+    // The occlusion map as a grey image
+    Image AOImage(const Emulator::AmbientOcclusion& _ao) {
+        Image image(_ao.m_width, _ao.m_height);
+        for (size_t i = 0; i < _ao.m_ao.size(); i++)
+            image.m_pixels[i] = DirectX::SimpleMath::Vector4(_ao.m_ao[i], _ao.m_ao[i], _ao.m_ao[i], 1);
+        return image;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+    // Regression scenes
+
+    struct Pose {
+        DirectX::SimpleMath::Vector3 camera;
+        DirectX::SimpleMath::Vector3 target;
+        DirectX::SimpleMath::Vector3 light;
+    };
+
+    struct CannedScene {
+        const char* name;
+        bool teapot, bunny, sphereOfSpheres;
+        bool allLights;     // The 1024 light field, or only the main light
+        bool toneMap;       // Compared after auto-exposure and tone mapping
+        std::vector<Pose> poses;
+    };
+
+    const std::vector<CannedScene>& CannedScenes() {
+        using DirectX::SimpleMath::Vector3;
+        static const std::vector<CannedScene> scenes = {
+            { "teapot", true, false, false, false, false, {
+                { Vector3(0, 4, 10), Vector3(0, 0.5f, 0), Vector3(5, 6, 5) },
+                { Vector3(-8, 2, -6), Vector3(0, 0.5f, 0), Vector3(-4, 8, 6) },
+                { Vector3(3, 1, 3), Vector3(0, 1, 0), Vector3(0, 2, -9) },
+            } },
+            { "bunny", false, true, false, false, false, {
+                { Vector3(0, 3, 8), Vector3(0, 0.5f, 0), Vector3(5, 6, 5) },
+                { Vector3(7, 1, -3), Vector3(0, 0.5f, 0), Vector3(-6, 7, 2) },
+            } },
+            { "spheres", true, false, true, false, false, {
+                { Vector3(0, 6, 14), Vector3(0, 0.5f, 0), Vector3(5, 6, 5) },
+                { Vector3(0, 1, 2), Vector3(0, 2, -3), Vector3(0, 3, 0) },
+            } },
+            { "lights", true, false, false, true, false, {
+                { Vector3(0, 30, 30), Vector3(0, -1, 0), Vector3(5, 6, 5) },
+                { Vector3(-20, 4, -20), Vector3(0, -1, 0), Vector3(5, 6, 5) },
+            } },
+            { "tonemap", true, false, false, false, true, {
+                { Vector3(0, 4, 10), Vector3(0, 0.5f, 0), Vector3(5, 6, 5) },
+                { Vector3(0, 2, 6), Vector3(0, 12, -20), Vector3(5, 6, 5) },
+            } },
+        };
+        return scenes;
+    }
+
+    void SelectScene(SceneGraph& _scene, const CannedScene& _canned, const std::vector<ShaderData::Light>& _lights) {
+        _scene.teapot->m_drawMe = _canned.teapot;
+        _scene.bunny->m_drawMe = _canned.bunny;
+        _scene.sphereOfSpheres->m_drawMe = _canned.sphereOfSpheres;
+        _scene.m_lights.assign(_lights.begin(), _canned.allLights ? _lights.end() : _lights.begin() + 1);
+    }
+
+    void SelectPose(SceneGraph& _scene, const Pose& _pose) {
+        _scene.cameraPos = _pose.camera;
+        _scene.cameraForward = _pose.target - _pose.camera;
+        _scene.cameraForward.Normalize();
+        _scene.m_lightPos = _pose.light;
+        _scene.UpdateTransforms();
+    }
+
+    // The fraction of pixels where any channel of _image differs from
+    // _reference by more than PixelTolerance, relative to the brighter
+    // of 1 and the reference value.  Differently sized images differ
+    // everywhere.
+    double Mismatch(const Image& _image, const Image& _reference) {
+        const float PixelTolerance = 1.0f / 64.0f;
+        if (_image.m_width != _reference.m_width || _image.m_height != _reference.m_height)
+            return 1.0;
+        size_t differing = 0;
+        for (size_t i = 0; i < _image.m_pixels.size(); i++) {
+            const auto& a = _image.m_pixels[i];
+            const auto& b = _reference.m_pixels[i];
+            float error = std::max({
+                std::abs(a.x - b.x) / std::max(1.0f, std::abs(b.x)),
+                std::abs(a.y - b.y) / std::max(1.0f, std::abs(b.y)),
+                std::abs(a.z - b.z) / std::max(1.0f, std::abs(b.z)),
+            });
+            if (!(error <= PixelTolerance))
+                differing++;
+        }
+        return _image.m_pixels.empty() ? 0.0 : static_cast<double>(differing) / _image.m_pixels.size();
+    }
+
+    double Median(std::vector<double> _values) {
+        std::sort(_values.begin(), _values.end());
+        return _values[_values.size() / 2];
+    }
+
+    // Renders every pose of every canned scene, and returns whether all
+    // of them matched their references.
+    bool Regress(SceneGraph& _scene, const Options& _options) {
+        if (_options.update)
+            std::filesystem::create_directories(_options.reference);
+        FILE* report = fopen(_options.report.c_str(), "w");
+        if (!report)
+            throw std::runtime_error("failed to open " + _options.report);
+
+        fprintf(report, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"simd\": \"%s\",\n  \"occlusion\": %s,\n  \"shadow\": %d,\n"
+            "  \"ao\": \"%s\",\n  \"repeat\": %d,\n",
+            _options.width, _options.height, Simd::Name(_scene.m_emulator.m_simdLevel),
+            _options.occlusion ? "true" : "false", _options.shadow,
+            !_options.ao ? "none" : _options.aoHalf ? "half" : "full", _options.repeat);
+        fprintf(report, "  \"results\": [");
+
+        printf("scene      pose  shadow ms  occlusion ms  geometry ms  ao ms  lighting ms  tonemap ms  triangles  mismatch\n");
+        const std::vector<ShaderData::Light> lights = _scene.m_lights;
+        bool passed = true;
+        bool first = true;
+        for (const CannedScene& canned : CannedScenes()) {
+            SelectScene(_scene, canned, lights);
+            for (size_t pose = 0; pose < canned.poses.size(); pose++) {
+                SelectPose(_scene, canned.poses[pose]);
+
+                // Tone mapped poses take their exposure straight away, so
+                // they don't depend on the poses before them
+                std::vector<double> shadow, occlusion, geometry, ao, lighting, tonemap;
+                for (int i = 0; i < _options.repeat; i++) {
+                    PassTimes times = RenderFrame(_scene);
+                    shadow.push_back(times.shadow);
+                    occlusion.push_back(times.occlusion);
+                    geometry.push_back(times.geometry);
+                    ao.push_back(times.ao);
+                    lighting.push_back(times.lighting);
+                    auto start = std::chrono::steady_clock::now();
+                    if (canned.toneMap)
+                        _scene.EmulateToneMap(0);
+                    tonemap.push_back(canned.toneMap ? Milliseconds(std::chrono::steady_clock::now() - start) : 0);
+                }
+                const Image& output = canned.toneMap ? _scene.m_toneMapper.m_output : _scene.m_emulatedLighting.m_output;
+
+                // The image is compared as read back from its file, so it
+                // has been through the same RGBE rounding as the reference.
+                char name[64];
+                snprintf(name, sizeof(name), "%s_%zu.hdr", canned.name, pose);
+                std::string outPath = (std::filesystem::path(_options.out) / name).string();
+                output.WriteRGBE(outPath);
+                Image image = Image::LoadRGBE(outPath);
+
+                // A missing reference is a failure unless it is being recorded
+                std::filesystem::path referencePath = std::filesystem::path(_options.reference) / name;
+                double mismatch = 0;
+                if (_options.update)
+                    image.WriteRGBE(referencePath.string());
+                else if (std::filesystem::exists(referencePath))
+                    mismatch = Mismatch(image, Image::LoadRGBE(referencePath.string()));
+                else
+                    mismatch = 1;
+                bool ok = mismatch <= _options.tolerance;
+                passed = passed && ok;
+
+                uint64_t triangles = _scene.m_emulator.m_statistics.setup;
+                printf("%-9s  %4zu  %9.2f  %12.2f  %11.2f  %5.2f  %11.2f  %10.2f  %9llu  %8.5f%s\n",
+                    canned.name, pose, Median(shadow), Median(occlusion), Median(geometry), Median(ao), Median(lighting),
+                    Median(tonemap), static_cast<unsigned long long>(triangles), mismatch, ok ? "" : "  FAILED");
+                fprintf(report, "%s\n    { \"scene\": \"%s\", \"pose\": %zu, \"shadow_ms\": %.3f, \"occlusion_ms\": %.3f, "
+                    "\"geometry_ms\": %.3f, \"ao_ms\": %.3f, \"lighting_ms\": %.3f, \"tonemap_ms\": %.3f, \"triangles\": %llu, "
+                    "\"mismatch\": %.6f, \"passed\": %s }",
+                    first ? "" : ",", canned.name, pose, Median(shadow), Median(occlusion), Median(geometry), Median(ao), Median(lighting),
+                    Median(tonemap), static_cast<unsigned long long>(triangles), mismatch, ok ? "true" : "false");
+                first = false;
+            }
+        }
+        fprintf(report, "\n  ],\n  \"passed\": %s\n}\n", passed ? "true" : "false");
+        fclose(report);
+        return passed;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+    // Self tests
+
+    // MomentShadowEvaluator's paths on the filtered moments of random
+    // pairs of occluders must agree exactly.  On single occluders, both
+    // must leave receivers in front lit and those well behind shadowed,
+    // and must not get lighter with depth in between.
+    bool CheckShadowEvaluator() {
+        using DirectX::SimpleMath::Vector4;
+        using Emulator::MomentShadowMap;
+        ShaderData::Constants constants{};
+        constants.momentBias = 0.003f;  // SceneGraph's defaults
+        constants.depthBias = 0.005f;
+
+        Emulator::MomentShadowEvaluator evaluator;
+        std::vector<Vector4> moments;
+        std::vector<float> depths;
+        auto evaluate = [&](Simd::Level _level) {
+            std::vector<float> intensities(moments.size());
+            evaluator.m_simdLevel = _level;
+            evaluator.Evaluate(constants, moments.data(), depths.data(), intensities.data(), static_cast<int>(moments.size()));
+            return intensities;
+        };
+
+        // Not a multiple of eight, so the scalar tail runs too
+        const int Fragments = 1003;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        for (int i = 0; i < Fragments; i++) {
+            float weight = uniform(random);
+            Vector4 near = MomentShadowMap::OptimizedMoments(uniform(random));
+            Vector4 far = MomentShadowMap::OptimizedMoments(uniform(random));
+            moments.push_back(near * weight + far * (1.0f - weight));
+            depths.push_back(uniform(random));
+        }
+        std::vector<float> scalar = evaluate(Simd::Level::Scalar);
+        std::vector<float> avx2 = evaluate(Simd::Level::AVX2);
+        int differing = 0;
+        for (int i = 0; i < Fragments; i++)
+            differing += scalar[i] != avx2[i];
+        printf("shadow: %d of %d fragments differ between %s and scalar\n",
+            differing, Fragments, Simd::Name(std::min(Simd::Level::AVX2, Simd::Detect())));
+
+        // Occluders at 0.1 to 0.9, each over receivers at 0 to 1
+        const int Steps = 100;
+        moments.clear();
+        depths.clear();
+        std::vector<float> occluders;
+        for (int occluder = 1; occluder <= 9; occluder++)
+            for (int receiver = 0; receiver <= Steps; receiver++) {
+                occluders.push_back(occluder / 10.0f);
+                moments.push_back(MomentShadowMap::OptimizedMoments(occluders.back()));
+                depths.push_back(receiver / static_cast<float>(Steps));
+            }
+        int wrong = 0;
+        for (Simd::Level level : { Simd::Level::Scalar, Simd::Level::AVX2 }) {
+            std::vector<float> intensities = evaluate(level);
+            for (size_t i = 0; i < intensities.size(); i++) {
+                float occluder = occluders[i];
+                bool first = i % (Steps + 1) == 0;
+                bool ok = true;
+                if (depths[i] <= occluder)
+                    ok = intensities[i] < 0.01f;
+                else if (depths[i] >= occluder + 0.1f)
+                    ok = intensities[i] > 0.9f;
+                ok = ok && (first || intensities[i] >= intensities[i - 1]);
+                wrong += !ok;
+            }
+        }
+        printf("shadow: %d of %d single occluder fragments wrong\n", wrong, 2 * static_cast<int>(depths.size()));
+        return differing == 0 && wrong == 0;
+    }
+
+    // SummedAreaTable's sums of random rectangles of a moment map of
+    // random depths, against the texels added up one by one.  The table
+    // sums exactly, so only the rounding of the result to float remains.
+    bool CheckSummedAreaTable() {
+        // Neither side a multiple of the scan's block of rows
+        const int Width = 301, Height = 203, Rectangles = 2000;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::vector<float> depth(Width * Height);
+        for (float& d : depth)
+            d = uniform(random);
+        Emulator::MomentShadowMap map;
+        map.Resize(Width, Height);
+        map.Generate(depth.data());
+        Emulator::SummedAreaTable table;
+        table.Build(map);
+
+        double worst = 0;
+        std::uniform_int_distribution<int> column(0, Width), row(0, Height);
+        for (int i = 0; i < Rectangles; i++) {
+            int x0 = column(random), x1 = column(random), y0 = row(random), y1 = row(random);
+            if (x1 < x0)
+                std::swap(x0, x1);
+            if (y1 < y0)
+                std::swap(y0, y1);
+            double expected[Emulator::SummedAreaTable::Channels] = {};
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                    for (int c = 0; c < Emulator::SummedAreaTable::Channels; c++)
+                        expected[c] += map.m_moments[(static_cast<size_t>(y) * Width + x) * Emulator::MomentShadowMap::Channels + c];
+            DirectX::SimpleMath::Vector4 sum = table.Sum(x0, y0, x1, y1);
+            const float actual[] = { sum.x, sum.y, sum.z, sum.w };
+            for (int c = 0; c < Emulator::SummedAreaTable::Channels; c++) {
+                expected[c] /= 65535.0;
+                double error = std::abs(actual[c] - expected[c]);
+                worst = std::max(worst, expected[c] > 0 ? error / expected[c] : error);
+            }
+        }
+        printf("summed-area table: worst relative error %.2g over %d rectangles\n", worst, Rectangles);
+        return worst < 1e-6;
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        Options options = ParseOptions(argc, argv);
+        if (!options.brdfTable.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            Emulator::SplitSumTable table;
+            table.Bake();
+            table.m_table.WriteRGBE(options.brdfTable);
+            printf("baked %dx%d split-sum table in %.1f ms\n", table.m_table.m_width, table.m_table.m_height,
+                Milliseconds(std::chrono::steady_clock::now() - start));
+            return EXIT_SUCCESS;
+        }
+        if (!options.environment.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            Emulator::PrefilteredEnvironment environment;
+            environment.Bake(Image::LoadRGBE(options.environment));
+            const std::string base = std::filesystem::path(options.environment).replace_extension().string();
+            environment.Write(base);
+            printf("baked %zu prefiltered levels of %s in %.1f ms\n", environment.m_levels.size(),
+                options.environment.c_str(), Milliseconds(std::chrono::steady_clock::now() - start));
+            return EXIT_SUCCESS;
+        }
+        if (!options.irradiance.empty()) {
+            Image sky = Image::LoadRGBE(options.irradiance);
+            auto start = std::chrono::steady_clock::now();
+            Emulator::IrradianceSH irradiance;
+            irradiance.Project(sky);
+            printf("projected %s in %.1f ms\n", options.irradiance.c_str(),
+                Milliseconds(std::chrono::steady_clock::now() - start));
+            for (const auto& coefficient : irradiance.m_coefficients)
+                printf("%g %g %g\n", coefficient.x, coefficient.y, coefficient.z);
+            const std::string base = std::filesystem::path(options.irradiance).replace_extension().string();
+            irradiance.Reconstruct(std::max(1, sky.m_width / 4), std::max(1, sky.m_height / 4)).WriteRGBE(base + ".sh.hdr");
+            return EXIT_SUCCESS;
+        }
+
+        if (options.selfTest) {
+            bool passed = CheckShadowEvaluator();
+            passed = CheckSummedAreaTable() && passed;
+            printf(passed ? "all self tests pass\n" : "some self tests failed\n");
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        std::filesystem::create_directories(options.out);
+
+        SceneGraph scene;
+        scene.Initialize(options.width, options.height);
+        scene.m_emulate = true;
+        scene.m_occlusionCulling = options.occlusion;
+        scene.m_emulateShadow = options.shadow > 0;
+        scene.m_emulateAO = options.ao;
+        scene.m_emulatedAO.m_halfResolution = options.aoHalf;
+        scene.m_emulateToneMap = options.tonemap;
+        if (options.shadow > 0)
+            scene.m_shadowResolution = options.shadow;
+        if (options.blur >= 0)
+            scene.SetBlurWidth(options.blur);
+
+        if (options.regress) {
+            bool passed = Regress(scene, options);
+            printf(passed ? "all scenes match\n" : "some scenes differ from their references\n");
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        printf("frame  geometry ms  ao ms  lighting ms  tonemap ms  triangles  lights/tile\n");
+        double geometryTotal = 0, aoTotal = 0, lightingTotal = 0, tonemapTotal = 0;
+        for (int frame = 0; frame < options.frames; frame++) {
+            ScriptFrame(scene, frame, options.frames);
+
+            PassTimes times = RenderFrame(scene);
+            double geometry = times.shadow + times.occlusion + times.geometry;
+            double lighting = times.lighting;
+            geometryTotal += geometry;
+            aoTotal += times.ao;
+            lightingTotal += lighting;
+
+            double tonemap = 0;
+            if (scene.m_emulateToneMap) {
+                auto start = std::chrono::steady_clock::now();
+                scene.EmulateToneMap(1.0f / FrameRate);
+                tonemap = Milliseconds(std::chrono::steady_clock::now() - start);
+                tonemapTotal += tonemap;
+            }
+
+            auto& statistics = scene.m_emulatedLighting.m_statistics;
+            printf("%5d  %11.2f  %5.2f  %11.2f  %10.2f  %9llu  %11.1f\n",
+                frame, geometry, times.ao, lighting, tonemap,
+                static_cast<unsigned long long>(scene.m_emulator.m_statistics.setup),
+                statistics.tiles ? static_cast<double>(statistics.tileLights) / statistics.tiles : 0.0
+            );
+
+            char name[32];
+            snprintf(name, sizeof(name), "frame%03d.hdr", frame);
+            scene.m_emulatedLighting.m_output.WriteRGBE((std::filesystem::path(options.out) / name).string());
+            if (options.ao) {
+                snprintf(name, sizeof(name), "ao%03d.hdr", frame);
+                AOImage(scene.m_emulatedAO).WriteRGBE((std::filesystem::path(options.out) / name).string());
+            }
+            if (options.tonemap) {
+                snprintf(name, sizeof(name), "frame%03d.ppm", frame);
+                scene.m_toneMapper.m_output.WritePPM((std::filesystem::path(options.out) / name).string());
+            }
+        }
+        printf("mean   %11.2f  %5.2f  %11.2f  %10.2f\n", geometryTotal / options.frames, aoTotal / options.frames,
+            lightingTotal / options.frames, tonemapTotal / options.frames);
+    }
+    catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
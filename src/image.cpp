@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////
+// A floating point RGBA image held in CPU memory.  Used wherever the
+// CPU side of the renderer needs texels: the emulator's texture
+// sampling, offline bakers, and writing out rendered frames.
+////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "image.h"
+#include "rgbe.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DirectX::SimpleMath;
+
+Image::Image(int _width, int _height)
+    : m_width(_width)
+    , m_height(_height)
+    , m_pixels(static_cast<size_t>(_width) * _height)
+{
+}
+
+Vector4 Image::Sample(const Vector2& _uv) const {
+    // Texel centers are at (i + 0.5) / size
+    float x = _uv.x * m_width - 0.5f;
+    float y = _uv.y * m_height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float tx = x - fx, ty = y - fy;
+
+    auto wrap = [](int _i, int _size) {
+        _i %= _size;
+        return _i < 0 ? _i + _size : _i;
+    };
+    int x0 = wrap(static_cast<int>(fx), m_width), x1 = wrap(x0 + 1, m_width);
+    int y0 = wrap(static_cast<int>(fy), m_height), y1 = wrap(y0 + 1, m_height);
+
+    Vector4 top = At(x0, y0) * (1 - tx) + At(x1, y0) * tx;
+    Vector4 bottom = At(x0, y1) * (1 - tx) + At(x1, y1) * tx;
+    return top * (1 - ty) + bottom * ty;
+}
+
+Image Image::LoadRGBE(const std::string& _filename) {
+    FILE* file = fopen(_filename.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("failed to open file");
+
+    int width = 0;
+    int height = 0;
+    rgbe_header_info info{};
+    if (RGBE_ReadHeader(file, &width, &height, &info) != RGBE_RETURN_SUCCESS) {
+        fclose(file);
+        throw std::runtime_error("failed to read header");
+    }
+
+    // RGBE_ReadPixels_RLE fills RGB and steps four floats per pixel
+    Image image(width, height);
+    for (auto& pixel : image.m_pixels)
+        pixel.w = 1;
+    if (RGBE_ReadPixels_RLE(file, &image.m_pixels[0].x, width, height) != RGBE_RETURN_SUCCESS) {
+        fclose(file);
+        throw std::runtime_error("failed to read pixels");
+    }
+    fclose(file);
+    return image;
+}
+
+void Image::WriteRGBE(const std::string& _filename) const {
+    FILE* file = fopen(_filename.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("failed to open file");
+
+    // The RGBE writer takes a non-const pointer but only reads
+    std::vector<Vector4> pixels = m_pixels;
+    if (RGBE_WriteHeader(file, m_width, m_height, nullptr) != RGBE_RETURN_SUCCESS ||
+        RGBE_WritePixels_RLE(file, &pixels[0].x, m_width, m_height) != RGBE_RETURN_SUCCESS) {
+        fclose(file);
+        throw std::runtime_error("failed to write image");
+    }
+    fclose(file);
+}
+
+void Image::WritePPM(const std::string& _filename) const {
+    FILE* file = fopen(_filename.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("failed to open file");
+
+    auto byte = [](float _value) {
+        return static_cast<unsigned char>(std::max(0.0f, std::min(_value, 1.0f)) * 255.0f + 0.5f); // NaN to 0
+    };
+    std::vector<unsigned char> bytes(m_pixels.size() * 3);
+    for (size_t i = 0; i < m_pixels.size(); i++) {
+        bytes[3 * i + 0] = byte(m_pixels[i].x);
+        bytes[3 * i + 1] = byte(m_pixels[i].y);
+        bytes[3 * i + 2] = byte(m_pixels[i].z);
+    }
+    fprintf(file, "P6\n%d %d\n255\n", m_width, m_height);
+    if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+        fclose(file);
+        throw std::runtime_error("failed to write image");
+    }
+    fclose(file);
+}
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////
+// A floating point RGBA image held in CPU memory.  Used wherever the
+// CPU side of the renderer needs texels: the emulator's texture
+// sampling, offline bakers, and writing out rendered frames.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <string>
+#include <vector>
+
+class Image {
+public:
+    int m_width = 0, m_height = 0;
+    std::vector<DirectX::SimpleMath::Vector4> m_pixels; // Row major, top row first
+
+    Image() = default;
+    Image(int _width, int _height);
+
+    DirectX::SimpleMath::Vector4& At(int _x, int _y) { return m_pixels[static_cast<size_t>(_y) * m_width + _x]; }
+    const DirectX::SimpleMath::Vector4& At(int _x, int _y) const {
+        return m_pixels[static_cast<size_t>(_y) * m_width + _x];
+    }
+
+    // Bilinear filtered lookup with wrap addressing, like the shaders'
+    // StaticSampler at mip level 0.
+    DirectX::SimpleMath::Vector4 Sample(const DirectX::SimpleMath::Vector2& _uv) const;
+
+    // Radiance (.hdr) files.  Alpha is 1 on load and ignored on write.
+    static Image LoadRGBE(const std::string& _filename);
+    void WriteRGBE(const std::string& _filename) const;
+
+    // Binary 8 bit PPM of values already in [0, 1], such as tone mapped
+    // frames.  Values outside are clamped.
+    void WritePPM(const std::string& _filename) const;
+
+    explicit operator bool() const { return !m_pixels.empty(); }
+};
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////
+// Spherical harmonic irradiance; see irradiance.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "irradiance.h"
+#include "envmap.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace DirectX::SimpleMath;
+
+static const double Pi = 3.141592653589793;
+
+static_assert(
+    sizeof(ShaderData::Constants::irradianceSH) == Emulator::IrradianceSH::Registers * sizeof(ShaderData::float4),
+    "irradianceSH no longer fits Pack"
+);
+static_assert(offsetof(ShaderData::Constants, irradianceSH) % 16 == 0, "irradianceSH must start a constant register");
+
+// The real SH as constant times polynomial, in the order of the
+// coefficients
+static const double Basis[] = {
+    0.282095,
+    0.488603, 0.488603, 0.488603,
+    1.092548, 1.092548, 0.315392, 1.092548, 0.546274,
+};
+
+// The clamped cosine's SH, by band
+static const double Convolution[] = { Pi, 2.0 * Pi / 3.0, 2.0 * Pi / 3.0, 2.0 * Pi / 3.0,
+    Pi / 4.0, Pi / 4.0, Pi / 4.0, Pi / 4.0, Pi / 4.0 };
+
+static void Polynomials(double _x, double _y, double _z, double _out[Emulator::IrradianceSH::Coefficients]) {
+    _out[0] = 1.0;
+    _out[1] = _y;
+    _out[2] = _z;
+    _out[3] = _x;
+    _out[4] = _x * _y;
+    _out[5] = _y * _z;
+    _out[6] = 3.0 * _z * _z - 1.0;
+    _out[7] = _x * _z;
+    _out[8] = _x * _x - _y * _y;
+}
+
+void Emulator::IrradianceSH::Project(const Image& _sky) {
+    const int width = _sky.m_width, height = _sky.m_height;
+
+    // Directions as in PrefilteredEnvironment::DirectionOf, split into
+    // the parts that vary by column and by row
+    std::vector<double> sinPhi(width), cosPhi(width);
+    for (int x = 0; x < width; x++) {
+        double phi = ((x + 0.5) / width - 0.5) * 2.0 * Pi;
+        sinPhi[x] = std::sin(phi);
+        cosPhi[x] = std::cos(phi);
+    }
+
+    using Sums = std::array<double, Floats + 1>; // The coefficients, then the solid angle
+    std::vector<Sums> rows(height);
+    ThreadPool::Get().ParallelFor(height, [&](uint32_t _y) {
+        const double theta = (_y + 0.5) / height * Pi;
+        const double sinTheta = std::sin(theta), cosTheta = std::cos(theta);
+        const double solidAngle = (2.0 * Pi / width) * (Pi / height) * sinTheta;
+        Sums sums{};
+        double polynomials[Coefficients];
+        for (int x = 0; x < width; x++) {
+            Polynomials(sinTheta * sinPhi[x], cosTheta, -sinTheta * cosPhi[x], polynomials);
+            const Vector4& radiance = _sky.At(x, _y);
+            for (int i = 0; i < Coefficients; i++) {
+                sums[3 * i + 0] += radiance.x * polynomials[i];
+                sums[3 * i + 1] += radiance.y * polynomials[i];
+                sums[3 * i + 2] += radiance.z * polynomials[i];
+            }
+        }
+        for (double& sum : sums)
+            sum *= solidAngle;
+        sums[Floats] = solidAngle * width;
+        rows[_y] = sums;
+    });
+
+    Sums total{};
+    for (const Sums& row : rows)
+        for (int i = 0; i <= Floats; i++)
+            total[i] += row[i];
+
+    // The midpoint rule misses the sphere's area slightly; rescale so a
+    // constant sky projects exactly
+    const double normalize = total[Floats] > 0 ? 4.0 * Pi / total[Floats] : 0.0;
+    for (int i = 0; i < Coefficients; i++) {
+        const double scale = normalize * Convolution[i] * Basis[i] * Basis[i];
+        m_coefficients[i] = Vector3(
+            static_cast<float>(total[3 * i + 0] * scale),
+            static_cast<float>(total[3 * i + 1] * scale),
+            static_cast<float>(total[3 * i + 2] * scale)
+        );
+    }
+}
+
+Vector3 Emulator::IrradianceSH::Irradiance(const Vector3& _normal) const {
+    double polynomials[Coefficients];
+    Polynomials(_normal.x, _normal.y, _normal.z, polynomials);
+    Vector3 irradiance;
+    for (int i = 0; i < Coefficients; i++)
+        irradiance += m_coefficients[i] * static_cast<float>(polynomials[i]);
+    return irradiance;
+}
+
+void Emulator::IrradianceSH::Pack(ShaderData::float4 _out[Registers]) const {
+    float floats[4 * Registers] = {};
+    for (int i = 0; i < Coefficients; i++) {
+        floats[3 * i + 0] = m_coefficients[i].x;
+        floats[3 * i + 1] = m_coefficients[i].y;
+        floats[3 * i + 2] = m_coefficients[i].z;
+    }
+    for (int i = 0; i < Registers; i++)
+        _out[i] = ShaderData::float4(floats[4 * i + 0], floats[4 * i + 1], floats[4 * i + 2], floats[4 * i + 3]);
+}
+
+Image Emulator::IrradianceSH::Reconstruct(int _width, int _height) const {
+    Image image(_width, _height);
+    ThreadPool::Get().ParallelFor(_height, [&](uint32_t _y) {
+        for (int x = 0; x < _width; x++) {
+            Vector3 N = PrefilteredEnvironment::DirectionOf(Vector2((x + 0.5f) / _width, (_y + 0.5f) / _height));
+            Vector3 E = Irradiance(N);
+            image.At(x, _y) = Vector4(std::max(E.x, 0.0f), std::max(E.y, 0.0f), std::max(E.z, 0.0f), 1.0f);
+        }
+    });
+    return image;
+}
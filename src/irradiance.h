@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////
+// Diffuse irradiance from an equirectangular sky as nine spherical
+// harmonics per color channel (Ramamoorthi and Hanrahan, "An Efficient
+// Representation for Irradiance Environment Maps", 2001), in place of
+// a precomputed .irr.hdr texture.
+//
+// Project integrates the sky against the first nine real SH, weighting
+// each texel by the solid angle it covers, sin(theta) times the size of
+// a texel in theta and phi.  Rows are summed in parallel, in doubles,
+// then added up in order so the result doesn't depend on the thread
+// count.  The clamped cosine's convolution and the basis constants are
+// folded into the coefficients, so the irradiance about a normal is
+// just a quadratic polynomial in its x, y and z:
+//
+//   E(N) = c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1)
+//             + c7 xz + c8 (x^2 - y^2)
+//
+// Pack lays the 27 floats out as seven float4s for the Constants
+// buffer, and Reconstruct renders them back to a texture laid out like
+// the sky, the old .irr.hdr.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+
+#include "../ShaderData.h"
+#include "image.h"
+
+namespace Emulator {
+    class IrradianceSH {
+    public:
+        static constexpr int Coefficients = 9;
+        static constexpr int Floats = 3 * Coefficients;
+        static constexpr int Registers = (Floats + 3) / 4; // float4s taken by Pack
+
+        DirectX::SimpleMath::Vector3 m_coefficients[Coefficients]; // c0 to c8 above, RGB each
+
+        void Project(const Image& _sky);
+
+        // Irradiance E, so a Lambertian surface reflects Kd / pi times it.
+        DirectX::SimpleMath::Vector3 Irradiance(const DirectX::SimpleMath::Vector3& _normal) const;
+
+        // c0.rgb, c1.rgb and so on, back to back; the last w is 0.
+        void Pack(ShaderData::float4 _out[Registers]) const;
+
+        // Rows in parallel.
+        Image Reconstruct(int _width, int _height) const;
+    };
+}
@@ -0,0 +1,380 @@
+////////////////////////////////////////////////////////////////////////
+// A bounding volume hierarchy over point lights; see lightbvh.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "lightbvh.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static Vector3 Center(const ShaderData::Light& _light) {
+    return Vector3(_light.lightPos.x, _light.lightPos.y, _light.lightPos.z);
+}
+
+static Vector3 Extent(const ShaderData::Light& _light) {
+    return Vector3(_light.range, _light.range, _light.range);
+}
+
+// lightingPhongPixel.hlsl's attenuation, 0 out of range
+static float Attenuation(float _distance, float _range) {
+    return _distance < _range ? 10.0f / (_distance * _distance) - 10.0f / (_range * _range) : 0.0f;
+}
+
+void Emulator::LightBVH::Build(const std::vector<ShaderData::Light>& _lights) {
+    m_nodes.clear();
+    m_order.resize(_lights.size());
+    if (_lights.empty())
+        return;
+
+    // The centers are partitioned alongside their indices, so the
+    // splits don't chase indices back into _lights
+    struct Entry {
+        float center[3];
+        uint32_t light;
+    };
+    std::vector<Entry> entries(_lights.size());
+    for (uint32_t i = 0; i < entries.size(); i++)
+        entries[i] = { { _lights[i].lightPos.x, _lights[i].lightPos.y, _lights[i].lightPos.z }, i };
+
+    // Nodes waiting to be split, as ranges of entries.  Each split
+    // appends both children at once, so they end up side by side.
+    struct Pending {
+        uint32_t node, begin, end;
+    };
+    std::vector<Pending> stack{ { 0, 0, static_cast<uint32_t>(entries.size()) } };
+    m_nodes.push_back({});
+    while (!stack.empty()) {
+        Pending pending = stack.back();
+        stack.pop_back();
+
+        const uint32_t count = pending.end - pending.begin;
+        if (count <= LeafSize) {
+            m_nodes[pending.node].first = pending.begin;
+            m_nodes[pending.node].count = count;
+            continue;
+        }
+
+        float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t i = pending.begin; i < pending.end; i++)
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::min(lo[axis], entries[i].center[axis]);
+                hi[axis] = std::max(hi[axis], entries[i].center[axis]);
+            }
+        const float size[3] = { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] };
+        const int axis = size[0] >= size[1] && size[0] >= size[2] ? 0 : size[1] >= size[2] ? 1 : 2;
+        const uint32_t middle = pending.begin + count / 2;
+        std::nth_element(
+            entries.begin() + pending.begin, entries.begin() + middle, entries.begin() + pending.end,
+            [axis](const Entry& _a, const Entry& _b) {
+                return _a.center[axis] < _b.center[axis] || (_a.center[axis] == _b.center[axis] && _a.light < _b.light);
+            }
+        );
+
+        const uint32_t left = static_cast<uint32_t>(m_nodes.size());
+        m_nodes[pending.node].first = left;
+        m_nodes[pending.node].count = 0;
+        m_nodes.push_back({});
+        m_nodes.push_back({});
+        stack.push_back({ left, pending.begin, middle });
+        stack.push_back({ left + 1, middle, pending.end });
+    }
+
+    for (uint32_t i = 0; i < entries.size(); i++)
+        m_order[i] = entries[i].light;
+
+    // Leaves keep their lights in index order, for the queries
+    for (const Node& node : m_nodes)
+        if (node.count)
+            std::sort(m_order.begin() + node.first, m_order.begin() + node.first + node.count);
+    Refit(_lights);
+}
+
+float Emulator::LightBVH::Intensity(const ShaderData::Light& _light) {
+    return std::max({ _light.lightColor.x, _light.lightColor.y, _light.lightColor.z, 0.0f });
+}
+
+// Two aggregates as one.  Lights of no intensity still count for the
+// position box, and only pull the centroid when nothing else does.
+static Emulator::LightBVH::Aggregate Combine(const Emulator::LightBVH::Aggregate& _a, const Emulator::LightBVH::Aggregate& _b) {
+    Emulator::LightBVH::Aggregate aggregate;
+    aggregate.weight = _a.weight + _b.weight;
+    aggregate.position = aggregate.weight > 0 ?
+        (_a.position * _a.weight + _b.position * _b.weight) * (1.0f / aggregate.weight) :
+        (_a.position + _b.position) * 0.5f;
+    aggregate.color = _a.color + _b.color;
+    aggregate.minRange = std::min(_a.minRange, _b.minRange);
+    aggregate.maxRange = std::max(_a.maxRange, _b.maxRange);
+    aggregate.positionMin = Vector3::Min(_a.positionMin, _b.positionMin);
+    aggregate.positionMax = Vector3::Max(_a.positionMax, _b.positionMax);
+    aggregate.falloff = _a.falloff + _b.falloff;
+    aggregate.falloffSquared = _a.falloffSquared + _b.falloffSquared;
+    return aggregate;
+}
+
+// Children always come after their parent, so walking backwards sees
+// both children of a node before the node itself.
+void Emulator::LightBVH::Refit(const std::vector<ShaderData::Light>& _lights) {
+    m_aggregates.resize(m_nodes.size());
+    for (size_t n = m_nodes.size(); n-- > 0;) {
+        Node& node = m_nodes[n];
+        if (node.count) {
+            Aggregate& aggregate = m_aggregates[n];
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                const ShaderData::Light& light = _lights[m_order[i]];
+                const float falloff = 1.0f / (light.range * light.range);
+                const Aggregate single{
+                    .position = Center(light),
+                    .weight = Intensity(light),
+                    .color = light.lightColor,
+                    .minRange = light.range,
+                    .positionMin = Center(light),
+                    .maxRange = light.range,
+                    .positionMax = Center(light),
+                    .falloff = Intensity(light) * falloff,
+                    .falloffSquared = Intensity(light) * falloff * falloff,
+                };
+                aggregate = i == node.first ? single : Combine(aggregate, single);
+            }
+
+            const ShaderData::Light& light = _lights[m_order[node.first]];
+            node.min = Center(light) - Extent(light);
+            node.max = Center(light) + Extent(light);
+            for (uint32_t i = node.first + 1; i < node.first + node.count; i++) {
+                const ShaderData::Light& other = _lights[m_order[i]];
+                node.min.x = std::min(node.min.x, other.lightPos.x - other.range);
+                node.min.y = std::min(node.min.y, other.lightPos.y - other.range);
+                node.min.z = std::min(node.min.z, other.lightPos.z - other.range);
+                node.max.x = std::max(node.max.x, other.lightPos.x + other.range);
+                node.max.y = std::max(node.max.y, other.lightPos.y + other.range);
+                node.max.z = std::max(node.max.z, other.lightPos.z + other.range);
+            }
+        }
+        else {
+            const Node& left = m_nodes[node.first];
+            const Node& right = m_nodes[node.first + 1];
+            node.min = Vector3(std::min(left.min.x, right.min.x), std::min(left.min.y, right.min.y), std::min(left.min.z, right.min.z));
+            node.max = Vector3(std::max(left.max.x, right.max.x), std::max(left.max.y, right.max.y), std::max(left.max.z, right.max.z));
+            m_aggregates[n] = Combine(m_aggregates[node.first], m_aggregates[node.first + 1]);
+        }
+    }
+}
+
+// Visits the nodes _overlaps accepts, and keeps the lights of their
+// leaves that _touches accepts.
+template <typename Overlaps, typename Touches>
+void Emulator::LightBVH::Traverse(Overlaps _overlaps, Touches _touches, std::vector<uint32_t>& _out) const {
+    _out.clear();
+    if (m_nodes.empty())
+        return;
+    uint32_t stack[64];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth) {
+        const Node& node = m_nodes[stack[--depth]];
+        if (!_overlaps(node))
+            continue;
+        if (node.count) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+                if (_touches(m_order[i]))
+                    _out.push_back(m_order[i]);
+        }
+        else {
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+    std::sort(_out.begin(), _out.end());
+}
+
+void Emulator::LightBVH::Query(
+    const std::vector<ShaderData::Light>& _lights, const Vector3& _min, const Vector3& _max, std::vector<uint32_t>& _out
+) const {
+    Traverse(
+        [&](const Node& _node) {
+            return _node.min.x <= _max.x && _node.max.x >= _min.x &&
+                _node.min.y <= _max.y && _node.max.y >= _min.y &&
+                _node.min.z <= _max.z && _node.max.z >= _min.z;
+        },
+        [&](uint32_t _light) {
+            const ShaderData::Light& light = _lights[_light];
+            float dx = std::max({ _min.x - light.lightPos.x, light.lightPos.x - _max.x, 0.0f });
+            float dy = std::max({ _min.y - light.lightPos.y, light.lightPos.y - _max.y, 0.0f });
+            float dz = std::max({ _min.z - light.lightPos.z, light.lightPos.z - _max.z, 0.0f });
+            return dx * dx + dy * dy + dz * dz <= light.range * light.range;
+        },
+        _out
+    );
+}
+
+void Emulator::LightBVH::Query(const std::vector<ShaderData::Light>& _lights, const Frustum& _frustum, std::vector<uint32_t>& _out) const {
+    Traverse(
+        // Outside when the box's corner farthest along a plane's normal
+        // is behind it
+        [&](const Node& _node) {
+            for (const Vector4& plane : _frustum.planes) {
+                Vector3 corner(
+                    plane.x >= 0 ? _node.max.x : _node.min.x,
+                    plane.y >= 0 ? _node.max.y : _node.min.y,
+                    plane.z >= 0 ? _node.max.z : _node.min.z
+                );
+                if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0)
+                    return false;
+            }
+            return true;
+        },
+        [&](uint32_t _light) {
+            const ShaderData::Light& light = _lights[_light];
+            for (const Vector4& plane : _frustum.planes)
+                if (plane.x * light.lightPos.x + plane.y * light.lightPos.y + plane.z * light.lightPos.z + plane.w < -light.range)
+                    return false;
+            return true;
+        },
+        _out
+    );
+}
+
+void Emulator::LightBVH::Query(
+    const std::vector<ShaderData::Light>& _lights,
+    const std::vector<std::pair<Vector3, Vector3>>& _boxes,
+    std::vector<std::vector<uint32_t>>& _out
+) const {
+    _out.resize(_boxes.size());
+    ThreadPool::Get().ParallelFor(static_cast<uint32_t>(_boxes.size()), [&](uint32_t _i) {
+        Query(_lights, _boxes[_i].first, _boxes[_i].second, _out[_i]);
+    });
+}
+
+void Emulator::LightBVH::Query(
+    const std::vector<ShaderData::Light>& _lights, const std::vector<Frustum>& _frustums,
+    std::vector<std::vector<uint32_t>>& _out
+) const {
+    _out.resize(_frustums.size());
+    ThreadPool::Get().ParallelFor(static_cast<uint32_t>(_frustums.size()), [&](uint32_t _i) {
+        Query(_lights, _frustums[_i], _out[_i]);
+    });
+}
+
+ShaderData::Light Emulator::LightBVH::VirtualLight(uint32_t _node) const {
+    const Aggregate& aggregate = m_aggregates[_node];
+    return {
+        .lightPos = aggregate.position,
+        .lightColor = aggregate.color,
+        .range = aggregate.falloff > 0 ? std::sqrt(aggregate.weight / aggregate.falloff) : aggregate.maxRange,
+    };
+}
+
+void Emulator::LightBVH::Cut(
+    const std::vector<ShaderData::Light>& _lights, const Matrix& _toBox,
+    const Vector3& _min, const Vector3& _max,
+    float _maxError, float _minError, std::vector<uint32_t>& _out
+) const {
+    // The least and most distance from anywhere in the box to anywhere
+    // within _radius of the world space _center
+    auto distances = [&](const Vector3& _center, float _radius, float& _nearest, float& _farthest) {
+        const Vector3 center = Vector3::Transform(_center, _toBox);
+        const float nearX = std::max({ _min.x - center.x, center.x - _max.x, 0.0f });
+        const float nearY = std::max({ _min.y - center.y, center.y - _max.y, 0.0f });
+        const float nearZ = std::max({ _min.z - center.z, center.z - _max.z, 0.0f });
+        const float farX = std::max(center.x - _min.x, _max.x - center.x);
+        const float farY = std::max(center.y - _min.y, _max.y - center.y);
+        const float farZ = std::max(center.z - _min.z, _max.z - center.z);
+        _nearest = std::max(std::sqrt(nearX * nearX + nearY * nearY + nearZ * nearZ) - _radius, 0.0f);
+        _farthest = std::sqrt(farX * farX + farY * farY + farZ * farZ) + _radius;
+    };
+
+    // The cut, as a heap on the error bound, and the least light the
+    // box gets from it
+    struct Entry {
+        float error, lower;
+        uint32_t node;
+    };
+    thread_local std::vector<Entry> heap;
+    auto byError = [](const Entry& _a, const Entry& _b) { return _a.error < _b.error; };
+    double lowerSum = 0;
+    auto push = [&](uint32_t _node) {
+        const Aggregate& aggregate = m_aggregates[_node];
+        const float radius = (aggregate.positionMax - aggregate.positionMin).Length() * 0.5f;
+        float nearest, farthest;
+        distances((aggregate.positionMin + aggregate.positionMax) * 0.5f, radius, nearest, farthest);
+        if (nearest > aggregate.maxRange)
+            return;
+        const float intensity = std::max({ aggregate.color.x, aggregate.color.y, aggregate.color.z, 0.0f });
+        const float spread = std::sqrt(std::max(aggregate.weight * aggregate.falloffSquared - aggregate.falloff * aggregate.falloff, 0.0f));
+        const float apart = nearest + 2.0f * radius;
+        const float error = intensity == 0 ? 0.0f : nearest == 0 ? INFINITY :
+            intensity * (10.0f / (nearest * nearest) - 10.0f / (apart * apart)) + 10.0f * spread;
+        const float lower = intensity * Attenuation(farthest, aggregate.minRange);
+        heap.push_back({ error, lower, _node });
+        std::push_heap(heap.begin(), heap.end(), byError);
+        lowerSum += lower;
+    };
+
+    heap.clear();
+    _out.clear();
+    if (m_nodes.empty())
+        return;
+    push(0);
+    while (!heap.empty() && heap.front().error > std::max(_maxError * lowerSum, static_cast<double>(_minError))) {
+        std::pop_heap(heap.begin(), heap.end(), byError);
+        const Entry entry = heap.back();
+        heap.pop_back();
+        lowerSum -= entry.lower;
+
+        const Node& node = m_nodes[entry.node];
+        if (!node.count) {
+            push(node.first);
+            push(node.first + 1);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            const ShaderData::Light& light = _lights[m_order[i]];
+            float nearest, farthest;
+            distances(Center(light), 0, nearest, farthest);
+            if (nearest > light.range)
+                continue;
+            _out.push_back(m_order[i]);
+            lowerSum += Intensity(light) * Attenuation(farthest, light.range);
+        }
+    }
+    for (const Entry& entry : heap)
+        _out.push_back(static_cast<uint32_t>(_lights.size()) + entry.node);
+    std::sort(_out.begin(), _out.end());
+}
+
+// With row vectors, clip space is p * _viewProj, so each clip
+// coordinate is p dotted with a column.  The planes are normalized so
+// a sphere can be tested against them by its radius.
+static Vector4 Column(const Matrix& _m, int _j) {
+    return Vector4(_m.m[0][_j], _m.m[1][_j], _m.m[2][_j], _m.m[3][_j]);
+}
+
+static Vector4 Normalized(const Vector4& _plane) {
+    float length = std::sqrt(_plane.x * _plane.x + _plane.y * _plane.y + _plane.z * _plane.z);
+    return length > 0 ? _plane * (1.0f / length) : _plane;
+}
+
+Emulator::LightBVH::Frustum Emulator::LightBVH::FrustumOf(const Matrix& _viewProj) {
+    return TileFrustum(_viewProj, 0, 0, 1, 1, 1, 1);
+}
+
+Emulator::LightBVH::Frustum Emulator::LightBVH::TileFrustum(
+    const Matrix& _viewProj, int _x0, int _y0, int _x1, int _y1, int _width, int _height
+) {
+    const Vector4 x = Column(_viewProj, 0), y = Column(_viewProj, 1), z = Column(_viewProj, 2), w = Column(_viewProj, 3);
+
+    // The tile's edges in normalized device coordinates, y up
+    const float left = 2.0f * _x0 / _width - 1.0f, right = 2.0f * _x1 / _width - 1.0f;
+    const float top = 1.0f - 2.0f * _y0 / _height, bottom = 1.0f - 2.0f * _y1 / _height;
+
+    Frustum frustum;
+    frustum.planes[Frustum::Left] = Normalized(x - w * left);
+    frustum.planes[Frustum::Right] = Normalized(w * right - x);
+    frustum.planes[Frustum::Bottom] = Normalized(y - w * bottom);
+    frustum.planes[Frustum::Top] = Normalized(w * top - y);
+    frustum.planes[Frustum::Near] = Normalized(z);
+    frustum.planes[Frustum::Far] = Normalized(w - z);
+    return frustum;
+}
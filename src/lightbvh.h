@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////
+// A bounding volume hierarchy over the scene's point lights, each
+// bounded by the box around its sphere of influence (lightPos, range),
+// so lights near a box, frustum or screen tile are found without
+// looking at all of them.
+//
+// Build splits at the median along the widest axis of the light
+// centers until at most LeafSize lights remain, which keeps the tree
+// balanced however the lights are spread.  Children are stored as
+// consecutive pairs after their parent, so Refit, for lights that move
+// or change range without being added or removed, is a single
+// backward pass over the nodes.
+//
+// Queries return light indices in increasing order, so lighting summed
+// over them matches lighting summed over the whole list.  Batched
+// queries run one query per work item on the thread pool.
+//
+// Each node also keeps an Aggregate of its lights, updated with the
+// bounds, so that far enough away one virtual light can stand in for
+// all of them, as in Lightcuts (Walter et al. 2005).  Cut picks, for a
+// box, the nodes whose virtual lights will do: starting from the root,
+// the node with the largest error bound is replaced by its children,
+// or a leaf by its lights, until no node's bound is more than
+// _maxError of the least light the box is sure to get, or _minError,
+// whichever is larger.  As in Lightcuts, it is each node's error that
+// is held below a visible fraction of the total, not their sum, which
+// is what lets the cut grow far slower than the number of lights.
+//
+// The bound follows from the shader's attenuation, 10 * max(0, 1 / d^2
+// - 1 / range^2): max(0, x) moves no more than x does, so a light and
+// its node's virtual light, both within the node's bounding sphere,
+// differ anywhere in the box by at most 10 * |1 / d^2 - 1 / d'^2|,
+// largest where the box is nearest, plus 10 * |1 / range^2 - 1 /
+// virtual range^2|, whose intensity weighted sum over the node
+// Cauchy-Schwarz bounds from two running sums.  The shading terms are
+// taken at the virtual light, as Lightcuts does.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+
+namespace Emulator {
+    class LightBVH {
+    public:
+        static constexpr uint32_t LeafSize = 4;
+
+        // Six planes, with points inside where dot(plane.xyz, p) + plane.w
+        // >= 0: left, right, bottom, top, near, far.
+        struct Frustum {
+            enum Plane { Left, Right, Bottom, Top, Near, Far, Count };
+            DirectX::SimpleMath::Vector4 planes[Count];
+        };
+
+        struct Node {
+            DirectX::SimpleMath::Vector3 min;
+            uint32_t first; // Left child, the right following it, or for a leaf its first entry of m_order
+            DirectX::SimpleMath::Vector3 max;
+            uint32_t count; // Lights of a leaf, 0 for an inner node
+        };
+
+        // A node's lights taken together: the sum of their colors at their
+        // centroid weighted by intensity, the box of their positions, the
+        // span of their ranges, and intensity weighted sums of 1 / range^2
+        // and its square, for the range a virtual light should have and
+        // how far the lights stray from it.
+        struct Aggregate {
+            DirectX::SimpleMath::Vector3 position;
+            float weight;       // Sum of the lights' intensities
+            DirectX::SimpleMath::Vector3 color;
+            float minRange;
+            DirectX::SimpleMath::Vector3 positionMin;
+            float maxRange;
+            DirectX::SimpleMath::Vector3 positionMax;
+            float falloff;
+            float falloffSquared;
+        };
+
+        std::vector<Node> m_nodes;      // Root first
+        std::vector<Aggregate> m_aggregates; // Per node
+        std::vector<uint32_t> m_order;  // Light indices, leaf by leaf
+
+        void Build(const std::vector<ShaderData::Light>& _lights);
+        void Refit(const std::vector<ShaderData::Light>& _lights);
+
+        // A light's intensity: its brightest channel.
+        static float Intensity(const ShaderData::Light& _light);
+
+        // The light that stands in for node _node's: their summed color at
+        // their centroid, with the range that matches their falloff on
+        // average.  Not shadowed.
+        ShaderData::Light VirtualLight(uint32_t _node) const;
+
+        // The cut for the box _min, _max, in the space the rigid _toBox
+        // takes world space to.  _out is replaced by the indices of the
+        // lights to use, with node n's virtual light as _lights.size() +
+        // n, in increasing order.  _lights must be those Build or Refit
+        // last saw.
+        void Cut(
+            const std::vector<ShaderData::Light>& _lights, const DirectX::SimpleMath::Matrix& _toBox,
+            const DirectX::SimpleMath::Vector3& _min, const DirectX::SimpleMath::Vector3& _max,
+            float _maxError, float _minError, std::vector<uint32_t>& _out
+        ) const;
+
+        // Whether Build has seen this many lights; if not, Refit won't do.
+        bool Fits(const std::vector<ShaderData::Light>& _lights) const { return m_order.size() == _lights.size(); }
+
+        // Lights whose sphere reaches the box _min, _max, or _frustum.
+        // _out is replaced.
+        void Query(
+            const std::vector<ShaderData::Light>& _lights,
+            const DirectX::SimpleMath::Vector3& _min, const DirectX::SimpleMath::Vector3& _max,
+            std::vector<uint32_t>& _out
+        ) const;
+        void Query(const std::vector<ShaderData::Light>& _lights, const Frustum& _frustum, std::vector<uint32_t>& _out) const;
+
+        // Batches of the above, _out[i] for box or frustum i.
+        void Query(
+            const std::vector<ShaderData::Light>& _lights,
+            const std::vector<std::pair<DirectX::SimpleMath::Vector3, DirectX::SimpleMath::Vector3>>& _boxes,
+            std::vector<std::vector<uint32_t>>& _out
+        ) const;
+        void Query(
+            const std::vector<ShaderData::Light>& _lights, const std::vector<Frustum>& _frustums,
+            std::vector<std::vector<uint32_t>>& _out
+        ) const;
+
+        // The frustum of _viewProj (WorldView * WorldProj, standard
+        // depth), and of the screen tile of pixels [_x0, _x1) x [_y0,
+        // _y1) in a _width by _height view through it.
+        static Frustum FrustumOf(const DirectX::SimpleMath::Matrix& _viewProj);
+        static Frustum TileFrustum(
+            const DirectX::SimpleMath::Matrix& _viewProj,
+            int _x0, int _y0, int _x1, int _y1, int _width, int _height
+        );
+
+    private:
+        template <typename Overlaps, typename Touches>
+        void Traverse(Overlaps _overlaps, Touches _touches, std::vector<uint32_t>& _out) const;
+    };
+}
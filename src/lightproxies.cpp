@@ -0,0 +1,79 @@
+////////////////////////////////////////////////////////////////////////
+// Light proxy visibility; see lightproxies.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "lightproxies.h"
+#include <algorithm>
+#include <bit>
+
+using namespace DirectX::SimpleMath;
+
+void Emulator::LightProxies::Cull(const std::vector<ShaderData::Light>& _lights, const Matrix& _viewProj, float _radius) {
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+
+    const uint32_t count = static_cast<uint32_t>(_lights.size());
+    m_x.resize(count);
+    m_y.resize(count);
+    m_z.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        m_x[i] = _lights[i].lightPos.x;
+        m_y[i] = _lights[i].lightPos.y;
+        m_z[i] = _lights[i].lightPos.z;
+    }
+
+    m_visible.clear();
+    m_positions.clear();
+    const LightBVH::Frustum frustum = LightBVH::FrustumOf(_viewProj);
+    if (m_level == Simd::Level::AVX2)
+        CullAVX2(frustum, _radius, count);
+    else
+        CullScalar(frustum, _radius, 0, count);
+}
+
+// Lights _begin to _end.  The planes are normalized, so a sphere is
+// outside one when its center is more than its radius behind it.
+void Emulator::LightProxies::CullScalar(const LightBVH::Frustum& _frustum, float _radius, uint32_t _begin, uint32_t _end) {
+    for (uint32_t i = _begin; i < _end; i++) {
+        bool inside = true;
+        for (const Vector4& plane : _frustum.planes)
+            inside = inside && plane.x * m_x[i] + plane.y * m_y[i] + plane.z * m_z[i] + plane.w >= -_radius;
+        if (inside) {
+            m_visible.push_back(i);
+            m_positions.push_back(Vector4(m_x[i], m_y[i], m_z[i], 1));
+        }
+    }
+}
+
+// Eight lights per iteration, the rest one at a time.
+SIMD_TARGET_AVX2 void Emulator::LightProxies::CullAVX2(const LightBVH::Frustum& _frustum, float _radius, uint32_t _count) {
+#if SIMD_X86
+    __m256 a[LightBVH::Frustum::Count], b[LightBVH::Frustum::Count], c[LightBVH::Frustum::Count], d[LightBVH::Frustum::Count];
+    for (int p = 0; p < LightBVH::Frustum::Count; p++) {
+        a[p] = _mm256_set1_ps(_frustum.planes[p].x);
+        b[p] = _mm256_set1_ps(_frustum.planes[p].y);
+        c[p] = _mm256_set1_ps(_frustum.planes[p].z);
+        d[p] = _mm256_set1_ps(_frustum.planes[p].w + _radius);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i + 8 <= _count; i += 8) {
+        const __m256 x = _mm256_load_ps(&m_x[i]), y = _mm256_load_ps(&m_y[i]), z = _mm256_load_ps(&m_z[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < LightBVH::Frustum::Count; p++) {
+            __m256 distance = _mm256_fmadd_ps(a[p], x, _mm256_fmadd_ps(b[p], y, _mm256_fmadd_ps(c[p], z, d[p])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        }
+        for (uint32_t bits = _mm256_movemask_ps(inside); bits; bits &= bits - 1) {
+            const uint32_t light = i + std::countr_zero(bits);
+            m_visible.push_back(light);
+            m_positions.push_back(Vector4(m_x[light], m_y[light], m_z[light], 1));
+        }
+    }
+    _mm256_zeroupper();
+    CullScalar(_frustum, _radius, i, _count);
+#else
+    CullScalar(_frustum, _radius, 0, _count);
+#endif
+}
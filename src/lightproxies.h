@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////
+// Visibility of the small spheres the geometry pass draws at every
+// light, found for all lights at once.
+//
+// Each frame the light positions are copied into separate x, y and z
+// arrays, and tested as spheres of the proxy's radius against the six
+// planes of the view frustum, eight lights at a time with AVX2.  The
+// visible lights' indices and positions come out in light order, the
+// positions ready to upload as the per-instance data of one instanced
+// draw of the proxy shape.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+#include "lightbvh.h"
+#include "simd.h"
+
+namespace Emulator {
+    class LightProxies {
+    public:
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        std::vector<uint32_t> m_visible;                        // Indices of the visible lights
+        std::vector<DirectX::SimpleMath::Vector4> m_positions;  // Their positions, w = 1
+
+        // Finds the lights whose proxy, a sphere of _radius about
+        // lightPos, reaches the frustum of _viewProj.
+        void Cull(const std::vector<ShaderData::Light>& _lights, const DirectX::SimpleMath::Matrix& _viewProj, float _radius);
+
+    private:
+        void CullScalar(const LightBVH::Frustum& _frustum, float _radius, uint32_t _begin, uint32_t _end);
+        void CullAVX2(const LightBVH::Frustum& _frustum, float _radius, uint32_t _count);
+
+        Simd::AlignedVector<float> m_x, m_y, m_z;
+        Simd::Level m_level = Simd::Level::Scalar;
+    };
+}
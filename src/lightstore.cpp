@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////
+// The lighting pass's light buffers; see lightstore.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "lightstore.h"
+#include <algorithm>
+#include <cstring>
+
+static ShaderData::LightData Hot(const ShaderData::Light& _light, int _shadow) {
+    return {
+        .lightPos = _light.lightPos,
+        .range = _light.range,
+        .lightColor = _light.lightColor,
+        .shadow = _shadow,
+    };
+}
+
+static ShaderData::ShadowData Cold(const ShaderData::Light& _light) {
+    return {
+        .ShadowView = _light.ShadowView,
+        .ShadowProj = _light.ShadowProj,
+        .ShadowMin = _light.ShadowMin,
+        .ShadowMax = _light.ShadowMax,
+    };
+}
+
+void Emulator::LightStore::Update(const std::vector<ShaderData::Light>& _lights, uint32_t _copies) {
+    const uint64_t shadowed = std::count_if(
+        _lights.begin(), _lights.end(), [](const ShaderData::Light& _light) { return _light.useShadows != 0; }
+    );
+    bool relayout = _lights.size() != m_hot.size() || shadowed != m_cold.size() || _copies != m_hotQueue.size();
+    for (size_t i = 0; i < _lights.size() && !relayout; i++)
+        relayout = (_lights[i].useShadows != 0) != (m_hot[i].shadow >= 0);
+    m_statistics.fullBytes = _lights.size() * sizeof(ShaderData::Light);
+
+    if (relayout) {
+        m_hot.resize(_lights.size());
+        m_cold.resize(shadowed);
+        int shadow = 0;
+        for (size_t i = 0; i < _lights.size(); i++) {
+            m_hot[i] = Hot(_lights[i], _lights[i].useShadows ? shadow : -1);
+            if (_lights[i].useShadows)
+                m_cold[shadow++] = Cold(_lights[i]);
+        }
+        m_hotQueue.assign(_copies, { { 0, static_cast<uint32_t>(m_hot.size()) } });
+        m_coldQueue.assign(_copies, { { 0, static_cast<uint32_t>(m_cold.size()) } });
+        return;
+    }
+
+    // Whole structs are compared, padding included, so the packings
+    // above must leave it zeroed
+    for (uint32_t i = 0; i < _lights.size(); i++) {
+        const ShaderData::LightData hot = Hot(_lights[i], m_hot[i].shadow);
+        if (std::memcmp(&hot, &m_hot[i], sizeof(hot))) {
+            m_hot[i] = hot;
+            for (std::vector<Range>& queue : m_hotQueue)
+                Queue(queue, i, i + 1);
+        }
+        if (hot.shadow < 0)
+            continue;
+        const ShaderData::ShadowData cold = Cold(_lights[i]);
+        if (std::memcmp(&cold, &m_cold[hot.shadow], sizeof(cold))) {
+            m_cold[hot.shadow] = cold;
+            for (std::vector<Range>& queue : m_coldQueue)
+                Queue(queue, hot.shadow, hot.shadow + 1);
+        }
+    }
+}
+
+// Extends the last range when _begin continues it, so a run of changed
+// lights is one copy.  A queue that grows past MaxRanges is merged
+// down, and if that isn't enough, to one range over all of it.
+void Emulator::LightStore::Queue(std::vector<Range>& _ranges, uint32_t _begin, uint32_t _end) {
+    if (!_ranges.empty() && _ranges.back().begin <= _begin && _begin <= _ranges.back().end) {
+        _ranges.back().end = std::max(_ranges.back().end, _end);
+        return;
+    }
+    _ranges.push_back({ _begin, _end });
+    if (_ranges.size() <= MaxRanges)
+        return;
+    Merge(_ranges);
+    if (_ranges.size() > MaxRanges / 2)
+        _ranges = { { _ranges.front().begin, _ranges.back().end } };
+}
+
+// Sorts the ranges and joins those that overlap or touch.
+void Emulator::LightStore::Merge(std::vector<Range>& _ranges) {
+    std::sort(_ranges.begin(), _ranges.end(), [](const Range& _a, const Range& _b) { return _a.begin < _b.begin; });
+    size_t kept = 0;
+    for (size_t i = 1; i < _ranges.size(); i++) {
+        if (_ranges[i].begin <= _ranges[kept].end)
+            _ranges[kept].end = std::max(_ranges[kept].end, _ranges[i].end);
+        else
+            _ranges[++kept] = _ranges[i];
+    }
+    _ranges.resize(_ranges.empty() ? 0 : kept + 1);
+}
+
+template <typename T>
+uint64_t Emulator::LightStore::Write(std::vector<Range>& _ranges, const std::vector<T>& _source, void* _destination) {
+    Merge(_ranges);
+    uint64_t bytes = 0;
+    for (const Range& range : _ranges) {
+        if (range.end == range.begin)
+            continue;
+        const size_t size = (range.end - range.begin) * sizeof(T);
+        std::memcpy(static_cast<T*>(_destination) + range.begin, _source.data() + range.begin, size);
+        bytes += size;
+    }
+    _ranges.clear();
+    return bytes;
+}
+
+void Emulator::LightStore::Flush(uint32_t _copy, void* _hot, void* _cold) {
+    m_statistics.bytes = Write(m_hotQueue[_copy], m_hot, _hot) + Write(m_coldQueue[_copy], m_cold, _cold);
+}
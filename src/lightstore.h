@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////
+// The lights as the lighting pass reads them, split by how often they
+// are needed: a small LightData for every light, and the ShadowData
+// matrices only for lights that cast shadows, which LightData indexes.
+//
+// The GPU copies live in persistent buffers, one set per frame in
+// flight.  Update repacks the lights and compares them with the last
+// packing, and every light that changed is queued, as a range of
+// entries, for each copy.  Flush then writes only a copy's queued
+// ranges.  A change of light count or of which lights cast shadows
+// moves entries around, so then everything is queued; a copy whose
+// size no longer matches m_hot and m_cold must be reallocated first.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+
+namespace Emulator {
+    class LightStore {
+    public:
+        // Queued ranges per copy before they are merged into one
+        static constexpr size_t MaxRanges = 64;
+
+        struct Statistics {
+            uint64_t bytes = 0;     // Written by the last Flush
+            uint64_t fullBytes = 0; // An upload of the whole Light array
+        };
+
+        std::vector<ShaderData::LightData> m_hot;
+        std::vector<ShaderData::ShadowData> m_cold;
+        Statistics m_statistics;
+
+        // Packs _lights, and queues what changed for each of _copies copies.
+        void Update(const std::vector<ShaderData::Light>& _lights, uint32_t _copies);
+
+        // Writes copy _copy's queued ranges to _hot and _cold, which hold
+        // m_hot.size() and m_cold.size() entries, and clears its queue.
+        void Flush(uint32_t _copy, void* _hot, void* _cold);
+
+    private:
+        struct Range {
+            uint32_t begin, end;
+        };
+
+        static void Queue(std::vector<Range>& _ranges, uint32_t _begin, uint32_t _end);
+        static void Merge(std::vector<Range>& _ranges);
+        template <typename T>
+        uint64_t Write(std::vector<Range>& _ranges, const std::vector<T>& _source, void* _destination);
+
+        std::vector<std::vector<Range>> m_hotQueue, m_coldQueue; // Per copy
+    };
+}
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////
+// Moment shadow map generation on the CPU; see moments.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "moments.h"
+#include "emulator.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+using Target = Emulator::GBuffer::Target;
+
+// The rows of the float4x4 in GetOptimizedMoments, and the bias it
+// adds to the first moment
+static const float OptimizeMatrix[4][4] = {
+    { -2.07224649f,    13.7948857237f,  0.105877704f,   9.7924062118f },
+    { 32.23703778f,   -59.4683975703f, -1.9077466311f, -33.7652110555f },
+    { -68.571074599f,  82.0359750338f,  9.3496555107f,  47.9456096605f },
+    { 39.3703274134f, -35.364903257f,  -6.6543490743f, -23.9728048165f },
+};
+static const float OptimizeBias = 0.035955884801f;
+
+static const float UnormScale = 65535.0f;
+
+// A float written to a UNORM16 target
+static uint16_t ToUnorm(float _value) {
+    return static_cast<uint16_t>(std::nearbyint(std::clamp(_value, 0.0f, 1.0f) * UnormScale));
+}
+
+void Emulator::MomentShadowMap::Resize(int _width, int _height) {
+    m_width = _width;
+    m_height = _height;
+    m_moments.resize(static_cast<size_t>(m_width) * m_height * Channels);
+}
+
+float Emulator::MomentShadowMap::RelativeDepth(float _w, const ShaderData::Light& _light) {
+    return (_w - _light.ShadowMin) / (_light.ShadowMax - _light.ShadowMin);
+}
+
+Vector4 Emulator::MomentShadowMap::OptimizedMoments(float _depth) {
+    float square = _depth * _depth;
+    float moments[4] = { _depth, square, square * _depth, square * square };
+    float optimized[4];
+    for (int j = 0; j < 4; j++)
+        optimized[j] = moments[0] * OptimizeMatrix[0][j] + moments[1] * OptimizeMatrix[1][j]
+            + moments[2] * OptimizeMatrix[2][j] + moments[3] * OptimizeMatrix[3][j];
+    optimized[0] += OptimizeBias;
+    return Vector4(optimized[0], optimized[1], optimized[2], optimized[3]);
+}
+
+Vector4 Emulator::MomentShadowMap::Load(int _x, int _y) const {
+    const uint16_t* texel = &m_moments[(static_cast<size_t>(_y) * m_width + _x) * Channels];
+    return Vector4(texel[0], texel[1], texel[2], texel[3]) * (1.0f / UnormScale);
+}
+
+void Emulator::MomentShadowMap::Generate(const float* _depth) {
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+    ThreadPool::Get().ParallelFor(m_height, [&](uint32_t _y) {
+        GenerateRow(_depth + static_cast<size_t>(_y) * m_width, _y);
+    });
+}
+
+void Emulator::MomentShadowMap::Generate(const Rasterizer& _rasterizer, const ShaderData::Light& _light) {
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+    Resize(_rasterizer.m_width, _rasterizer.m_height);
+
+    // Pixels the rasterizer never wrote still hold the clear depth
+    const float clearDepth = _rasterizer.m_reverseZ ? 0.0f : 1.0f;
+    ThreadPool::Get().ParallelFor(m_height, [&](uint32_t _y) {
+        thread_local std::vector<float> depth;
+        depth.resize(m_width);
+        const float* w = _rasterizer.m_gbuffer.Row(Target::WorldPosition, 3, _y);
+        const float* device = &_rasterizer.m_depth[static_cast<size_t>(_y) * m_width];
+        for (int x = 0; x < m_width; x++)
+            depth[x] = device[x] == clearDepth ? 1.0f : RelativeDepth(w[x], _light);
+        GenerateRow(depth.data(), _y);
+    });
+}
+
+void Emulator::MomentShadowMap::GenerateRow(const float* _depth, int _y) {
+    if (m_level == Simd::Level::AVX2)
+        GenerateRowAVX2(_depth, _y);
+    else
+        GenerateRowScalar(_depth, _y);
+}
+
+// The shadow target holds the depth as UNORM16, so the copy pass sees
+// it already rounded.  Texels from _x0 to the end of the row.
+void Emulator::MomentShadowMap::GenerateRowScalar(const float* _depth, int _y, int _x0) {
+    uint16_t* out = &m_moments[static_cast<size_t>(_y) * m_width * Channels];
+    for (int x = _x0; x < m_width; x++) {
+        float depth = ToUnorm(_depth[x]) * (1.0f / UnormScale);
+        Vector4 optimized = OptimizedMoments(depth);
+        out[x * Channels + 0] = ToUnorm(optimized.x);
+        out[x * Channels + 1] = ToUnorm(optimized.y);
+        out[x * Channels + 2] = ToUnorm(optimized.z);
+        out[x * Channels + 3] = ToUnorm(optimized.w);
+    }
+}
+
+#if SIMD_X86
+// ToUnorm for eight values, left as 32 bit integers
+SIMD_TARGET_AVX2 static __m256i ToUnormAVX2(__m256 _value) {
+    __m256 clamped = _mm256_min_ps(_mm256_max_ps(_value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    return _mm256_cvtps_epi32(_mm256_mul_ps(clamped, _mm256_set1_ps(UnormScale)));
+}
+#endif
+
+// Eight texels per iteration.  Multiplies and adds are kept separate,
+// in the scalar order, so both paths round the same way as long as the
+// compiler doesn't fuse them, which CMakeLists.txt turns off for GCC and
+// Clang.
+SIMD_TARGET_AVX2 void Emulator::MomentShadowMap::GenerateRowAVX2(const float* _depth, int _y) {
+#if SIMD_X86
+    uint16_t* out = &m_moments[static_cast<size_t>(_y) * m_width * Channels];
+    const __m256 invScale = _mm256_set1_ps(1.0f / UnormScale);
+
+    int x = 0;
+    for (; x + 8 <= m_width; x += 8) {
+        __m256 depth = _mm256_mul_ps(_mm256_cvtepi32_ps(ToUnormAVX2(_mm256_loadu_ps(_depth + x))), invScale);
+        __m256 square = _mm256_mul_ps(depth, depth);
+        __m256 moments[4] = { depth, square, _mm256_mul_ps(square, depth), _mm256_mul_ps(square, square) };
+
+        __m256i texels[4];
+        for (int j = 0; j < 4; j++) {
+            __m256 sum = _mm256_mul_ps(moments[0], _mm256_set1_ps(OptimizeMatrix[0][j]));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(moments[1], _mm256_set1_ps(OptimizeMatrix[1][j])));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(moments[2], _mm256_set1_ps(OptimizeMatrix[2][j])));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(moments[3], _mm256_set1_ps(OptimizeMatrix[3][j])));
+            if (j == 0)
+                sum = _mm256_add_ps(sum, _mm256_set1_ps(OptimizeBias));
+            texels[j] = ToUnormAVX2(sum);
+        }
+
+        // Channel planes to RGBA texels.  The packs work within 128 bit
+        // halves, so texels 0-3 end up in the low halves and 4-7 in the
+        // high halves.
+        __m256i rg = _mm256_packus_epi32(texels[0], texels[1]);   // r0-3 g0-3 | r4-7 g4-7
+        __m256i ba = _mm256_packus_epi32(texels[2], texels[3]);   // b0-3 a0-3 | b4-7 a4-7
+        __m256i rbrb = _mm256_unpacklo_epi16(rg, ba);             // r0 b0 .. r3 b3 | r4 b4 ..
+        __m256i gaga = _mm256_unpackhi_epi16(rg, ba);             // g0 a0 .. g3 a3 | g4 a4 ..
+        __m256i t01 = _mm256_unpacklo_epi16(rbrb, gaga);          // texels 0 1 | 4 5
+        __m256i t23 = _mm256_unpackhi_epi16(rbrb, gaga);          // texels 2 3 | 6 7
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * Channels), _mm256_permute2x128_si256(t01, t23, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (x + 4) * Channels), _mm256_permute2x128_si256(t01, t23, 0x31));
+    }
+    if (x < m_width)
+        GenerateRowScalar(_depth, _y, x);
+#else
+    GenerateRowScalar(_depth, _y);
+#endif
+}
@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of the moment shadow map passes: shadowVert.hlsl's
+// PSmain depth, followed by DepthCopyShader.hlsl's GetOptimizedMoments.
+//
+// Depth comes either from an array of relative depths, as in the r
+// channel of the shadow render target, or from an emulated draw of the
+// scene from the light.  Each is rounded to 16 bit unorm like the
+// render target, turned into the four optimized 4MSM moments, and
+// stored as 16 bit unorm texels like m_blurMap.  Rows are converted in
+// parallel, eight texels at a time with AVX2.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "../ShaderData.h"
+#include "simd.h"
+
+namespace Emulator {
+    class Rasterizer;
+
+    class MomentShadowMap {
+    public:
+        static constexpr int Channels = 4;
+
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        int m_width = 0, m_height = 0;
+
+        // R16G16B16A16_UNORM texels, row major, top row first
+        std::vector<uint16_t> m_moments;
+
+        void Resize(int _width, int _height);
+
+        // PSmain's depth of a fragment at light clip space _w, relative
+        // to the light's ShadowMin and ShadowMax.
+        static float RelativeDepth(float _w, const ShaderData::Light& _light);
+
+        // GetOptimizedMoments, unquantized.
+        static DirectX::SimpleMath::Vector4 OptimizedMoments(float _depth);
+
+        // _depth holds m_width * m_height relative depths, row major.
+        void Generate(const float* _depth);
+
+        // From a rasterizer that drew the scene with _light's ShadowView
+        // and ShadowProj as its WorldView and WorldProj, and has the same
+        // size as the map.  Uncovered pixels are at relative depth 1.
+        void Generate(const Rasterizer& _rasterizer, const ShaderData::Light& _light);
+
+        // A texel's moments, converted back to floats.
+        DirectX::SimpleMath::Vector4 Load(int _x, int _y) const;
+
+    private:
+        void GenerateRowScalar(const float* _depth, int _y, int _x0 = 0);
+        void GenerateRowAVX2(const float* _depth, int _y);
+        void GenerateRow(const float* _depth, int _y);
+
+        Simd::Level m_level = Simd::Level::Scalar;
+    };
+}
@@ -8,8 +8,12 @@
 //
 // Methods consist of a constructor, and a Draw procedure, and an
 // append for building hierarchies of objects.
+//
+// Draw and DrawInstanced are in objectdraw.cpp, so that this file
+// needs no device and builds into the headless program.
 
 #include "math.h"
+#include <cfloat>
 #include <fstream>
 #include <stdlib.h>
 
@@ -32,37 +36,33 @@
 //            exit(-1);                                                                                     \
 //        }                                                                                                 \
 //    }
-#include "framework.h"
-#include "shapes.h"
+#include "object.h"
+#include "emulator.h"
+#include "occlusion.h"
 
 #include "../ShaderData.h"
-#include <directxtk12/GraphicsMemory.h>
 
 Object::Object(
     std::shared_ptr<DirectX::GeometricPrimitive> _shape,
     const int _objectId,
     const DirectX::SimpleMath::Vector3 _diffuseColor, 
     const DirectX::SimpleMath::Vector3 _specularColor, 
-    const float _roughness
+    const float _roughness,
+    std::shared_ptr<Emulator::Mesh> _mesh
 )
     : m_diffuseColor(_diffuseColor)
     , m_specularColor(_specularColor)
     , m_roughness(_roughness)
     , m_shape(_shape)
+    , m_mesh(_mesh)
     , m_objectId(_objectId)
     , m_drawMe(true)
 
 {
 }
 
-void Object::Draw(
-    CommandList& _cmd, 
-    std::unique_ptr<ShaderProgram>& _program,
-    std::unique_ptr<DirectX::DescriptorPile>& _heap,
-    const DirectX::SimpleMath::Matrix& _objectTr
-)
+ShaderData::Object Object::ObjectData(const DirectX::SimpleMath::Matrix& _objectTr) const
 {
-    using namespace DirectX::SimpleMath;
     ShaderData::Object objectData{};
     objectData.diffuse   = m_diffuseColor;
     objectData.specular  = m_specularColor;
@@ -73,26 +73,75 @@ void Object::Draw(
     objectData.NormalTr = objectData.NormalTr.Invert();
     objectData.NormalTr = objectData.NormalTr.Transpose();
 
-    if (m_texture) {
-        objectData.Textured = true;
-        m_texture.BindTexture(_cmd, _heap, 3);
+    objectData.Textured = m_texture || m_image;
+    return objectData;
+}
+
+void Object::Emulate(
+    Emulator::Rasterizer& _emulator,
+    const DirectX::SimpleMath::Matrix& _objectTr,
+    Emulator::OcclusionBuffer* _occlusion
+)
+{
+    using namespace DirectX::SimpleMath;
+    if (!m_drawMe)
+        return;
+    if (_occlusion && m_bounded && !_occlusion->IsVisible(m_boundsMin, m_boundsMax, _objectTr))
+        return;
+
+    if (m_mesh)
+        _emulator.Submit(*m_mesh, ObjectData(_objectTr), m_image.get());
+
+    for (int i = 0; i < m_instances.size(); i++) {
+        Matrix itr = m_animTr * m_instances[i].second * _objectTr;
+        m_instances[i].first->Emulate(_emulator, itr, _occlusion);
+    }
+}
+
+void Object::Occlude(Emulator::OcclusionBuffer& _occlusion, const DirectX::SimpleMath::Matrix& _objectTr)
+{
+    using namespace DirectX::SimpleMath;
+    if (!m_drawMe)
+        return;
+
+    if (m_occluder && m_mesh)
+        _occlusion.Rasterize(*m_mesh, _objectTr);
+
+    for (int i = 0; i < m_instances.size(); i++) {
+        Matrix itr = m_animTr * m_instances[i].second * _objectTr;
+        m_instances[i].first->Occlude(_occlusion, itr);
     }
-    else {
-        objectData.Textured = false;
+}
+
+void Object::UpdateBounds()
+{
+    using namespace DirectX::SimpleMath;
+    m_bounded = !m_shape || m_mesh;
+    m_boundsMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+    m_boundsMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    if (m_mesh) {
+        m_boundsMin = m_mesh->m_minP;
+        m_boundsMax = m_mesh->m_maxP;
     }
 
-    auto& graphicsMemory = DirectX::GraphicsMemory::Get();
-    auto objectMemory    = graphicsMemory.AllocateConstant(objectData);
-    _cmd->SetGraphicsRootConstantBufferView(2, objectMemory.GpuAddress());
-    // Draw this object
-    if (m_shape)
-        if (m_drawMe)
-            m_shape->Draw(*_cmd);
-
-    // Recursively draw each sub-objects, each with its own transformation.
-    if (m_drawMe)
-        for (int i = 0; i < m_instances.size(); i++) {
-            Matrix itr = m_animTr * m_instances[i].second  * _objectTr;
-            m_instances[i].first->Draw(_cmd, _program, _heap, itr);
+    // Children's boxes are carried into this object's space through
+    // their corners
+    for (auto& instance : m_instances) {
+        Object& child = *instance.first;
+        child.UpdateBounds();
+        m_bounded = m_bounded && child.m_bounded;
+        if (child.m_boundsMin.x > child.m_boundsMax.x)
+            continue;
+        Matrix tr = m_animTr * instance.second;
+        for (int i = 0; i < 8; i++) {
+            Vector3 corner(
+                i & 1 ? child.m_boundsMax.x : child.m_boundsMin.x,
+                i & 2 ? child.m_boundsMax.y : child.m_boundsMin.y,
+                i & 4 ? child.m_boundsMax.z : child.m_boundsMin.z
+            );
+            corner = Vector3::Transform(corner, tr);
+            m_boundsMin = Vector3::Min(m_boundsMin, corner);
+            m_boundsMax = Vector3::Max(m_boundsMax, corner);
         }
+    }
 }
@@ -14,24 +14,37 @@
 
 #include <directxtk12/SimpleMath.h>
 #include <directxtk12/GeometricPrimitive.h>
-#include <directxtk12/BufferHelpers.h>
-#include "texture.h"
+#include <directxtk12/DescriptorHeap.h>
+#include "image.h"
 
+#include <memory>
 #include <utility> // for pair<Object*,Matrix>
+#include <vector>
 
 class ShaderProgram;
+class Texture;
 class Object;
 struct CommandList;
+namespace ShaderData { struct Object; }
+namespace Emulator { class Mesh; class OcclusionBuffer; class Rasterizer; }
 
 typedef std::pair<std::shared_ptr<Object>, DirectX::SimpleMath::Matrix> INSTANCE;
 
 // Object:: A shape, and its transformations, colors, and textures and sub-objects.
 class Object {
 public:
-    std::shared_ptr<DirectX::GeometricPrimitive> m_shape; // Polygons
+    std::shared_ptr<DirectX::GeometricPrimitive> m_shape; // Polygons on the GPU, if there is a device
+    std::shared_ptr<Emulator::Mesh> m_mesh; // CPU copy of m_shape's polygons, for Emulate
     DirectX::SimpleMath::Matrix m_animTr; // This model's animation transformation
     int m_objectId; // Object id to be sent to the shader
     bool m_drawMe; // Toggle specifies if this object (and children) are drawn.
+    bool m_occluder = false; // Rasterized into the occlusion buffer by Occlude
+
+    // Bounds of this object and its children, in the space _objectTr
+    // maps from.  Set by UpdateBounds; an object whose shape has no
+    // m_mesh can't be bounded and is never culled.
+    DirectX::SimpleMath::Vector3 m_boundsMin, m_boundsMax;
+    bool m_bounded = false;
 
     DirectX::SimpleMath::Vector3 m_diffuseColor; // Diffuse color of object
     DirectX::SimpleMath::Vector3 m_specularColor; // Specular color of object
@@ -39,13 +52,15 @@ public:
 
     std::vector<INSTANCE> m_instances; // Pairs of sub-objects and transformations
 
-    Texture m_texture;
+    std::shared_ptr<Texture> m_texture; // On the GPU, if there is a device
+    std::shared_ptr<Image> m_image;     // CPU copy of m_texture's texels, for Emulate
 
     Object(
         std::shared_ptr<DirectX::GeometricPrimitive> _shape, const int objectId,
         const DirectX::SimpleMath::Vector3 _d = DirectX::SimpleMath::Vector3(),
         const DirectX::SimpleMath::Vector3 _s = DirectX::SimpleMath::Vector3(),
-        const float _roughness = 0.5f
+        const float _roughness = 0.5f,
+        std::shared_ptr<Emulator::Mesh> _mesh = nullptr
     );
 
     // If this object is to be drawn with a texture, this is a good
@@ -53,13 +68,37 @@ public:
     // texture id should be set in Scene::InitializeScene and used in
     // Object::Draw.
 
+    // With _occlusion, objects whose bounds it rejects are skipped along
+    // with their children.
     void Draw(
         CommandList& _cmd,
         std::unique_ptr<ShaderProgram>& _program,
         std::unique_ptr<DirectX::DescriptorPile>& _heap,
-        const DirectX::SimpleMath::Matrix& _objectTr
+        const DirectX::SimpleMath::Matrix& _objectTr,
+        Emulator::OcclusionBuffer* _occlusion = nullptr
+    );
+
+    // The same traversal as Draw, but submits to the software rasterizer.
+    void Emulate(
+        Emulator::Rasterizer& _emulator,
+        const DirectX::SimpleMath::Matrix& _objectTr,
+        Emulator::OcclusionBuffer* _occlusion = nullptr
     );
 
+    // Draws just this object's shape, _count times, with the current
+    // program's per-instance data; no children, no culling.
+    void DrawInstanced(CommandList& _cmd, std::unique_ptr<DirectX::DescriptorPile>& _heap, uint32_t _count);
+
+    // The same traversal again, rasterizing the occluders' meshes.
+    void Occlude(Emulator::OcclusionBuffer& _occlusion, const DirectX::SimpleMath::Matrix& _objectTr);
+
+    // Recomputes m_boundsMin, m_boundsMax and m_bounded for this object
+    // and its children; needed whenever an m_animTr changes.
+    void UpdateBounds();
+
+    // The per-draw shader constants for this object under _objectTr.
+    ShaderData::Object ObjectData(const DirectX::SimpleMath::Matrix& _objectTr) const;
+
     void add(std::shared_ptr<Object>& m, DirectX::SimpleMath::Matrix tr = DirectX::SimpleMath::Matrix::Identity) 
     { m_instances.push_back(std::make_pair(m, tr)); }
 };
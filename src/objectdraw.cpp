@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////
+// Object's D3D12 drawing: Draw and DrawInstanced submit m_shape to a
+// command list with the object's constants and texture.  Kept out of
+// object.cpp, which the headless program builds without a device.
+
+#include "framework.h"
+#include "object.h"
+#include "occlusion.h"
+#include "texture.h"
+
+#include "../ShaderData.h"
+#include <directxtk12/GeometricPrimitive.h>
+#include <directxtk12/GraphicsMemory.h>
+
+void Object::Draw(
+    CommandList& _cmd, 
+    std::unique_ptr<ShaderProgram>& _program,
+    std::unique_ptr<DirectX::DescriptorPile>& _heap,
+    const DirectX::SimpleMath::Matrix& _objectTr,
+    Emulator::OcclusionBuffer* _occlusion
+)
+{
+    using namespace DirectX::SimpleMath;
+    if (_occlusion && m_bounded && !_occlusion->IsVisible(m_boundsMin, m_boundsMax, _objectTr))
+        return;
+    ShaderData::Object objectData = ObjectData(_objectTr);
+    if (m_texture)
+        m_texture->BindTexture(_cmd, _heap, 3);
+
+    auto& graphicsMemory = DirectX::GraphicsMemory::Get();
+    auto objectMemory    = graphicsMemory.AllocateConstant(objectData);
+    _cmd->SetGraphicsRootConstantBufferView(2, objectMemory.GpuAddress());
+    // Draw this object
+    if (m_shape)
+        if (m_drawMe)
+            m_shape->Draw(*_cmd);
+
+    // Recursively draw each sub-objects, each with its own transformation.
+    if (m_drawMe)
+        for (int i = 0; i < m_instances.size(); i++) {
+            Matrix itr = m_animTr * m_instances[i].second  * _objectTr;
+            m_instances[i].first->Draw(_cmd, _program, _heap, itr, _occlusion);
+        }
+}
+
+void Object::DrawInstanced(CommandList& _cmd, std::unique_ptr<DirectX::DescriptorPile>& _heap, uint32_t _count)
+{
+    using namespace DirectX::SimpleMath;
+    if (!m_shape || !m_drawMe || !_count)
+        return;
+    if (m_texture)
+        m_texture->BindTexture(_cmd, _heap, 3);
+
+    auto objectMemory = DirectX::GraphicsMemory::Get().AllocateConstant(ObjectData(Matrix::Identity));
+    _cmd->SetGraphicsRootConstantBufferView(2, objectMemory.GpuAddress());
+    m_shape->DrawInstanced(*_cmd, _count, 0);
+}
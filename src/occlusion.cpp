@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////
+// A coarse depth buffer for occlusion culling the Object hierarchy.
+//
+// Each frame the scene's large occluders (Object::m_occluder) are
+// rasterized into it at low resolution, and every Object's bounding
+// box is tested against it before the object and its children are
+// drawn.  Occluders only write the pixels they cover completely, at
+// the farthest depth they reach anywhere in the pixel, and a box is
+// only rejected when every pixel it touches is nearer, so nothing that
+// shows past an occluder's silhouette is ever culled.
+////////////////////////////////////////////////////////////////////////
+
+#include "occlusion.h"
+#include "emulator.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+void Emulator::OcclusionBuffer::Begin(const Matrix& _viewProj) {
+    m_viewProj = _viewProj;
+    m_depth.assign(static_cast<size_t>(Width) * Height, 1.0f);
+    m_statistics = {};
+}
+
+void Emulator::OcclusionBuffer::Rasterize(const Mesh& _mesh, const Matrix& _modelTr) {
+    Matrix modelViewProj = _modelTr * m_viewProj;
+    m_screen.resize(_mesh.m_positions.size());
+    m_inFront.resize(_mesh.m_positions.size());
+    for (size_t i = 0; i < _mesh.m_positions.size(); i++) {
+        const Vector3& p = _mesh.m_positions[i];
+        Vector4 clip = Vector4::Transform(Vector4(p.x, p.y, p.z, 1), modelViewProj);
+        m_inFront[i] = clip.z >= 0;
+        float invW = 1.0f / clip.w;
+        m_screen[i] = Vector3(
+            (clip.x * invW * 0.5f + 0.5f) * Width,
+            (0.5f - clip.y * invW * 0.5f) * Height,
+            clip.z * invW
+        );
+    }
+
+    for (size_t t = 0; t + 2 < _mesh.m_indices.size(); t += 3) {
+        const uint32_t* index = &_mesh.m_indices[t];
+
+        // Triangles reaching past the near plane are left out, which
+        // only ever makes the buffer less occluding.
+        if (!m_inFront[index[0]] || !m_inFront[index[1]] || !m_inFront[index[2]])
+            continue;
+        const Vector3& v0 = m_screen[index[0]];
+        const Vector3& v1 = m_screen[index[1]];
+        const Vector3& v2 = m_screen[index[2]];
+
+        // Back faces of a closed occluder are hidden by its front faces
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (area <= 0)
+            continue;
+
+        // Pixel centers inside the bounding box, clamped before converting
+        // since vertices near the camera can land very far off screen
+        auto center = [](float _v, int _size) { return std::clamp(_v - 0.5f, -1.0f, float(_size)); };
+        int x0 = std::max(static_cast<int>(std::ceil(center(std::min({ v0.x, v1.x, v2.x }), Width))), 0);
+        int y0 = std::max(static_cast<int>(std::ceil(center(std::min({ v0.y, v1.y, v2.y }), Height))), 0);
+        int x1 = std::min(static_cast<int>(std::floor(center(std::max({ v0.x, v1.x, v2.x }), Width))), Width - 1);
+        int y1 = std::min(static_cast<int>(std::floor(center(std::max({ v0.y, v1.y, v2.y }), Height))), Height - 1);
+        if (x0 > x1 || y0 > y1)
+            continue;
+        m_statistics.occluderTriangles++;
+
+        // Edge functions, positive inside, moved in to the corner of the
+        // pixel farthest outside each edge, so a pixel center passes only
+        // when the whole pixel is inside.  Pixels that two triangles of
+        // an occluder share are left unwritten; those cracks only make
+        // the buffer less occluding.
+        const Vector3* vertices[3] = { &v0, &v1, &v2 };
+        float A[3], B[3], C[3];
+        for (int i = 0; i < 3; i++) {
+            const Vector3& a = *vertices[i];
+            const Vector3& b = *vertices[(i + 1) % 3];
+            A[i] = a.y - b.y;
+            B[i] = b.x - a.x;
+            C[i] = -(A[i] * a.x + B[i] * a.y) - 0.5f * (std::abs(A[i]) + std::abs(B[i]));
+        }
+
+        // Depth plane, raised to the farthest corner of each pixel
+        float invArea = 1.0f / area;
+        float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) * invArea;
+        float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) * invArea;
+        float zSlack = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+        float zMax = std::max({ v0.z, v1.z, v2.z });
+
+        for (int y = y0; y <= y1; y++) {
+            float* row = &m_depth[static_cast<size_t>(y) * Width];
+            float py = y + 0.5f;
+            for (int x = x0; x <= x1; x++) {
+                float px = x + 0.5f;
+                if (A[0] * px + B[0] * py + C[0] < 0 ||
+                    A[1] * px + B[1] * py + C[1] < 0 ||
+                    A[2] * px + B[2] * py + C[2] < 0)
+                    continue;
+                float z = std::min(v0.z + dzdx * (px - v0.x) + dzdy * (py - v0.y) + zSlack, zMax);
+                row[x] = std::min(row[x], z);
+            }
+        }
+    }
+}
+
+bool Emulator::OcclusionBuffer::IsVisible(const Vector3& _minP, const Vector3& _maxP, const Matrix& _modelTr) {
+    m_statistics.tested++;
+    Matrix modelViewProj = _modelTr * m_viewProj;
+
+    // Screen rectangle and nearest depth of the box's corners.  A box
+    // reaching past the near plane can't be bounded on screen, so it is
+    // always drawn.
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        Vector3 corner(i & 1 ? _maxP.x : _minP.x, i & 2 ? _maxP.y : _minP.y, i & 4 ? _maxP.z : _minP.z);
+        Vector4 clip = Vector4::Transform(Vector4(corner.x, corner.y, corner.z, 1), modelViewProj);
+        if (clip.z < 0)
+            return true;
+        float invW = 1.0f / clip.w;
+        float x = (clip.x * invW * 0.5f + 0.5f) * Width;
+        float y = (0.5f - clip.y * invW * 0.5f) * Height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clip.z * invW);
+    }
+
+    // Every pixel the rectangle overlaps
+    int x0 = static_cast<int>(std::floor(std::clamp(minX, 0.0f, float(Width))));
+    int y0 = static_cast<int>(std::floor(std::clamp(minY, 0.0f, float(Height))));
+    int x1 = static_cast<int>(std::ceil(std::clamp(maxX, 0.0f, float(Width))));
+    int y1 = static_cast<int>(std::ceil(std::clamp(maxY, 0.0f, float(Height))));
+    if (x0 < x1 && y0 < y1 && minZ <= 1) {
+        for (int y = y0; y < y1; y++) {
+            const float* row = &m_depth[static_cast<size_t>(y) * Width];
+            for (int x = x0; x < x1; x++)
+                if (row[x] >= minZ)
+                    return true;
+        }
+    }
+    m_statistics.culled++;
+    return false;
+}
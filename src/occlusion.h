@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////
+// A coarse depth buffer for occlusion culling the Object hierarchy.
+//
+// Each frame the scene's large occluders (Object::m_occluder) are
+// rasterized into it at low resolution, and every Object's bounding
+// box is tested against it before the object and its children are
+// drawn.  Occluders only write the pixels they cover completely, at
+// the farthest depth they reach anywhere in the pixel, and a box is
+// only rejected when every pixel it touches is nearer, so nothing that
+// shows past an occluder's silhouette is ever culled.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <vector>
+
+namespace Emulator {
+    class Mesh;
+
+    class OcclusionBuffer {
+    public:
+        static constexpr int Width = 256, Height = 128;
+
+        struct Statistics {
+            uint64_t occluderTriangles = 0; // Triangles written into the buffer
+            uint64_t tested = 0;            // Bounding boxes tested
+            uint64_t culled = 0;            // Bounding boxes found hidden or off screen
+        };
+
+        std::vector<float> m_depth; // Row major, farthest occluder depth per pixel, 1 where none
+        Statistics m_statistics;
+
+        // Clears the buffer for a frame seen through _viewProj, which
+        // must use standard depth (WorldView * WorldProj).
+        void Begin(const DirectX::SimpleMath::Matrix& _viewProj);
+
+        void Rasterize(const Mesh& _mesh, const DirectX::SimpleMath::Matrix& _modelTr);
+
+        // False when the box _minP, _maxP under _modelTr is certainly
+        // hidden behind the occluders or outside the view.
+        bool IsVisible(
+            const DirectX::SimpleMath::Vector3& _minP,
+            const DirectX::SimpleMath::Vector3& _maxP,
+            const DirectX::SimpleMath::Matrix& _modelTr
+        );
+
+    private:
+        DirectX::SimpleMath::Matrix m_viewProj;
+        std::vector<DirectX::SimpleMath::Vector3> m_screen; // Per vertex x, y, depth of the mesh being rasterized
+        std::vector<bool> m_inFront;                        // Per vertex, on the visible side of the near plane
+    };
+}
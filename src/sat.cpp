@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////
+// Summed-area tables of moment shadow maps; see sat.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "sat.h"
+#include "moments.h"
+#include "threadpool.h"
+#include <algorithm>
+
+using namespace DirectX::SimpleMath;
+
+static const double UnormScale = 65535.0;
+
+void Emulator::SummedAreaTable::Build(const MomentShadowMap& _map) {
+    m_scale = 1.0 / UnormScale;
+    Build(_map.m_width, _map.m_height, [&](int _y, double* _row) {
+        const uint16_t* texels = &_map.m_moments[static_cast<size_t>(_y) * _map.m_width * Channels];
+        for (int i = 0; i < _map.m_width * Channels; i++)
+            _row[i] = texels[i];
+    });
+}
+
+void Emulator::SummedAreaTable::Build(const Vector4* _texels, int _width, int _height) {
+    m_scale = 1;
+    Build(_width, _height, [&](int _y, double* _row) {
+        const Vector4* texels = _texels + static_cast<size_t>(_y) * _width;
+        for (int x = 0; x < _width; x++) {
+            _row[x * Channels + 0] = texels[x].x;
+            _row[x * Channels + 1] = texels[x].y;
+            _row[x * Channels + 2] = texels[x].z;
+            _row[x * Channels + 3] = texels[x].w;
+        }
+    });
+}
+
+void Emulator::SummedAreaTable::Build(int _width, int _height, const std::function<void(int, double*)>& _load) {
+    m_width = _width;
+    m_height = _height;
+    m_sums.assign(static_cast<size_t>(m_width + 1) * (m_height + 1) * Channels, 0.0);
+    if (m_width == 0 || m_height == 0)
+        return;
+
+    const size_t rowLength = static_cast<size_t>(m_width) * Channels;
+    const uint32_t blocks = (m_height + BlockRows - 1) / BlockRows;
+    auto firstRow = [](uint32_t _block) { return static_cast<int>(_block) * BlockRows + 1; };
+    auto lastRow = [&](uint32_t _block) { return std::min(firstRow(_block) + BlockRows - 1, m_height); };
+
+    // Each block of rows as a table of its own: every row is a prefix
+    // sum along x plus the row above it within the block.
+    ThreadPool::Get().ParallelFor(blocks, [&](uint32_t _block) {
+        for (int y = firstRow(_block); y <= lastRow(_block); y++) {
+            double* row = Row(y) + Channels;
+            _load(y - 1, row);
+            for (size_t i = Channels; i < rowLength; i++)
+                row[i] += row[i - Channels];
+            if (y > firstRow(_block)) {
+                const double* above = Row(y - 1) + Channels;
+                for (size_t i = 0; i < rowLength; i++)
+                    row[i] += above[i];
+            }
+        }
+    });
+
+    // Carry down the last rows, which makes each block's last row final
+    for (uint32_t block = 1; block < blocks; block++) {
+        double* row = Row(lastRow(block)) + Channels;
+        const double* carry = Row(lastRow(block - 1)) + Channels;
+        for (size_t i = 0; i < rowLength; i++)
+            row[i] += carry[i];
+    }
+
+    // and then the rest of every block
+    ThreadPool::Get().ParallelFor(blocks, [&](uint32_t _block) {
+        if (_block == 0)
+            return;
+        const double* carry = Row(lastRow(_block - 1)) + Channels;
+        for (int y = firstRow(_block); y < lastRow(_block); y++) {
+            double* row = Row(y) + Channels;
+            for (size_t i = 0; i < rowLength; i++)
+                row[i] += carry[i];
+        }
+    });
+}
+
+Vector4 Emulator::SummedAreaTable::Sum(int _x0, int _y0, int _x1, int _y1) const {
+    _x0 = std::clamp(_x0, 0, m_width);
+    _x1 = std::clamp(_x1, 0, m_width);
+    _y0 = std::clamp(_y0, 0, m_height);
+    _y1 = std::clamp(_y1, 0, m_height);
+    if (_x0 >= _x1 || _y0 >= _y1)
+        return Vector4();
+
+    const double* a = Entry(_x0, _y0);
+    const double* b = Entry(_x1, _y0);
+    const double* c = Entry(_x0, _y1);
+    const double* d = Entry(_x1, _y1);
+    double sum[Channels];
+    for (int i = 0; i < Channels; i++)
+        sum[i] = (d[i] - b[i] - c[i] + a[i]) * m_scale;
+    return Vector4(
+        static_cast<float>(sum[0]), static_cast<float>(sum[1]), static_cast<float>(sum[2]), static_cast<float>(sum[3])
+    );
+}
+
+Vector4 Emulator::SummedAreaTable::Average(int _x0, int _y0, int _x1, int _y1) const {
+    int width = std::min(_x1, m_width) - std::max(_x0, 0);
+    int height = std::min(_y1, m_height) - std::max(_y0, 0);
+    if (width <= 0 || height <= 0)
+        return Vector4();
+    return Sum(_x0, _y0, _x1, _y1) * (1.0f / (static_cast<float>(width) * height));
+}
+
+Vector4 Emulator::SummedAreaTable::Filter(int _x, int _y, int _radius) const {
+    return Average(_x - _radius, _y - _radius, _x + _radius + 1, _y + _radius + 1);
+}
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////
+// A summed-area table over a moment shadow map, the CPU counterpart of
+// SummedAreaTable.hlsl.  Once built, the average of any rectangle of
+// texels costs four lookups, so every pixel can filter the shadow map
+// over its own footprint without blurring the whole map first.
+//
+// Sums are kept in doubles.  Moment texels are 16 bit unorm, and are
+// summed as their raw integer values, scaled by 1/65535 only in Sum.
+// Doubles hold integers exactly up to 2^53, so every entry, even the
+// corner sum of a 4096x4096 map, is exact, and rectangles far from the
+// origin lose nothing to cancellation.  Tables built from floats have
+// no such guarantee.
+//
+// The table is built with a two-level scan over blocks of rows: every
+// block is summed on its own in parallel, the last rows of the blocks
+// are then carried down serially, and finally each block adds the
+// carry of the blocks above it, again in parallel.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Emulator {
+    class MomentShadowMap;
+
+    class SummedAreaTable {
+    public:
+        static constexpr int Channels = 4;
+        static constexpr int BlockRows = 32; // Rows per work item of the scan
+
+        int m_width = 0, m_height = 0; // Of the source, in texels
+
+        void Build(const MomentShadowMap& _map);
+        void Build(const DirectX::SimpleMath::Vector4* _texels, int _width, int _height);
+
+        // Sum of the texels in [_x0, _x1) x [_y0, _y1), clipped to the map.
+        DirectX::SimpleMath::Vector4 Sum(int _x0, int _y0, int _x1, int _y1) const;
+
+        // Mean of the same texels: the box-filtered moments of the
+        // rectangle.  Rectangles reaching past an edge average only the
+        // texels inside, like a clamped blur of that size.
+        DirectX::SimpleMath::Vector4 Average(int _x0, int _y0, int _x1, int _y1) const;
+
+        // Average of the square of side 2 * _radius + 1 centered on texel
+        // (_x, _y).
+        DirectX::SimpleMath::Vector4 Filter(int _x, int _y, int _radius) const;
+
+    private:
+        // _load(y, row) writes source row y, Channels values per texel.
+        void Build(int _width, int _height, const std::function<void(int, double*)>& _load);
+
+        // Entry (x, y) holds the sum of [0, x) x [0, y), so row and
+        // column 0 are zero.
+        const double* Entry(int _x, int _y) const {
+            return &m_sums[(static_cast<size_t>(_y) * (m_width + 1) + _x) * Channels];
+        }
+        double* Row(int _y) { return &m_sums[static_cast<size_t>(_y) * (m_width + 1) * Channels]; }
+
+        std::vector<double> m_sums;
+        double m_scale = 1; // From the summed values to texel values
+    };
+}
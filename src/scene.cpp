@@ -21,6 +21,7 @@
 #include "../ShaderData.h"
 #include "scene.h"
 #include "shader.h"
+#include <algorithm>
 #include <cmath>
 #include <combaseapi.h>
 #include <cstdint>
@@ -69,97 +70,6 @@
 #endif
 
 
-const bool fullPolyCount = true; // Use false when emulating the graphics pipeline in software
-
-const float PI = 3.14159f;
-const float rad = PI / 180.0f;    // Convert degrees to radians
-
-const float grndSize = 100.0f;    // Island radius;  Minimum about 20;  Maximum 1000 or so
-const float grndOctaves = 4.0f;  // Number of levels of detail to compute
-const float grndFreq = 0.03f;    // Number of hills per (approx) 50m
-const float grndPersistence = 0.03f; // Terrain roughness: Slight:0.01  rough:0.05
-const float grndLow = -3.0f;         // Lowest extent below sea level
-const float grndHigh = 5.0f;        // Highest extent above sea level
-
-DirectX::SimpleMath::Matrix PerspectiveReverseZ(const float _fovy, const float _aspect, const float _near, const float _far) {
-    const float e = 1.0f / std::tan(_fovy * 0.5f);
-    return { e / _aspect, 0.0f, 0.0f, 0.0f,
-            0.0f, e, 0.0f, 0.0f,
-            0.0f, 0.0f, _far / (_near - _far), -1.f,
-            0.0f, 0.0f, (_far * _near) / (_near - _far), 0.0f };
-}
-
-// Create an RGB color from human friendly parameters: hue, saturation, value
-DirectX::SimpleMath::Vector3 HSV2RGB(const float h, const float s, const float v) {
-    if (s == 0.0f)
-        return DirectX::SimpleMath::Vector3(v, v, v);
-
-    int i = (int)(h * 6.0f) % 6;
-    float f = (h * 6.0f) - i;
-    float p = v * (1.0f - s);
-    float q = v * (1.0f - s * f);
-    float t = v * (1.0f - s * (1.0f - f));
-    if (i == 0)     return DirectX::SimpleMath::Vector3(v, t, p);
-    else if (i == 1)     return DirectX::SimpleMath::Vector3(q, v, p);
-    else if (i == 2)     return DirectX::SimpleMath::Vector3(p, v, t);
-    else if (i == 3)     return DirectX::SimpleMath::Vector3(p, q, v);
-    else if (i == 4)     return DirectX::SimpleMath::Vector3(t, p, v);
-    else   /*i == 5*/    return DirectX::SimpleMath::Vector3(v, p, q);
-}
-
-////////////////////////////////////////////////////////////////////////
-// Constructs a hemisphere of spheres of varying hues
-std::shared_ptr<Object> SphereOfSpheres(std::shared_ptr<DirectX::GeometricPrimitive>& SpherePolygons) {
-    std::shared_ptr<Object> ob = std::make_shared<Object>(nullptr, nullId);
-
-    using namespace DirectX::SimpleMath;
-    for (float angle = 0.0; angle < 360.0; angle += 18.0)
-        for (float row = 0.075f; row < PI / 2.0f; row += PI / 2.0f / 6.0f) {
-            Vector3 hue = HSV2RGB(angle / 360.0f, 1.0f - 2.0f * row / PI, 1.0f);
-
-            std::shared_ptr<Object> sp = std::make_shared<Object>(
-                SpherePolygons,
-                spheresId,
-                hue,
-                Vector3(1.0, 1.0, 1.0),
-                120.0
-            );
-            float s = sin(row);
-            float c = cos(row);
-            ob->add(sp,
-                Matrix::CreateScale(0.075f * c, 0.075f * c, 0.075f * c)
-                * Matrix::CreateTranslation(c, 0, s)
-                * Matrix::CreateRotationZ(DirectX::XMConvertToRadians(angle))
-            );
-        }
-    return ob;
-}
-
-////////////////////////////////////////////////////////////////////////
-// Constructs a -1...+1  quad (canvas) framed by four (elongated) boxes
-std::shared_ptr<Object> FramedPicture(const DirectX::SimpleMath::Matrix& modelTr, const int objectId,
-    std::shared_ptr<DirectX::GeometricPrimitive> BoxPolygons,
-    std::shared_ptr<DirectX::GeometricPrimitive> QuadPolygons) {
-    using namespace DirectX::SimpleMath;
-    // This draws the frame as four (elongated) boxes of size +-1.0
-    float w = 0.05f;             // Width of frame boards.
-
-    std::shared_ptr<Object> frame = std::make_shared<Object>(nullptr, nullId);
-    std::shared_ptr<Object> ob;
-
-    Vector3 woodColor(87.0f / 255.0f, 51.0f / 255.0f, 35.0f / 255.0f);
-    ob = std::make_shared<Object>(BoxPolygons, frameId, woodColor, Vector3(0.2f, 0.2f, 0.2f), 10.0f);
-    frame->add(ob, Matrix::CreateScale(1.0f, w, w) * Matrix::CreateTranslation(0.0f, 0.0f, 1.0f + w));
-    frame->add(ob, Matrix::CreateScale(1.0f, w, w) * Matrix::CreateTranslation(0.0f, 0.0f, -1.0f - w));
-    frame->add(ob, Matrix::CreateScale(w, w, 1.0f + 2.f * w) * Matrix::CreateTranslation(1.0f + w, 0.0f, 0.0f));
-    frame->add(ob, Matrix::CreateScale(w, w, 1.0f + 2.f * w) * Matrix::CreateTranslation(-1.0f - w, 0.0f, 0.0f));
-
-    ob = std::make_shared<Object>(QuadPolygons, objectId, woodColor, Vector3(1.0f, 1.0f, 1.0f), 10.0f);
-    frame->add(ob, Matrix::CreateRotationX(DirectX::XMConvertToRadians(-90)));
-
-    return frame;
-}
-
 ////////////////////////////////////////////////////////////////////////
 // InitializeScene is called once during setup to create all the
 // textures, shape VAOs, and shader programs as well as setting a
@@ -205,7 +115,7 @@ void Scene::InitializeScene() {
         m_device.Get(),
         D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
         D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-        FrameCount * 6
+        FrameCount * 7
     );
     m_dsvHeap = std::make_unique<DirectX::DescriptorPile>(
         m_device.Get(),
@@ -362,10 +272,11 @@ void Scene::InitializeScene() {
             throw std::runtime_error("Failed to create shadow texture");
         }
 
+        m_shadowTargetID = m_rtvHeap->Allocate();
         m_device->CreateRenderTargetView(
             m_shadowTexture.Get(),
             nullptr,
-            m_rtvHeap->GetCpuHandle(FrameCount * 5)
+            m_rtvHeap->GetCpuHandle(m_shadowTargetID)
         );
         m_shadowTextureID = m_descHeap->Allocate();
 
@@ -420,10 +331,11 @@ void Scene::InitializeScene() {
             m_AOMap[1].Get(),
             m_descHeap->GetCpuHandle(m_AOMapSrvID + 1)
         );
+        m_AOTargetID = m_rtvHeap->Allocate();
         DirectX::CreateRenderTargetView(
             m_device.Get(),
             m_AOMap[1].Get(),
-            m_rtvHeap->GetCpuHandle(FrameCount * 5 + 1)
+            m_rtvHeap->GetCpuHandle(m_AOTargetID)
         );
     }
 
@@ -487,167 +399,72 @@ void Scene::InitializeScene() {
         }
     }
 
-    nav = false;
-    w_down = s_down = a_down = d_down = false;
-    Yaw = 0.0f;
-    Pitch = 0.0f;
-    eye = Vector3(0.0f, -20.0f, 0.0f);
-    speed = 300.0f / 30.0f;
-    last_time = static_cast<float>(glfwGetTime());
-    cameraPos = Vector3(0.0f, 8.0f, 8.0f);
-
-    ry = 0.4f;
-    front = 0.1f;
-    back = 5000.0f;
+    for (uint32_t i = 0; i < FrameCount; i++) {
+        m_hdrFbos[i].CreateFBO(m_device, m_rtvHeap, m_descHeap, m_width, m_height);
+        m_hdrFbos[i].m_texture->SetName(L"HDR");
+    }
 
-    objectRoot = std::make_unique<Object>(nullptr, nullId);
+    // The tone curve's table and the tone mapper's state, from which
+    // the exposure starts at 1 and adapts
+    {
+        static_assert(Emulator::ToneMapper::Bins == ToneMapBins);
+        const std::vector<float>& lut = m_toneMapper.BuildLut();
+        ShaderData::ToneMapState state{
+            .exposure = 1,
+            .targetExposure = 1,
+        };
+        DirectX::ResourceUploadBatch uploadBatch(m_device.Get());
+        uploadBatch.Begin();
+        auto upload = [&](ComPtr<ID3D12Resource>& _buffer, const void* _data, size_t _size,
+            D3D12_RESOURCE_FLAGS _flags, D3D12_RESOURCE_STATES _state) {
+            CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+            CD3DX12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Buffer(_size, _flags);
+            HRESULT hr = m_device->CreateCommittedResource(
+                &heapProperties,
+                D3D12_HEAP_FLAG_NONE,
+                &desc,
+                D3D12_RESOURCE_STATE_COMMON,
+                nullptr,
+                IID_PPV_ARGS(&_buffer)
+            );
+            if (FAILED(hr))
+                throw std::runtime_error("failed to create tone mapping buffer");
+            D3D12_SUBRESOURCE_DATA data{
+                .pData = _data,
+                .RowPitch = static_cast<LONG_PTR>(_size),
+                .SlicePitch = static_cast<LONG_PTR>(_size),
+            };
+            uploadBatch.Upload(_buffer.Get(), 0, &data, 1);
+            uploadBatch.Transition(_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, _state);
+        };
+        upload(m_toneMapLut, lut.data(), lut.size() * sizeof(float),
+            D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+        upload(m_toneMapState, &state, sizeof(state),
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        uploadBatch.End(m_queue.Get()).wait();
+        m_toneMapLut->SetName(L"ToneMapLut");
+        m_toneMapState->SetName(L"ToneMapState");
+    }
 
-    cameraForward = { 0, -.75f, -.66f };
-    right = { 1, 0, 0 };
-    up = { 0, 1, 0 };
+    last_time = static_cast<float>(glfwGetTime());
 
     // Create the lighting shader program from source code files.
     // @@ Initialize additional shaders if necessary
     LoadShaders();
 
-    // Create all the Polygon shapes
-    //proceduralground = new Shapes::ProceduralGround(m_queue, grndSize, 400,
-    //    grndOctaves, grndFreq, grndPersistence,
-    //    grndLow, grndHigh);
-
-    std::shared_ptr<DirectX::GeometricPrimitive> TeapotPolygons = DirectX::GeometricPrimitive::CreateTeapot();
-    std::shared_ptr<DirectX::GeometricPrimitive> BoxPolygons = DirectX::GeometricPrimitive::CreateBox({ 1, 1, 1 });
-    std::shared_ptr<DirectX::GeometricPrimitive> SpherePolygons = DirectX::GeometricPrimitive::CreateSphere(
-    1.f, 32Ui64);
-    std::shared_ptr<DirectX::GeometricPrimitive> InvSpherePolygons = DirectX::GeometricPrimitive::CreateSphere(
-        1.f, 16Ui64, false, true
-    );
-    // Shape* RoomPolygons = new Ply(m_queue, "room.ply");
-    // std::shared_ptr<DirectX::GeometricPrimitive> FloorPolygons = DirectX::GeometricPrimitive::Create new Shapes::Plane(10.0, 10, m_queue);
-    // std::shared_ptr<DirectX::GeometricPrimitive> QuadPolygons = new Quad(m_queue);
-    // std::shared_ptr<DirectX::GeometricPrimitive> SeaPolygons = new Shapes::Plane(2000.0, 50, m_queue);
-    // std::shared_ptr<DirectX::GeometricPrimitive> GroundPolygons = proceduralground;
-
-    DirectX::GeometricPrimitive::VertexCollection vertices;
-    vertices.push_back({ DirectX::XMFLOAT3{ -1, -1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 0, 1 } });
-    vertices.push_back({ DirectX::XMFLOAT3{ -1, 1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 0, 0 } });
-    vertices.push_back({ DirectX::XMFLOAT3{ 1, 1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 1, 0 } });
-    vertices.push_back({ DirectX::XMFLOAT3{ 1, -1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 1, 1 } });
-    DirectX::GeometricPrimitive::IndexCollection indices;
-    indices.push_back(0);
-    indices.push_back(1);
-    indices.push_back(2);
-    indices.push_back(0);
-    indices.push_back(2);
-    indices.push_back(3);
-    std::shared_ptr<DirectX::GeometricPrimitive> QuadPolygons = DirectX::GeometricPrimitive::CreateCustom(
-        vertices, indices
-    );
-
-
-    D3D12_FEATURE_DATA_D3D12_OPTIONS12 options{};
-    m_device->CheckFeatureSupport(D3D12_FEATURE::D3D12_FEATURE_D3D12_OPTIONS12, &options, sizeof(options));
-    DirectX::ResourceUploadBatch uploadBatch(m_device.Get());
-    uploadBatch.Begin();
-    BoxPolygons->LoadStaticBuffers(m_device.Get(), uploadBatch);
-    SpherePolygons->LoadStaticBuffers(m_device.Get(), uploadBatch);
-    QuadPolygons->LoadStaticBuffers(m_device.Get(), uploadBatch);
-    InvSpherePolygons->LoadStaticBuffers(m_device.Get(), uploadBatch);
-    uploadBatch.End(m_queue.Get()).wait();
-
-    // Various colors used in the subsequent models
-    Vector3 woodColor(87.0f / 255.0f, 51.0f / 255.0f, 35.0f / 255.0f);
-    Vector3 brickColor(134.0f / 255.0f, 60.0f / 255.0f, 56.0f / 255.0f);
-    Vector3 floorColor(6 * 16 / 255.0f, 5.5f * 16 / 255.0f, 3 * 16 / 255.0f);
-    Vector3 brassColor(0.5f, 0.5f, 0.1f);
-    Vector3 grassColor(62.0f / 255.0f, 102.0f / 255.0f, 38.0f / 255.0f);
-    Vector3 waterColor(0.3f, 0.3f, 1.0f);
-
-    Vector3 black(0.0f, 0.0f, 0.0f);
-    Vector3 brightSpec(0.5f, 0.5f, 0.5f);
-    Vector3 polishedSpec(0.3f, 0.3f, 0.3f);
-
-    // Creates all the models from which the scene is composed.  Each
-    // is created with a polygon shape (possibly NULL), a
-    // transformation, and the surface lighting parameters Kd, Ks, and
-    // alpha.
-
-    // @@ This is where you could read in all the textures and
-    // associate them with the various objects being created in the
-    // next dozen lines of code.
-
-    // @@ To change an object's surface parameters (Kd, Ks, or alpha),
-    // modify the following lines.
-
-    central = std::make_shared<Object>(nullptr, nullId);
-    anim = std::make_shared<Object>(nullptr, nullId);
-    //room       = new Object(RoomPolygons, roomId, brickColor, black, 1);
-    //floor      = new Object(FloorPolygons, floorId, floorColor, black, 1);
-    teapot = std::make_shared<Object>(TeapotPolygons, teapotId, Vector3(1.0f, 1.0f, 1.0f), brightSpec, 0.1f);
-    podium = std::make_shared<Object>(BoxPolygons, boxId, Vector3(woodColor), Vector3(0.01f, 0.01f, 0.01f), 1.0f);
-    sky = std::make_shared<Object>(InvSpherePolygons, skyId, black, black, 0);
-    //ground     = new Object(GroundPolygons, groundId, grassColor, black, 1);
-    //sea        = new Object(SeaPolygons, seaId, waterColor, brightSpec, 120);
-    leftFrame = std::shared_ptr<Object>(FramedPicture(Matrix::Identity, lPicId, BoxPolygons, QuadPolygons));
-    rightFrame = std::shared_ptr<Object>(FramedPicture(Matrix::Identity, rPicId, BoxPolygons, QuadPolygons));
-    spheres = std::make_shared<Object>(SpherePolygons, 14, Vector3(0.3f, 0.3f, 0.3f), Vector3(0.3f, 0.3f, 0.3f), 0.1f);
-    //std::shared_ptr<Object>(SphereOfSpheres(SpherePolygons));
-    frame = std::make_shared<Object>(QuadPolygons, 12, Vector3(0, 0, 0), Vector3(0, 0, 0), 1);
-    light = std::make_shared<Object>(SpherePolygons, 13, Vector3(1, 1, 1), Vector3(0, 0, 0), 1);
-#ifdef REFL
-    spheres->drawMe = true;
-#else
-    spheres->m_drawMe = false;
-#endif
-
-
-    // @@ To change the scene hierarchy, examine the hierarchy created
-    // by the following object->add() calls and adjust as you wish.
-    // The objects being manipulated and their polygon shapes are
-    // created above here.
-    //objectRoot->add(teapot);
-
-    // Scene is composed of sky, ground, sea, room and some central models
-    if (fullPolyCount) {
-        objectRoot->add(sky, Matrix::CreateScale(2000.0f, 2000.0f, 2000.0f));
-        //objectRoot->add(sea);
-        //objectRoot->add(ground);
-    }
-    objectRoot->add(central);
-#ifndef REFL
-    //objectRoot->add(room);
-#endif
-    //objectRoot->add(floor, Matrix::CreateTranslation(0, 0.02f, 0));
-
-    // Central model has a rudimentary animation (constant rotation on Z)
-    //animated.push_back(anim.get());
-
-    // Central contains a teapot on a podium and an external sphere of spheres
-    central->add(podium, Matrix::CreateScale(24.f, 0.5f, 24.f) * Matrix::CreateTranslation(0, -1.5f, 0));
-    central->add(anim, Matrix::CreateTranslation(0, 0.0f, 0));
-    //for (int i = 0; i < 8; i++) {
-    //    auto object = std::make_shared<Object>(
-    //        SpherePolygons, 14, Vector3(0.5f, 0.5f, 0.5f), Vector3(0.5f, 0.5f, 0.5f), i * (1.f / 8.f) + .01f
-    //    );
-    //    central->add(
-    //        object,
-    //        Matrix::CreateScale(2) * Matrix::CreateTranslation({0, 0, 5}) * Matrix::CreateRotationY(i * (2.f * PI) / 8.f)
-    //    );
-    //}
-    anim->add(teapot, Matrix::CreateScale(2.0f, 2.0f, 2.0f) * Matrix::CreateTranslation(0.f, 0.25f, 0));
-
-    if (fullPolyCount)
-        anim->add(spheres, Matrix::CreateScale(16, 16, 16) * Matrix::CreateTranslation(0.0f, 0.0f, 0.0f));
-
-    // Room contains two framed pictures
-    if (fullPolyCount) {
-        //room->add(leftFrame, Matrix::CreateScale(0.8f, 0.8f, 0.8f) * Matrix::CreateTranslation(-1.5f, 9.85f, 1.f));
-        //room->add(rightFrame, Matrix::CreateScale(0.8f, 0.8f, 0.8f) * Matrix::CreateTranslation(1.5f, 9.85f, 1.f));
-    }
+    nav = false;
+    w_down = s_down = a_down = d_down = false;
+    Yaw = 0.0f;
+    Pitch = 0.0f;
+    eye = Vector3(0.0f, -20.0f, 0.0f);
+    speed = 300.0f / 30.0f;
+    ry = 0.4f;
 
     // Options menu stuff
     show_demo_window = false;
 
+    BuildSceneGraph();
+
     m_waitableObject = m_swapchain->GetFrameLatencyWaitableObject();
 
     hr = m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_idleFence));
@@ -655,49 +472,32 @@ void Scene::InitializeScene() {
         throw std::runtime_error("failed to create fence");
     }
 
-    Texture texture = Texture::LoadRGBE(m_device, m_queue, m_descHeap, "skys/Newport_Loft_Ref.hdr");
-    m_irradianceMap = Texture::LoadRGBE(m_device, m_queue, m_descHeap, "skys/Newport_Loft_Ref.irr.hdr");
-    sky->m_texture = texture;
     m_states = std::make_unique<DirectX::CommonStates>(m_device.Get());
 
-    m_lights.push_back({
-        .ShadowView = ShadowView,
-        .ShadowProj = ShadowProj,
-        .lightPos = m_lightPos,
-        .ShadowMin = m_shadowMin - m_lightPos.Length(),
-        .lightColor = ShaderData::float3(1, 1, 1),
-        .ShadowMax = m_shadowMax + m_lightPos.Length(),
-        .useShadows = 1,
-        .range = 10
-    });
-    for (int i = 0; i < 1024; i++) {
-
-        ShaderData::Light light{
-            .lightPos = ShaderData::float3((i * 2) % 64 - 32, 0, (i * 2) / 32 - 32),
-            .lightColor = { (float)rand() / (float)RAND_MAX, 
-            (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX},
-            .useShadows = 0,
-            .range = 20
-        };
-        m_lights.push_back(light);
-    }
+    SetBlurWidth(4);
+    m_lightDataID = m_descHeap->Allocate();
+    for (uint32_t i = 1; i < 2 * FrameCount; i++)
+        m_descHeap->Allocate();
+    m_clusterDataID = m_descHeap->Allocate();
+    for (uint32_t i = 1; i < 2 * FrameCount; i++)
+        m_descHeap->Allocate();
+}
 
-    m_computeData.cwidth = 4;
-    float weights[104];
-    const float e = 2.718281828f;
-    float sum = 0;
-    for (int i = 0; i < 2 * m_computeData.cwidth + 1; i++) {
-        float exp = (i - m_computeData.cwidth) / (m_computeData.cwidth / 2.f);
-        weights[i] = powf(e, -0.5f * exp * exp);
-        sum += weights[i];
-    }
+// Static buffers on the device for a shape's polygons
+std::shared_ptr<DirectX::GeometricPrimitive> Scene::CreateShape(
+    const DirectX::GeometricPrimitive::VertexCollection& _vertices,
+    const DirectX::GeometricPrimitive::IndexCollection& _indices
+) {
+    std::shared_ptr<DirectX::GeometricPrimitive> shape = DirectX::GeometricPrimitive::CreateCustom(_vertices, _indices);
+    DirectX::ResourceUploadBatch uploadBatch(m_device.Get());
+    uploadBatch.Begin();
+    shape->LoadStaticBuffers(m_device.Get(), uploadBatch);
+    uploadBatch.End(m_queue.Get()).wait();
+    return shape;
+}
 
-    for (int i = 0; i < 2 * m_computeData.cwidth + 1; i++) {
-        weights[i] /= sum;
-    }
-    memcpy(m_computeData.weights, weights, sizeof(weights));
-    m_lightDataID = m_descHeap->Allocate();
-    m_descHeap->Allocate();
+std::shared_ptr<Texture> Scene::CreateTexture(const Image& _image) {
+    return std::make_shared<Texture>(Texture::Create(m_device, m_queue, m_descHeap, _image));
 }
 
 void Scene::DrawMenu() {
@@ -710,6 +510,9 @@ void Scene::DrawMenu() {
         // This menu demonstrates how to provide the user a list of toggleable settings.
         if (ImGui::BeginMenu("Objects")) {
             if (ImGui::MenuItem("Draw spheres", "", spheres->m_drawMe)) { spheres->m_drawMe ^= true; }
+            if (ImGui::MenuItem("Draw teapot", "", teapot->m_drawMe)) { teapot->m_drawMe ^= true; }
+            if (ImGui::MenuItem("Draw bunny", "", bunny->m_drawMe)) { bunny->m_drawMe ^= true; }
+            if (ImGui::MenuItem("Draw sphere of spheres", "", sphereOfSpheres->m_drawMe)) { sphereOfSpheres->m_drawMe ^= true; }
             if (ImGui::MenuItem("Draw walls", "", room->m_drawMe)) { room->m_drawMe ^= true; }
             if (ImGui::MenuItem("Draw ground/sea", "", ground->m_drawMe)) {
                 ground->m_drawMe ^= true;
@@ -760,6 +563,32 @@ void Scene::DrawMenu() {
             if (ImGui::MenuItem("Reset", "")) {
                 m_reset = true;
             }
+            if (ImGui::MenuItem("Emulate geometry", "", m_emulate)) {
+                m_emulate ^= true;
+            }
+            if (ImGui::MenuItem("Emulate with reverse Z", "", m_emulateReverseZ)) {
+                m_emulateReverseZ ^= true;
+            }
+            if (ImGui::MenuItem("Emulate shadow map", "", m_emulateShadow)) {
+                m_emulateShadow ^= true;
+            }
+            if (ImGui::MenuItem("Emulate ambient occlusion", "", m_emulateAO)) {
+                m_emulateAO ^= true;
+            }
+            if (ImGui::MenuItem("Tone mapping", "", m_toneMap)) {
+                m_toneMap ^= true;
+                m_resetToneMap = true;
+            }
+            if (ImGui::MenuItem("Emulate tone mapping", "", m_emulateToneMap)) {
+                m_emulateToneMap ^= true;
+                m_toneMapper.Reset();
+            }
+            if (ImGui::MenuItem("Occlusion culling", "", m_occlusionCulling)) {
+                m_occlusionCulling ^= true;
+            }
+            if (ImGui::MenuItem("Aggregate distant lights", "", m_lightClusters.m_aggregate)) {
+                m_lightClusters.m_aggregate ^= true;
+            }
             ImGui::EndMenu();
         }
 
@@ -769,6 +598,21 @@ void Scene::DrawMenu() {
     if (ImGui::Begin("Time")) {
         ImGui::Text("Frame Time %f", m_frameTime);
         ImGui::Text("fps %f", m_fps);
+        if (m_occlusionCulling)
+            ImGui::Text("Occlusion culled %llu of %llu", m_occlusion.m_statistics.culled, m_occlusion.m_statistics.tested);
+        ImGui::Text("Light clusters lit %llu, lights per lit cluster %f", m_lightClusters.m_statistics.clusters,
+            m_lightClusters.m_statistics.clusters ?
+            double(m_lightClusters.m_statistics.references) / m_lightClusters.m_statistics.clusters : 0.0);
+        if (m_lightClusters.m_aggregate)
+            ImGui::Text("Virtual light references %llu", m_lightClusters.m_statistics.virtualReferences);
+        ImGui::Text("Light upload %llu bytes, whole array %llu", m_lightStore.m_statistics.bytes, m_lightStore.m_statistics.fullBytes);
+        if (m_emulate) {
+            ImGui::Text("Emulated triangles %llu", m_emulator.m_statistics.setup);
+            ImGui::Text("Emulated lights per tile %f", m_emulatedLighting.m_statistics.tiles ?
+                double(m_emulatedLighting.m_statistics.tileLights) / m_emulatedLighting.m_statistics.tiles : 0.0);
+            if (m_emulateToneMap)
+                ImGui::Text("Emulated exposure %f (mean log2 luminance %f)", m_toneMapper.m_exposure, m_toneMapper.m_averageLog2);
+        }
     }
     ImGui::End();
 
@@ -781,21 +625,12 @@ void Scene::DrawMenu() {
             ImGui::DragFloat("Light Near", &m_lightNear, 0.1f, 0.0f, 10000.f, "%.3f");
             ImGui::DragFloat("ShadowMin", &m_shadowMin, 0.5f, -100.f, 100.f);
             ImGui::DragFloat("ShadowMax", &m_shadowMax, 0.5f, -100.f, 100.f);
-            if (ImGui::SliderInt("Blur Width", &m_computeData.cwidth, 0, WIDTH)) {
-                float weights[104];
-                const float e = 2.718281828f;
-                float sum = 0;
-                for (int i = 0; i < 2 * m_computeData.cwidth + 1; i++) {
-                    float exp = (i - m_computeData.cwidth) / (m_computeData.cwidth / 2.f);
-                    weights[i] = powf(e, -0.5f * exp * exp);
-                    sum += weights[i];
-                }
-
-                for (int i = 0; i < 2 * m_computeData.cwidth + 1; i++) {
-                    weights[i] /= sum;
-                }
-                memcpy(m_computeData.weights, weights, sizeof(weights));
-            }
+            int blurWidth = m_computeData.cwidth;
+            if (ImGui::SliderInt("Blur Width", &blurWidth, 0, WIDTH))
+                SetBlurWidth(blurWidth);
+            bool boxBlur = m_emulatedBlur.m_mode == Emulator::MomentBlur::Mode::Box;
+            if (ImGui::Checkbox("Emulated box blur", &boxBlur))
+                m_emulatedBlur.m_mode = boxBlur ? Emulator::MomentBlur::Mode::Box : Emulator::MomentBlur::Mode::Exact;
             ImGui::TreePop();
         }
         if (ImGui::TreeNode("Object")) {
@@ -816,6 +651,14 @@ void Scene::DrawMenu() {
             ImGui::SliderFloat("n", &m_aoData.n, 10, 20);
             ImGui::SliderFloat("s", &m_aoData.s, 0.01f, 1.f);
             ImGui::SliderFloat("k", &m_aoData.k, 0, 100);
+            ImGui::Checkbox("Emulated half resolution", &m_emulatedAO.m_halfResolution);
+            ImGui::TreePop();
+        }
+        if (ImGui::TreeNode("Tone Mapping")) {
+            ImGui::SliderFloat("Key", &m_toneMapper.m_key, 0.01f, 1.f);
+            ImGui::SliderFloat("Compensation (EV)", &m_toneMapper.m_compensation, -5.f, 5.f);
+            ImGui::SliderFloat("Adapt darker (EV/s)", &m_toneMapper.m_adaptDarker, 0.1f, 10.f);
+            ImGui::SliderFloat("Adapt brighter (EV/s)", &m_toneMapper.m_adaptBrighter, 0.1f, 10.f);
             ImGui::TreePop();
         }
     }
@@ -846,37 +689,7 @@ void Scene::BuildTransforms() {
     if (a_down)
         cameraPos -= dist * right;
 
-    WorldView = DirectX::XMMatrixLookToRH(cameraPos, cameraForward, up);
-    WorldProj = Matrix::CreatePerspectiveFieldOfView(
-        XMConvertToRadians(60.0f),
-        static_cast<float>(m_width) / static_cast<float>(m_height),
-        front,
-        back
-    );
-    WorldView.Invert(WorldInverse);
-
-    ShadowView = Matrix::CreateLookAt(
-        m_lightPos,
-        { 0, 0, 0 },
-        { 0, 1, 0 }
-    );
-
-    ShadowProj = Matrix::CreatePerspectiveFieldOfView(
-        XMConvertToRadians(90),
-        1024.f / 1024.f,
-        m_lightNear,
-        m_lightFar
-    );
-    m_lights[0] = {
-        .ShadowView = ShadowView,
-        .ShadowProj = ShadowProj,
-        .lightPos = m_lightPos,
-        .ShadowMin = m_shadowMin - m_lightPos.Length(),
-        .lightColor = ShaderData::float3(1, 1, 1),
-        .ShadowMax = m_shadowMax + m_lightPos.Length(),
-        .useShadows = 1,
-        .range = 1000
-    };
+    UpdateTransforms();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -905,9 +718,22 @@ void Scene::DrawScene() {
         m_reset = false;
     }
     //DrawShadow();
+    if (m_occlusionCulling)
+        BuildOcclusion();
     DrawGeometry();
+    if (m_emulate) {
+        if (m_emulateShadow)
+            EmulateShadow();
+        EmulateGeometry();
+        if (m_emulateAO)
+            EmulateAO();
+        EmulateLighting();
+        if (m_emulateToneMap)
+            EmulateToneMap(m_frameTime);
+    }
     //DrawAO();
     DrawLighting();
+    DrawToneMap();
 }
 
 void Scene::EndFrame() {
@@ -954,6 +780,8 @@ void Scene::EndFrame() {
 }
 
 Scene::~Scene() {
+    if (!m_device)
+        return;
     for (auto& cmd : m_lightingCmds) {
         cmd.Wait();
     }
@@ -1008,7 +836,7 @@ void Scene::DrawShadow() {
     );
     cmd->ResourceBarrier(1, &barrier);
 
-    auto rtvHandle = m_rtvHeap->GetCpuHandle(FrameCount * 5);
+    auto rtvHandle = m_rtvHeap->GetCpuHandle(m_shadowTargetID);
     auto dsvHandle = m_dsvHeap->GetCpuHandle(m_frameIndex);
     cmd->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, DepthClearValue, 0, 0, nullptr);
     cmd->OMSetRenderTargets(1, &rtvHandle, false, &dsvHandle);
@@ -1093,6 +921,7 @@ void Scene::LoadShaders() {
     m_lightingProgram = std::make_unique<ShaderProgram>();
     m_lightingProgram->AddShader("lightingPhongVert.hlsl", ShaderProgram::Type::Vertex);
     m_lightingProgram->AddShader("lightingPhongPixel.hlsl", ShaderProgram::Type::Pixel);
+    m_lightingProgram->SetRenderTargetFormat(0, DXGI_FORMAT_R32G32B32A32_FLOAT);
     m_lightingProgram->LinkProgram(m_device, D3D12_CULL_MODE_BACK, DirectX::CommonStates::DepthDefault,
         DirectX::CommonStates::Additive);
 
@@ -1101,6 +930,11 @@ void Scene::LoadShaders() {
     m_geometryProgram->AddShader("geometryPhongPixel.hlsl", ShaderProgram::Type::Pixel);
     m_geometryProgram->LinkProgram(m_device);
 
+    m_lightProxyProgram = std::make_unique<ShaderProgram>();
+    m_lightProxyProgram->AddShader("geometryPhongVert.hlsl", ShaderProgram::Type::Vertex, L"main", { L"INSTANCED" });
+    m_lightProxyProgram->AddShader("geometryPhongPixel.hlsl", ShaderProgram::Type::Pixel);
+    m_lightProxyProgram->LinkProgram(m_device);
+
     m_shadowProgram = std::make_unique<ShaderProgram>();
     m_shadowProgram->AddShader("shadowVert.hlsl", ShaderProgram::Type::Vertex);
     m_shadowProgram->AddShader("shadowVert.hlsl", ShaderProgram::Type::Pixel, L"PSmain");
@@ -1125,6 +959,19 @@ void Scene::LoadShaders() {
     m_AOV->AddShader("AOShader.hlsl", ShaderProgram::Type::Compute, L"AOBlurmainV", {L"V"});
     m_AOV->LinkProgram(m_device);
 
+    m_histogramProgram = std::make_unique<ShaderProgram>();
+    m_histogramProgram->AddShader("ToneMapShader.hlsl", ShaderProgram::Type::Compute, L"HistogramMain");
+    m_histogramProgram->LinkProgram(m_device);
+
+    m_exposureProgram = std::make_unique<ShaderProgram>();
+    m_exposureProgram->AddShader("ToneMapShader.hlsl", ShaderProgram::Type::Compute, L"ExposureMain");
+    m_exposureProgram->LinkProgram(m_device);
+
+    m_resolveProgram = std::make_unique<ShaderProgram>();
+    m_resolveProgram->AddShader("ToneMapShader.hlsl", ShaderProgram::Type::Vertex, L"VSMain");
+    m_resolveProgram->AddShader("ToneMapShader.hlsl", ShaderProgram::Type::Pixel, L"PSMain");
+    m_resolveProgram->LinkProgram(m_device, D3D12_CULL_MODE_NONE, DirectX::CommonStates::DepthNone);
+
 }
 
 void Scene::DrawAO() {
@@ -1181,7 +1028,7 @@ void Scene::DrawAO() {
     );
     cmd->ResourceBarrier(1, &barrier);
     auto mem = m_graphicsMemory->AllocateConstant(m_aoData);
-    auto rtvHandle = m_rtvHeap->GetCpuHandle(FrameCount * 5 + 1);
+    auto rtvHandle = m_rtvHeap->GetCpuHandle(m_AOTargetID);
     cmd->OMSetRenderTargets(1, &rtvHandle, false, nullptr);
     cmd->SetGraphicsRootConstantBufferView(0, mem.GpuAddress());
     cmd->SetGraphicsRootDescriptorTable(1, m_descHeap->GetGpuHandle(m_fbos[4 * m_frameIndex + 0].m_textureID));
@@ -1296,11 +1143,18 @@ void Scene::DrawGeometry() {
     cmd->SetGraphicsRootConstantBufferView(0, constantsMemory.GpuAddress());
     cmd->SetGraphicsRootConstantBufferView(1, lightMemory.GpuAddress());
 
-    objectRoot->Draw(cmd, m_geometryProgram, m_descHeap, Matrix::Identity);
-    for (auto& ligh : m_lights) {
-        Vector4 l = Vector4::Transform(Vector4::Transform(Vector4(ligh.lightPos.x, ligh.lightPos.y, ligh.lightPos.z, 1), WorldView), WorldProj);
-        if (abs(l.x / l.w) < 1 && abs(l.y / l.w) < 1)
-            light->Draw(cmd, m_geometryProgram, m_descHeap, Matrix::CreateTranslation(ligh.lightPos));
+    objectRoot->Draw(cmd, m_geometryProgram, m_descHeap, Matrix::Identity, m_occlusionCulling ? &m_occlusion : nullptr);
+
+    // The visible light proxies in one instanced draw.  Switching
+    // programs switches root signatures, which drops the bindings.
+    if (!m_lightProxies.m_positions.empty()) {
+        auto instanceMemory = m_graphicsMemory->Allocate(m_lightProxies.m_positions.size() * sizeof(Vector4));
+        memcpy(instanceMemory.Memory(), m_lightProxies.m_positions.data(), m_lightProxies.m_positions.size() * sizeof(Vector4));
+        m_lightProxyProgram->UseShader(cmd.cmd);
+        cmd->SetGraphicsRootConstantBufferView(0, constantsMemory.GpuAddress());
+        cmd->SetGraphicsRootConstantBufferView(1, lightMemory.GpuAddress());
+        cmd->SetGraphicsRootShaderResourceView(4, instanceMemory.GpuAddress());
+        light->DrawInstanced(cmd, m_descHeap, static_cast<uint32_t>(m_lightProxies.m_positions.size()));
     }
 
     for (uint32_t i = 0; i < static_cast<uint32_t>(FBOIndex::Count); i++) {
@@ -1319,6 +1173,65 @@ void Scene::DrawGeometry() {
     //m_queue->Wait(cmd.fence.Get(), cmd.fenceEventValue);
 }
 
+// Brings this frame's copy of the lighting pass's light buffers up to
+// date with m_lights, followed by m_lightClusters' virtual lights when
+// it aggregates.  Only lights that changed since this copy was
+// last written are copied.  DrawLighting has waited for this frame's
+// previous use of the copy, so it may be written, or replaced when the
+// number of lights or shadowed lights changes.
+void Scene::UploadLights() {
+    if (m_lightClusters.m_virtualLights.empty())
+        m_lightStore.Update(m_lights, FrameCount);
+    else {
+        m_shaderLights.assign(m_lights.begin(), m_lights.end());
+        m_shaderLights.insert(m_shaderLights.end(), m_lightClusters.m_virtualLights.begin(), m_lightClusters.m_virtualLights.end());
+        m_lightStore.Update(m_shaderLights, FrameCount);
+    }
+    LightBuffers& buffers = m_lightBuffers[m_frameIndex];
+    const uint32_t descriptor = m_lightDataID + 2 * m_frameIndex;
+
+    // A view of no elements is invalid, so each buffer holds at least one
+    auto create = [&](size_t _count, UINT _stride, ComPtr<ID3D12Resource>& _buffer, void*& _memory, uint32_t _descriptor) {
+        const size_t elements = std::max<size_t>(_count, 1);
+        CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_UPLOAD);
+        CD3DX12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Buffer(elements * _stride);
+        HRESULT hr = m_device->CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &desc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&_buffer)
+        );
+        if (FAILED(hr))
+            throw std::runtime_error("failed to create light buffer");
+        CD3DX12_RANGE noRead(0, 0);
+        hr = _buffer->Map(0, &noRead, &_memory);
+        if (FAILED(hr))
+            throw std::runtime_error("failed to map light buffer");
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+            .ViewDimension = D3D12_SRV_DIMENSION_BUFFER,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Buffer = {
+                .FirstElement = 0,
+                .NumElements = static_cast<UINT>(elements),
+                .StructureByteStride = _stride,
+            },
+        };
+        m_device->CreateShaderResourceView(_buffer.Get(), &srvDesc, m_descHeap->GetCpuHandle(_descriptor));
+    };
+    if (!buffers.hot || buffers.hotCount != m_lightStore.m_hot.size()) {
+        buffers.hotCount = m_lightStore.m_hot.size();
+        create(buffers.hotCount, sizeof(ShaderData::LightData), buffers.hot, buffers.hotMemory, descriptor);
+    }
+    if (!buffers.cold || buffers.coldCount != m_lightStore.m_cold.size()) {
+        buffers.coldCount = m_lightStore.m_cold.size();
+        create(buffers.coldCount, sizeof(ShaderData::ShadowData), buffers.cold, buffers.coldMemory, descriptor + 1);
+    }
+    m_lightStore.Flush(m_frameIndex, buffers.hotMemory, buffers.coldMemory);
+}
+
 void Scene::DrawLighting() {
     //WaitForSingleObjectEx(m_waitableObject, 1000, true);
     PIXScopedEvent(PIX_COLOR(0, 255, 0), "DrawLighting");
@@ -1354,13 +1267,14 @@ void Scene::DrawLighting() {
         m_descHeap->Heap()
     };
     cmd->SetDescriptorHeaps(_countof(heaps), heaps);
-    auto rtvHandle = m_rtvHeap->GetCpuHandle(m_frameIndex);
+
+    // Into the HDR target, which DrawToneMap resolves to the back buffer
+    FBO& hdr = m_hdrFbos[m_frameIndex];
+    auto rtvHandle = m_rtvHeap->GetCpuHandle(hdr.m_fboID);
     auto dsvHandle = m_dsvHeap->GetCpuHandle(m_frameIndex);
-    ComPtr<ID3D12Resource> backBuffer;
-    m_swapchain->GetBuffer(m_frameIndex, IID_PPV_ARGS(&backBuffer));
     auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        backBuffer.Get(),
-        D3D12_RESOURCE_STATE_COMMON,
+        hdr.m_texture.Get(),
+        D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
         D3D12_RESOURCE_STATE_RENDER_TARGET
     );
     cmd->ResourceBarrier(1, &barrier);
@@ -1379,12 +1293,11 @@ void Scene::DrawLighting() {
         nullptr
     );
     constexpr FLOAT color[] = { 0, 0, 0, 1 };
-    cmd->ClearRenderTargetView(m_rtvHeap->GetCpuHandle(m_frameIndex), color, 0, nullptr);
+    cmd->ClearRenderTargetView(rtvHandle, color, 0, nullptr);
 
 
     cmd->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     //cmd->SetGraphicsRootDescriptorTable(7, m_descHeap->GetGpuHandle(m_blurMapSrvID + 0));
-    //m_irradianceMap.BindTexture(cmd, m_descHeap, 8);
     //sky->m_texture.BindTexture(cmd, m_descHeap, 9);
     //cmd->SetGraphicsRootDescriptorTable(10, m_descHeap->GetGpuHandle(m_AOMapSrvID));
 
@@ -1416,6 +1329,12 @@ void Scene::DrawLighting() {
         .momentBias = m_momentBias,
         .depthBias = m_depthBias,
     };
+    m_irradiance.Pack(constants.irradianceSH);
+
+    // EmulateLighting has already built the clusters for this frame
+    if (!m_emulate)
+        BuildLightClusters();
+    m_lightClusters.Pack(constants);
     //for (int i = 0; i < 80; i++) {
     //    constants.hammersley[i].x = hammersley[i];
     //}
@@ -1423,29 +1342,121 @@ void Scene::DrawLighting() {
 
     auto constantsMemory = m_graphicsMemory->AllocateConstant(constants);
 
-    auto lightMemory = m_graphicsMemory->Allocate(m_lights.size() * sizeof(m_lights[0]));
-    memcpy(lightMemory.Memory(), m_lights.data(), m_lights.size() * sizeof(m_lights[0]));
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
-        .ViewDimension = D3D12_SRV_DIMENSION_BUFFER,
-        .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
-        .Buffer = {
-            .FirstElement = lightMemory.ResourceOffset() / sizeof(m_lights[0]),
-            .NumElements = static_cast<UINT>(m_lights.size()),
-            .StructureByteStride = sizeof(m_lights[0]),
-        },
+    UploadLights();
+
+    // The cluster grid, as ClusterRanges and ClusterLights.  A view can
+    // leave every cluster empty, and a view of no elements is invalid,
+    // so each buffer holds at least one.
+    auto uploadClusterBuffer = [&](const void* _data, size_t _count, UINT _stride, uint32_t _descriptor) {
+        const size_t elements = std::max<size_t>(_count, 1);
+        auto memory = m_graphicsMemory->Allocate(elements * _stride);
+        memcpy(memory.Memory(), _data, _count * _stride);
+        D3D12_SHADER_RESOURCE_VIEW_DESC desc{
+            .ViewDimension = D3D12_SRV_DIMENSION_BUFFER,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Buffer = {
+                .FirstElement = memory.ResourceOffset() / _stride,
+                .NumElements = static_cast<UINT>(elements),
+                .StructureByteStride = _stride,
+            },
+        };
+        m_device->CreateShaderResourceView(memory.Resource(), &desc, m_descHeap->GetCpuHandle(_descriptor));
+        return memory;
     };
-    m_device->CreateShaderResourceView(
-        lightMemory.Resource(),
-        &srvDesc,
-        m_descHeap->GetCpuHandle(m_lightDataID + m_frameIndex)
+    const uint32_t clusterData = m_clusterDataID + 2 * m_frameIndex;
+    auto rangeMemory = uploadClusterBuffer(
+        m_lightClusters.m_ranges.data(), m_lightClusters.m_ranges.size(), sizeof(Emulator::LightClusters::Range), clusterData
+    );
+    auto indexMemory = uploadClusterBuffer(
+        m_lightClusters.m_indices.data(), m_lightClusters.m_indices.size(), sizeof(uint32_t), clusterData + 1
     );
     //for (auto& light : m_lights) {
     //
     //    auto lightMemory = m_graphicsMemory->AllocateConstant(light);
     cmd->SetGraphicsRootConstantBufferView(0, constantsMemory.GpuAddress());
-    cmd->SetGraphicsRootDescriptorTable(1, m_descHeap->GetGpuHandle(m_lightDataID + m_frameIndex));
+    cmd->SetGraphicsRootDescriptorTable(1, m_descHeap->GetGpuHandle(m_lightDataID + 2 * m_frameIndex));
+    cmd->SetGraphicsRootDescriptorTable(6, m_descHeap->GetGpuHandle(clusterData));
     frame->m_shape->DrawInstanced(*cmd, 1, 0);
     //
     //    //frame->Draw(cmd, m_lightingProgram, m_descHeap, Matrix::Identity);
     //}
 }
+
+// Exposes the lighting pass's HDR output and tone maps it onto the back
+// buffer, on the lighting command list: a histogram of its luminance,
+// an exposure adapted toward what the histogram asks for, and a
+// full-screen draw through m_toneMapper's curve.  The G-buffer views
+// and a disabled tone mapper are only copied.
+void Scene::DrawToneMap() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "DrawToneMap");
+    CommandList& cmd = m_lightingCmds[m_frameIndex];
+    FBO& hdr = m_hdrFbos[m_frameIndex];
+    auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+        hdr.m_texture.Get(),
+        D3D12_RESOURCE_STATE_RENDER_TARGET,
+        D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE
+    );
+    cmd->ResourceBarrier(1, &barrier);
+
+    ShaderData::ToneMapData toneMap{
+        .minLog2 = Emulator::ToneMapper::MinLog2,
+        .maxLog2 = Emulator::ToneMapper::MaxLog2,
+        .key = m_toneMapper.m_key,
+        .compensation = m_toneMapper.m_compensation,
+        .lowPercentile = m_toneMapper.m_lowPercentile,
+        .highPercentile = m_toneMapper.m_highPercentile,
+        .adaptDarker = m_toneMapper.m_adaptDarker,
+        .adaptBrighter = m_toneMapper.m_adaptBrighter,
+        .seconds = m_frameTime,
+        .reset = m_resetToneMap,
+        .enabled = m_toneMap && frameBufferMode == 0,
+        .lutSize = Emulator::ToneMapper::LutSize,
+    };
+    m_resetToneMap = false;
+    auto toneMapMemory = m_graphicsMemory->AllocateConstant(toneMap);
+
+    // Each program has its own root signature, so each is bound afresh
+    if (toneMap.enabled) {
+        auto bindCompute = [&]() {
+            cmd->SetComputeRootConstantBufferView(0, toneMapMemory.GpuAddress());
+            cmd->SetComputeRootDescriptorTable(1, m_descHeap->GetGpuHandle(hdr.m_textureID));
+            cmd->SetComputeRootShaderResourceView(2, m_toneMapLut->GetGPUVirtualAddress());
+            cmd->SetComputeRootUnorderedAccessView(3, m_toneMapState->GetGPUVirtualAddress());
+        };
+        auto stateBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_toneMapState.Get());
+
+        PIXBeginEvent(cmd.cmd.Get(), PIX_COLOR(255, 0, 0), "Histogram");
+        m_histogramProgram->UseShader(cmd.cmd);
+        bindCompute();
+        cmd->Dispatch((m_width + 15) / 16, (m_height + 15) / 16, 1);
+        cmd->ResourceBarrier(1, &stateBarrier);
+        PIXEndEvent(cmd.cmd.Get());
+
+        PIXBeginEvent(cmd.cmd.Get(), PIX_COLOR(255, 0, 0), "Exposure");
+        m_exposureProgram->UseShader(cmd.cmd);
+        bindCompute();
+        cmd->Dispatch(1, 1, 1);
+        cmd->ResourceBarrier(1, &stateBarrier);
+        PIXEndEvent(cmd.cmd.Get());
+    }
+
+    PIXBeginEvent(cmd.cmd.Get(), PIX_COLOR(255, 0, 0), "Resolve");
+    ComPtr<ID3D12Resource> backBuffer;
+    m_swapchain->GetBuffer(m_frameIndex, IID_PPV_ARGS(&backBuffer));
+    barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+        backBuffer.Get(),
+        D3D12_RESOURCE_STATE_COMMON,
+        D3D12_RESOURCE_STATE_RENDER_TARGET
+    );
+    cmd->ResourceBarrier(1, &barrier);
+    auto rtvHandle = m_rtvHeap->GetCpuHandle(m_frameIndex);
+    cmd->OMSetRenderTargets(1, &rtvHandle, false, nullptr);
+
+    m_resolveProgram->UseShader(cmd.cmd);
+    cmd->SetGraphicsRootConstantBufferView(0, toneMapMemory.GpuAddress());
+    cmd->SetGraphicsRootDescriptorTable(1, m_descHeap->GetGpuHandle(hdr.m_textureID));
+    cmd->SetGraphicsRootShaderResourceView(2, m_toneMapLut->GetGPUVirtualAddress());
+    cmd->SetGraphicsRootUnorderedAccessView(3, m_toneMapState->GetGPUVirtualAddress());
+    frame->m_shape->DrawInstanced(*cmd, 1, 0);
+    PIXEndEvent(cmd.cmd.Get());
+}
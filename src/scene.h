@@ -12,28 +12,17 @@
 // Some of these parameters are set when the scene is built, and
 // others are set by the framework in response to user mouse/keyboard
 // interactions.  All of them can be used to draw the scene.
+//
+// What needs no device, the objects, lights and software pipeline, is
+// in SceneGraph; this class adds the window and the D3D12 passes.
 
+#include "scenegraph.h"
 #include "shapes.h"
-#include "object.h"
 #include "texture.h"
 #include "fbo.h"
+#include "lightstore.h"
 #include <memory>
 
-enum ObjectIds {
-    nullId = 0,
-    skyId = 1,
-    seaId = 2,
-    groundId = 3,
-    roomId = 4,
-    boxId = 5,
-    frameId = 6,
-    lPicId = 7,
-    rPicId = 8,
-    teapotId = 9,
-    spheresId = 10,
-    floorId = 11
-};
-
 class Shader;
 class ShaderProgram;
 constexpr float DepthClearValue = 1.0f;
@@ -46,9 +35,6 @@ constexpr float DepthClearValue = 1.0f;
 #include <directxtk12/CommonStates.h>
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
-#define AO
-#define COMPUTE
-#include "../ShaderData.h"
 struct CommandList {
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmd = nullptr;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator = nullptr;
@@ -106,7 +92,7 @@ struct CommandList {
     }
 };
 
-class Scene {
+class Scene : public SceneGraph {
 public:
     template <typename T>
     using ComPtr = Microsoft::WRL::ComPtr<T>;
@@ -130,7 +116,9 @@ public:
     uint32_t m_blurMapID = 0;
     uint32_t m_blurMapSrvID = 0;
     uint32_t m_shadowTextureID = 0;
-    uint32_t m_lightDataID = 0;
+    uint32_t m_shadowTargetID = 0; // RTV of m_shadowTexture
+    uint32_t m_lightDataID = 0;   // LightData and ShadowData, a pair per frame
+    uint32_t m_clusterDataID = 0; // ClusterRanges and ClusterLights, a pair per frame
     std::unique_ptr<DirectX::GraphicsMemory> m_graphicsMemory;
     std::unique_ptr<DirectX::DescriptorPile> m_rtvHeap;
     std::unique_ptr<DirectX::DescriptorPile> m_dsvHeap;
@@ -141,6 +129,7 @@ public:
     std::array<ComPtr<ID3D12Resource>, 2> m_AOMap;
     uint32_t m_AOMapID = 0;
     uint32_t m_AOMapSrvID = 0;
+    uint32_t m_AOTargetID = 0;     // RTV of m_AOMap[1]
 
     enum class FBOIndex {
         WorldPosition,
@@ -151,6 +140,15 @@ public:
     };
     std::array<FBO, FrameCount * 4> m_fbos;
 
+    // The lighting pass's HDR output, a target per frame, which
+    // DrawToneMap exposes onto the back buffer through m_toneMapper's
+    // table.  The histogram and exposure stay on the device.
+    std::array<FBO, FrameCount> m_hdrFbos;
+    ComPtr<ID3D12Resource> m_toneMapLut;
+    ComPtr<ID3D12Resource> m_toneMapState; // ShaderData::ToneMapState
+    bool m_toneMap = true;
+    bool m_resetToneMap = true;
+
     uint32_t m_frameIndex = 0;
 
     GLFWwindow* window;
@@ -160,27 +158,16 @@ public:
     // Light parameters
     //float lightSpin, lightTilt, lightDist;
     //DirectX::SimpleMath::Vector3 lightPos;
-    DirectX::SimpleMath::Vector3 m_lightPos{ 0, 2.f, -9.f };
     // @@ Perhaps declare additional scene lighting values here. (lightVal, lightAmb)
 
     HANDLE m_waitableObject;
 
     bool drawReflective;
     bool m_reset = false;
-    int frameBufferMode = 0;
     bool nav;
     bool w_down, s_down, a_down, d_down;
-    float Yaw, Pitch, speed, ry, front, back;
-    DirectX::SimpleMath::Vector3 eye, cameraPos;
-    DirectX::SimpleMath::Vector3 cameraForward;
-    DirectX::SimpleMath::Vector3 right;
-    DirectX::SimpleMath::Vector3 up;
-    float m_momentBias = .003f;
-    float m_lightFar = 10000.f;
-    float m_lightNear = 0.1f;
-    float m_depthBias = 0.005f;
-    float m_shadowMin = -24;
-    float m_shadowMax = 24;
+    float Yaw, Pitch, speed, ry;
+    DirectX::SimpleMath::Vector3 eye;
     float last_time;
     float m_frameStart = 0;
     float m_frameEnd = 0;
@@ -216,25 +203,12 @@ public:
 
     bool m_flatshade;
 
-    // Viewport
-    int m_width, m_height;
-
-    // Transformations
-    DirectX::SimpleMath::Matrix WorldProj, WorldView, WorldInverse, ShadowView, ShadowProj;
-
-    // All objects in the scene are children of this single root object.
-    std::shared_ptr<Object> objectRoot;
-    std::shared_ptr<Object> central, anim, room, floor, teapot, podium, sky,
-        ground, sea, spheres, leftFrame, rightFrame;
-    std::shared_ptr<Object> frame;
-    std::shared_ptr<Object> light;
-
-    std::vector<Object*> animated;
     Shapes::ProceduralGround* proceduralground;
 
     // Shader programs
     std::unique_ptr<ShaderProgram> m_lightingProgram;
     std::unique_ptr<ShaderProgram> m_geometryProgram;
+    std::unique_ptr<ShaderProgram> m_lightProxyProgram; // m_geometryProgram, instanced at the visible lights
     std::unique_ptr<ShaderProgram> m_shadowProgram;
     std::unique_ptr<ShaderProgram> m_copyProgram;
     std::unique_ptr<ShaderProgram> m_computeProgram;
@@ -243,20 +217,27 @@ public:
     std::unique_ptr<ShaderProgram> m_AOH;
     std::unique_ptr<ShaderProgram> m_AOV;
 
+    // Tone mapping
+    std::unique_ptr<ShaderProgram> m_histogramProgram;
+    std::unique_ptr<ShaderProgram> m_exposureProgram;
+    std::unique_ptr<ShaderProgram> m_resolveProgram;
+
     // Ambient Occlusion
     std::unique_ptr<ShaderProgram> m_AOProgram;
     // @@ Declare additional shaders if necessary
 
-    Texture m_irradianceMap;
-    
-    std::vector<ShaderData::Light> m_lights{};
-    ShaderData::AoData m_aoData{
-        .R = 1,
-        .n = 10,
-        .s = 0.5f,
-        .k = 1,
+    // m_lights as the lighting pass reads them, kept in persistently
+    // mapped buffers, a set per frame, that are only written where
+    // lights change
+    struct LightBuffers {
+        ComPtr<ID3D12Resource> hot, cold;
+        void* hotMemory = nullptr;
+        void* coldMemory = nullptr;
+        size_t hotCount = 0, coldCount = 0;
     };
-    ShaderData::ComputeData m_computeData{};
+    Emulator::LightStore m_lightStore;
+    std::array<LightBuffers, FrameCount> m_lightBuffers;
+    std::vector<ShaderData::Light> m_shaderLights; // m_lights and the clusters' virtual lights
 
     // Options menu stuff
     bool show_demo_window;
@@ -269,10 +250,19 @@ public:
 
     void DrawShadow();
     void DrawGeometry();
+    void UploadLights();
     void DrawLighting();
+    void DrawToneMap();
     void DrawAO();
 
     void LoadShaders();
 
     ~Scene();
+
+protected:
+    std::shared_ptr<DirectX::GeometricPrimitive> CreateShape(
+        const DirectX::GeometricPrimitive::VertexCollection& _vertices,
+        const DirectX::GeometricPrimitive::IndexCollection& _indices
+    ) override;
+    std::shared_ptr<Texture> CreateTexture(const Image& _image) override;
 };
@@ -0,0 +1,458 @@
+////////////////////////////////////////////////////////////////////////
+// The device free part of the scene: building the camera, objects and
+// lights, updating their transforms, and drawing them with the
+// software pipeline.  See scenegraph.h.
+
+#ifdef _WIN32
+#include <pix3.h>
+#else
+#define PIXScopedEvent(...)
+#endif
+
+#include "scenegraph.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+const bool fullPolyCount = true; // Use false when emulating the graphics pipeline in software
+
+const float PI = 3.14159f;
+const float rad = PI / 180.0f;    // Convert degrees to radians
+
+const float grndSize = 100.0f;    // Island radius;  Minimum about 20;  Maximum 1000 or so
+const float grndOctaves = 4.0f;  // Number of levels of detail to compute
+const float grndFreq = 0.03f;    // Number of hills per (approx) 50m
+const float grndPersistence = 0.03f; // Terrain roughness: Slight:0.01  rough:0.05
+const float grndLow = -3.0f;         // Lowest extent below sea level
+const float grndHigh = 5.0f;        // Highest extent above sea level
+
+// Right handed perspective that maps the near plane to depth 1 and the
+// far plane to depth 0.  Use with a depth clear of 0 and GREATER_EQUAL.
+DirectX::SimpleMath::Matrix PerspectiveReverseZ(const float _fovy, const float _aspect, const float _near, const float _far) {
+    const float e = 1.0f / std::tan(_fovy * 0.5f);
+    return { e / _aspect, 0.0f, 0.0f, 0.0f,
+            0.0f, e, 0.0f, 0.0f,
+            0.0f, 0.0f, _near / (_far - _near), -1.f,
+            0.0f, 0.0f, (_far * _near) / (_far - _near), 0.0f };
+}
+
+// Create an RGB color from human friendly parameters: hue, saturation, value
+DirectX::SimpleMath::Vector3 HSV2RGB(const float h, const float s, const float v) {
+    if (s == 0.0f)
+        return DirectX::SimpleMath::Vector3(v, v, v);
+
+    int i = (int)(h * 6.0f) % 6;
+    float f = (h * 6.0f) - i;
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - s * f);
+    float t = v * (1.0f - s * (1.0f - f));
+    if (i == 0)     return DirectX::SimpleMath::Vector3(v, t, p);
+    else if (i == 1)     return DirectX::SimpleMath::Vector3(q, v, p);
+    else if (i == 2)     return DirectX::SimpleMath::Vector3(p, v, t);
+    else if (i == 3)     return DirectX::SimpleMath::Vector3(p, q, v);
+    else if (i == 4)     return DirectX::SimpleMath::Vector3(t, p, v);
+    else   /*i == 5*/    return DirectX::SimpleMath::Vector3(v, p, q);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Constructs a hemisphere of spheres of varying hues
+std::shared_ptr<Object> SphereOfSpheres(std::shared_ptr<DirectX::GeometricPrimitive>& SpherePolygons,
+    std::shared_ptr<Emulator::Mesh> SphereMesh = nullptr) {
+    std::shared_ptr<Object> ob = std::make_shared<Object>(nullptr, nullId);
+
+    using namespace DirectX::SimpleMath;
+    for (float angle = 0.0; angle < 360.0; angle += 18.0)
+        for (float row = 0.075f; row < PI / 2.0f; row += PI / 2.0f / 6.0f) {
+            Vector3 hue = HSV2RGB(angle / 360.0f, 1.0f - 2.0f * row / PI, 1.0f);
+
+            std::shared_ptr<Object> sp = std::make_shared<Object>(
+                SpherePolygons,
+                spheresId,
+                hue,
+                Vector3(1.0, 1.0, 1.0),
+                120.0,
+                SphereMesh
+            );
+            float s = sin(row);
+            float c = cos(row);
+            ob->add(sp,
+                Matrix::CreateScale(0.075f * c, 0.075f * c, 0.075f * c)
+                * Matrix::CreateTranslation(c, 0, s)
+                * Matrix::CreateRotationZ(DirectX::XMConvertToRadians(angle))
+            );
+        }
+    return ob;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Constructs a -1...+1  quad (canvas) framed by four (elongated) boxes
+std::shared_ptr<Object> FramedPicture(const DirectX::SimpleMath::Matrix& modelTr, const int objectId,
+    std::shared_ptr<DirectX::GeometricPrimitive> BoxPolygons,
+    std::shared_ptr<DirectX::GeometricPrimitive> QuadPolygons,
+    std::shared_ptr<Emulator::Mesh> BoxMesh = nullptr,
+    std::shared_ptr<Emulator::Mesh> QuadMesh = nullptr) {
+    using namespace DirectX::SimpleMath;
+    // This draws the frame as four (elongated) boxes of size +-1.0
+    float w = 0.05f;             // Width of frame boards.
+
+    std::shared_ptr<Object> frame = std::make_shared<Object>(nullptr, nullId);
+    std::shared_ptr<Object> ob;
+
+    Vector3 woodColor(87.0f / 255.0f, 51.0f / 255.0f, 35.0f / 255.0f);
+    ob = std::make_shared<Object>(BoxPolygons, frameId, woodColor, Vector3(0.2f, 0.2f, 0.2f), 10.0f, BoxMesh);
+    frame->add(ob, Matrix::CreateScale(1.0f, w, w) * Matrix::CreateTranslation(0.0f, 0.0f, 1.0f + w));
+    frame->add(ob, Matrix::CreateScale(1.0f, w, w) * Matrix::CreateTranslation(0.0f, 0.0f, -1.0f - w));
+    frame->add(ob, Matrix::CreateScale(w, w, 1.0f + 2.f * w) * Matrix::CreateTranslation(1.0f + w, 0.0f, 0.0f));
+    frame->add(ob, Matrix::CreateScale(w, w, 1.0f + 2.f * w) * Matrix::CreateTranslation(-1.0f - w, 0.0f, 0.0f));
+
+    ob = std::make_shared<Object>(QuadPolygons, objectId, woodColor, Vector3(1.0f, 1.0f, 1.0f), 10.0f, QuadMesh);
+    frame->add(ob, Matrix::CreateRotationX(DirectX::XMConvertToRadians(-90)));
+
+    return frame;
+}
+
+// Builds the scene for a _width by _height view, with no window,
+// device or swapchain.  Used by the headless executable.
+void SceneGraph::Initialize(const int _width, const int _height) {
+    m_width = _width;
+    m_height = _height;
+    BuildSceneGraph();
+    SetBlurWidth(4);
+}
+
+// Camera, objects and lights.  The GPU copies of shapes and textures
+// come from CreateShape and CreateTexture.
+void SceneGraph::BuildSceneGraph() {
+    using namespace DirectX::SimpleMath;
+    cameraPos = Vector3(0.0f, 8.0f, 8.0f);
+
+    front = 0.1f;
+    back = 5000.0f;
+
+    objectRoot = std::make_unique<Object>(nullptr, nullId);
+
+    cameraForward = { 0, -.75f, -.66f };
+    right = { 1, 0, 0 };
+    up = { 0, 1, 0 };
+
+    // Create all the Polygon shapes
+    //proceduralground = new Shapes::ProceduralGround(m_queue, grndSize, 400,
+    //    grndOctaves, grndFreq, grndPersistence,
+    //    grndLow, grndHigh);
+
+    // Every shape's vertices make both its GPU copy, for Object::Draw,
+    // and its Mesh, for the software rasterizer, so both pipelines see
+    // the same triangles.
+    DirectX::GeometricPrimitive::VertexCollection vertices;
+    DirectX::GeometricPrimitive::IndexCollection indices;
+    auto polygons = [&](std::shared_ptr<DirectX::GeometricPrimitive>& _shape, std::shared_ptr<Emulator::Mesh>& _mesh) {
+        _shape = CreateShape(vertices, indices);
+        _mesh = Emulator::Mesh::CreateCustom(vertices, indices);
+    };
+    std::shared_ptr<DirectX::GeometricPrimitive> TeapotPolygons, BoxPolygons, SpherePolygons, InvSpherePolygons,
+        QuadPolygons, BunnyPolygons;
+    std::shared_ptr<Emulator::Mesh> TeapotMesh, BoxMesh, SphereMesh, InvSphereMesh, QuadMesh, BunnyMesh;
+
+    DirectX::GeometricPrimitive::CreateTeapot(vertices, indices);
+    polygons(TeapotPolygons, TeapotMesh);
+    DirectX::GeometricPrimitive::CreateBox(vertices, indices, { 1, 1, 1 });
+    polygons(BoxPolygons, BoxMesh);
+    DirectX::GeometricPrimitive::CreateSphere(vertices, indices, 1.f, 32);
+    polygons(SpherePolygons, SphereMesh);
+    DirectX::GeometricPrimitive::CreateSphere(vertices, indices, 1.f, 16, false, true);
+    polygons(InvSpherePolygons, InvSphereMesh);
+    // Shape* RoomPolygons = new Ply(m_queue, "room.ply");
+    // std::shared_ptr<DirectX::GeometricPrimitive> FloorPolygons = DirectX::GeometricPrimitive::Create new Shapes::Plane(10.0, 10, m_queue);
+    // std::shared_ptr<DirectX::GeometricPrimitive> SeaPolygons = new Shapes::Plane(2000.0, 50, m_queue);
+    // std::shared_ptr<DirectX::GeometricPrimitive> GroundPolygons = proceduralground;
+
+    vertices.clear();
+    vertices.push_back({ DirectX::XMFLOAT3{ -1, -1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 0, 1 } });
+    vertices.push_back({ DirectX::XMFLOAT3{ -1, 1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 0, 0 } });
+    vertices.push_back({ DirectX::XMFLOAT3{ 1, 1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 1, 0 } });
+    vertices.push_back({ DirectX::XMFLOAT3{ 1, -1, 0 }, DirectX::XMFLOAT3{ 0, 0, 1 }, DirectX::XMFLOAT2{ 1, 1 } });
+    indices = { 0, 1, 2, 0, 2, 3 };
+    polygons(QuadPolygons, QuadMesh);
+
+    Emulator::Mesh::ReadPly("bunny.ply", vertices, indices);
+    polygons(BunnyPolygons, BunnyMesh);
+
+    // Various colors used in the subsequent models
+    Vector3 woodColor(87.0f / 255.0f, 51.0f / 255.0f, 35.0f / 255.0f);
+    Vector3 brickColor(134.0f / 255.0f, 60.0f / 255.0f, 56.0f / 255.0f);
+    Vector3 floorColor(6 * 16 / 255.0f, 5.5f * 16 / 255.0f, 3 * 16 / 255.0f);
+    Vector3 brassColor(0.5f, 0.5f, 0.1f);
+    Vector3 grassColor(62.0f / 255.0f, 102.0f / 255.0f, 38.0f / 255.0f);
+    Vector3 waterColor(0.3f, 0.3f, 1.0f);
+
+    Vector3 black(0.0f, 0.0f, 0.0f);
+    Vector3 brightSpec(0.5f, 0.5f, 0.5f);
+    Vector3 polishedSpec(0.3f, 0.3f, 0.3f);
+
+    // Creates all the models from which the scene is composed.  Each
+    // is created with a polygon shape (possibly NULL), a
+    // transformation, and the surface lighting parameters Kd, Ks, and
+    // alpha.
+
+    // @@ This is where you could read in all the textures and
+    // associate them with the various objects being created in the
+    // next dozen lines of code.
+
+    // @@ To change an object's surface parameters (Kd, Ks, or alpha),
+    // modify the following lines.
+
+    central = std::make_shared<Object>(nullptr, nullId);
+    anim = std::make_shared<Object>(nullptr, nullId);
+    //room       = new Object(RoomPolygons, roomId, brickColor, black, 1);
+    //floor      = new Object(FloorPolygons, floorId, floorColor, black, 1);
+    teapot = std::make_shared<Object>(TeapotPolygons, teapotId, Vector3(1.0f, 1.0f, 1.0f), brightSpec, 0.1f, TeapotMesh);
+    podium = std::make_shared<Object>(BoxPolygons, boxId, Vector3(woodColor), Vector3(0.01f, 0.01f, 0.01f), 1.0f, BoxMesh);
+    teapot->m_occluder = true;
+    podium->m_occluder = true;
+    sky = std::make_shared<Object>(InvSpherePolygons, skyId, black, black, 0, InvSphereMesh);
+    //ground     = new Object(GroundPolygons, groundId, grassColor, black, 1);
+    //sea        = new Object(SeaPolygons, seaId, waterColor, brightSpec, 120);
+    leftFrame = std::shared_ptr<Object>(FramedPicture(Matrix::Identity, lPicId, BoxPolygons, QuadPolygons, BoxMesh, QuadMesh));
+    rightFrame = std::shared_ptr<Object>(FramedPicture(Matrix::Identity, rPicId, BoxPolygons, QuadPolygons, BoxMesh, QuadMesh));
+    spheres = std::make_shared<Object>(SpherePolygons, 14, Vector3(0.3f, 0.3f, 0.3f), Vector3(0.3f, 0.3f, 0.3f), 0.1f, SphereMesh);
+    bunny = std::make_shared<Object>(BunnyPolygons, bunnyId, Vector3(0.8f, 0.8f, 0.5f), brightSpec, 0.3f, BunnyMesh);
+    bunny->m_occluder = true;
+    bunny->m_drawMe = false;
+    sphereOfSpheres = SphereOfSpheres(SpherePolygons, SphereMesh);
+    sphereOfSpheres->m_drawMe = false;
+    frame = std::make_shared<Object>(QuadPolygons, 12, Vector3(0, 0, 0), Vector3(0, 0, 0), 1, QuadMesh);
+    light = std::make_shared<Object>(SpherePolygons, 13, Vector3(1, 1, 1), Vector3(0, 0, 0), 1, SphereMesh);
+    light->UpdateBounds();
+    m_lightProxyRadius = Vector3::Max(-light->m_boundsMin, light->m_boundsMax).Length();
+#ifdef REFL
+    spheres->drawMe = true;
+#else
+    spheres->m_drawMe = false;
+#endif
+
+
+    // @@ To change the scene hierarchy, examine the hierarchy created
+    // by the following object->add() calls and adjust as you wish.
+    // The objects being manipulated and their polygon shapes are
+    // created above here.
+    //objectRoot->add(teapot);
+
+    // Scene is composed of sky, ground, sea, room and some central models
+    if (fullPolyCount) {
+        objectRoot->add(sky, Matrix::CreateScale(2000.0f, 2000.0f, 2000.0f));
+        //objectRoot->add(sea);
+        //objectRoot->add(ground);
+    }
+    objectRoot->add(central);
+#ifndef REFL
+    //objectRoot->add(room);
+#endif
+    //objectRoot->add(floor, Matrix::CreateTranslation(0, 0.02f, 0));
+
+    // Central model has a rudimentary animation (constant rotation on Z)
+    //animated.push_back(anim.get());
+
+    // Central contains a teapot on a podium and an external sphere of spheres
+    central->add(podium, Matrix::CreateScale(24.f, 0.5f, 24.f) * Matrix::CreateTranslation(0, -1.5f, 0));
+    central->add(anim, Matrix::CreateTranslation(0, 0.0f, 0));
+    //for (int i = 0; i < 8; i++) {
+    //    auto object = std::make_shared<Object>(
+    //        SpherePolygons, 14, Vector3(0.5f, 0.5f, 0.5f), Vector3(0.5f, 0.5f, 0.5f), i * (1.f / 8.f) + .01f
+    //    );
+    //    central->add(
+    //        object,
+    //        Matrix::CreateScale(2) * Matrix::CreateTranslation({0, 0, 5}) * Matrix::CreateRotationY(i * (2.f * PI) / 8.f)
+    //    );
+    //}
+    anim->add(teapot, Matrix::CreateScale(2.0f, 2.0f, 2.0f) * Matrix::CreateTranslation(0.f, 0.25f, 0));
+
+    // The bunny stands in for the teapot, and the sphere of spheres
+    // domes over both; neither is drawn until turned on.
+    anim->add(bunny, Matrix::CreateScale(20.0f, 20.0f, 20.0f) * Matrix::CreateTranslation(0.34f, -1.91f, 0));
+    central->add(sphereOfSpheres,
+        Matrix::CreateScale(5.0f, 5.0f, 5.0f)
+        * Matrix::CreateRotationX(DirectX::XMConvertToRadians(-90))
+        * Matrix::CreateTranslation(0, -1.25f, 0)
+    );
+
+    if (fullPolyCount)
+        anim->add(spheres, Matrix::CreateScale(16, 16, 16) * Matrix::CreateTranslation(0.0f, 0.0f, 0.0f));
+
+    // Room contains two framed pictures
+    if (fullPolyCount) {
+        //room->add(leftFrame, Matrix::CreateScale(0.8f, 0.8f, 0.8f) * Matrix::CreateTranslation(-1.5f, 9.85f, 1.f));
+        //room->add(rightFrame, Matrix::CreateScale(0.8f, 0.8f, 0.8f) * Matrix::CreateTranslation(1.5f, 9.85f, 1.f));
+    }
+
+    sky->m_image = std::make_shared<Image>(Image::LoadRGBE("skys/Newport_Loft_Ref.hdr"));
+    sky->m_texture = CreateTexture(*sky->m_image);
+    m_irradiance.Project(*sky->m_image);
+
+    m_lights.push_back({
+        .ShadowView = ShadowView,
+        .ShadowProj = ShadowProj,
+        .lightPos = m_lightPos,
+        .ShadowMin = m_shadowMin - m_lightPos.Length(),
+        .lightColor = ShaderData::float3(1, 1, 1),
+        .ShadowMax = m_shadowMax + m_lightPos.Length(),
+        .useShadows = 1,
+        .range = 10
+    });
+    for (int i = 0; i < 1024; i++) {
+
+        ShaderData::Light light{
+            .lightPos = ShaderData::float3((i * 2) % 64 - 32, 0, (i * 2) / 32 - 32),
+            .lightColor = { (float)rand() / (float)RAND_MAX, 
+            (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX},
+            .useShadows = 0,
+            .range = 20
+        };
+        m_lights.push_back(light);
+    }
+}
+
+// The view, projection and light transforms for the current cameraPos,
+// cameraForward and m_lightPos, and the light proxies they leave in
+// view, which both geometry passes draw.
+void SceneGraph::UpdateTransforms() {
+    using namespace DirectX::SimpleMath;
+    using namespace DirectX;
+    WorldView = DirectX::XMMatrixLookToRH(cameraPos, cameraForward, up);
+    WorldProj = Matrix::CreatePerspectiveFieldOfView(
+        XMConvertToRadians(60.0f),
+        static_cast<float>(m_width) / static_cast<float>(m_height),
+        front,
+        back
+    );
+    WorldView.Invert(WorldInverse);
+
+    ShadowView = Matrix::CreateLookAt(
+        m_lightPos,
+        { 0, 0, 0 },
+        { 0, 1, 0 }
+    );
+
+    ShadowProj = Matrix::CreatePerspectiveFieldOfView(
+        XMConvertToRadians(90),
+        1024.f / 1024.f,
+        m_lightNear,
+        m_lightFar
+    );
+    m_lights[0] = {
+        .ShadowView = ShadowView,
+        .ShadowProj = ShadowProj,
+        .lightPos = m_lightPos,
+        .ShadowMin = m_shadowMin - m_lightPos.Length(),
+        .lightColor = ShaderData::float3(1, 1, 1),
+        .ShadowMax = m_shadowMax + m_lightPos.Length(),
+        .useShadows = 1,
+        .range = 1000
+    };
+    m_lightProxies.Cull(m_lights, WorldView * WorldProj, m_lightProxyRadius);
+}
+
+// Rasterizes the occluders into m_occlusion for this frame's view.
+void SceneGraph::BuildOcclusion() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "BuildOcclusion");
+    using namespace DirectX::SimpleMath;
+    objectRoot->UpdateBounds();
+    m_occlusion.Begin(WorldView * WorldProj);
+    objectRoot->Occlude(m_occlusion, Matrix::Identity);
+}
+
+// Sets the blur width of the shadow map, and the Gaussian weights the
+// compute shader blurs with, up to the shader's WIDTH.
+void SceneGraph::SetBlurWidth(const int _width) {
+    m_computeData.cwidth = std::clamp(_width, 0, WIDTH);
+    std::vector<float> weights = Emulator::MomentBlur::GaussianWeights(m_computeData.cwidth);
+    memset(m_computeData.weights, 0, sizeof(m_computeData.weights));
+    memcpy(m_computeData.weights, weights.data(), weights.size() * sizeof(float));
+}
+
+// The shadow pass again: central drawn from the main light by the
+// software rasterizer, then turned into optimized moments like the
+// depth copy in DrawShadow, and blurred like the compute passes.
+void SceneGraph::EmulateShadow() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "EmulateShadow");
+    using namespace DirectX::SimpleMath;
+    ShaderData::Constants constants{
+        .WorldView = m_lights[0].ShadowView,
+        .WorldProj = m_lights[0].ShadowProj,
+    };
+
+    m_shadowEmulator.Resize(m_shadowResolution, m_shadowResolution);
+    m_shadowEmulator.Begin(constants);
+    central->Emulate(m_shadowEmulator, Matrix::Identity);
+    m_shadowEmulator.End();
+    m_emulatedShadow.Generate(m_shadowEmulator, m_lights[0]);
+    m_emulatedBlur.Blur(m_emulatedShadow, m_computeData.cwidth);
+}
+
+// The geometry pass again, but drawn by the software rasterizer into
+// m_emulator instead of the G-buffer.
+void SceneGraph::EmulateGeometry() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "EmulateGeometry");
+    using namespace DirectX::SimpleMath;
+    WorldView.Invert(WorldInverse);
+
+    ShaderData::Constants constants{
+        .WorldView = WorldView,
+        .WorldInverse = WorldInverse,
+        .WorldProj = WorldProj,
+    };
+    m_emulator.m_reverseZ = m_emulateReverseZ;
+    if (m_emulateReverseZ)
+        constants.WorldProj = PerspectiveReverseZ(
+            DirectX::XMConvertToRadians(60.0f),
+            static_cast<float>(m_width) / static_cast<float>(m_height),
+            front,
+            back
+        );
+
+    m_emulator.Resize(m_width, m_height);
+    m_emulator.Begin(constants);
+    objectRoot->Emulate(m_emulator, Matrix::Identity, m_occlusionCulling ? &m_occlusion : nullptr);
+    for (const Vector4& position : m_lightProxies.m_positions)
+        light->Emulate(m_emulator, Matrix::CreateTranslation(position.x, position.y, position.z));
+    m_emulator.End();
+}
+
+// Bins m_lights into m_lightClusters for the current view, for both
+// lighting passes.  m_lightBVH is rebuilt when lights come or go, and
+// otherwise only refit to where they are now.
+void SceneGraph::BuildLightClusters() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "BuildLightClusters");
+    if (m_lightBVH.Fits(m_lights))
+        m_lightBVH.Refit(m_lights);
+    else
+        m_lightBVH.Build(m_lights);
+    m_lightClusters.Build(m_lights, WorldView, WorldProj, m_width, m_height, front, back, &m_lightBVH);
+}
+
+// The lighting pass over m_emulator's G-buffer, into m_emulatedLighting.
+void SceneGraph::EmulateLighting() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "EmulateLighting");
+    ShaderData::Constants constants{
+        .CameraPos = cameraPos,
+        .shaderMode = frameBufferMode,
+    };
+    BuildLightClusters();
+    m_emulatedLighting.Resolve(m_emulator.m_gbuffer, constants, m_lights, &m_lightClusters, &m_lightBVH);
+}
+
+// The ambient occlusion pass over m_emulator's G-buffer, into
+// m_emulatedAO, and its bilateral blurs like DrawAO.
+void SceneGraph::EmulateAO() {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "EmulateAO");
+    m_emulatedAO.Resolve(m_emulator.m_gbuffer, m_aoData);
+    m_emulatedAOBlur.Blur(m_emulatedAO, m_emulator.m_gbuffer);
+}
+
+// Exposes and tone maps m_emulatedLighting's output, _seconds after the
+// last frame, into m_toneMapper.
+void SceneGraph::EmulateToneMap(const float _seconds) {
+    PIXScopedEvent(PIX_COLOR(0, 255, 0), "EmulateToneMap");
+    m_toneMapper.Resolve(m_emulatedLighting.m_output, _seconds);
+}
@@ -0,0 +1,158 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////
+// The part of the scene that needs no device or window: the camera,
+// the object hierarchy and its lights, their transforms, and the
+// software pipeline that draws them.  Scene adds the D3D12 passes on
+// top of it; the headless program uses it alone, so it builds
+// anywhere the emulator does.
+//
+// The GPU copies of shapes and textures are made through CreateShape
+// and CreateTexture, which make nothing here and are overridden by
+// Scene once it has a device.
+
+// Before the emulator headers, which include it without AoData and
+// ComputeData
+#define AO
+#define COMPUTE
+#include "../ShaderData.h"
+#include "object.h"
+#include "emulator.h"
+#include "deferred.h"
+#include "occlusion.h"
+#include "moments.h"
+#include "blur.h"
+#include "cluster.h"
+#include "lightbvh.h"
+#include "lightproxies.h"
+#include "irradiance.h"
+#include "ao.h"
+#include "aoblur.h"
+#include "tonemap.h"
+#include <memory>
+#include <vector>
+
+enum ObjectIds {
+    nullId = 0,
+    skyId = 1,
+    seaId = 2,
+    groundId = 3,
+    roomId = 4,
+    boxId = 5,
+    frameId = 6,
+    lPicId = 7,
+    rPicId = 8,
+    teapotId = 9,
+    spheresId = 10,
+    floorId = 11,
+    bunnyId = 15
+};
+
+// Right handed perspective that maps the near plane to depth 1 and the
+// far plane to depth 0.  Use with a depth clear of 0 and GREATER_EQUAL.
+DirectX::SimpleMath::Matrix PerspectiveReverseZ(const float _fovy, const float _aspect, const float _near, const float _far);
+
+class SceneGraph {
+public:
+    // Light parameters
+    DirectX::SimpleMath::Vector3 m_lightPos{ 0, 2.f, -9.f };
+
+    int frameBufferMode = 0;
+    float front, back;
+    DirectX::SimpleMath::Vector3 cameraPos;
+    DirectX::SimpleMath::Vector3 cameraForward;
+    DirectX::SimpleMath::Vector3 right;
+    DirectX::SimpleMath::Vector3 up;
+    float m_momentBias = .003f;
+    float m_lightFar = 10000.f;
+    float m_lightNear = 0.1f;
+    float m_depthBias = 0.005f;
+    float m_shadowMin = -24;
+    float m_shadowMax = 24;
+
+    // Viewport
+    int m_width, m_height;
+
+    // Transformations
+    DirectX::SimpleMath::Matrix WorldProj, WorldView, WorldInverse, ShadowView, ShadowProj;
+
+    // All objects in the scene are children of this single root object.
+    std::shared_ptr<Object> objectRoot;
+    std::shared_ptr<Object> central, anim, room, floor, teapot, podium, sky,
+        ground, sea, spheres, leftFrame, rightFrame, bunny, sphereOfSpheres;
+    std::shared_ptr<Object> frame;
+    std::shared_ptr<Object> light;
+
+    std::vector<Object*> animated;
+
+    // Diffuse irradiance of the sky, for the lighting pass's constants
+    Emulator::IrradianceSH m_irradiance;
+
+    std::vector<ShaderData::Light> m_lights{};
+    Emulator::LightClusters m_lightClusters; // m_lights by cluster of the current view
+    Emulator::LightBVH m_lightBVH;           // Over m_lights, refit as they move
+    Emulator::LightProxies m_lightProxies;   // Which lights' proxies are in view, as of UpdateTransforms
+    float m_lightProxyRadius = 1;            // Bounds light's shape, about its origin
+    ShaderData::AoData m_aoData{
+        .R = 1,
+        .n = 10,
+        .s = 0.5f,
+        .k = 1,
+    };
+    ShaderData::ComputeData m_computeData{};
+
+    // Software emulation of the geometry pass
+    Emulator::Rasterizer m_emulator;
+    Emulator::DeferredLighting m_emulatedLighting;
+    bool m_emulate = false;
+    bool m_emulateReverseZ = false;
+
+    // Software emulation of the shadow pass, at any resolution
+    Emulator::Rasterizer m_shadowEmulator;
+    Emulator::MomentShadowMap m_emulatedShadow;
+    Emulator::MomentBlur m_emulatedBlur;
+    int m_shadowResolution = 1024;
+    bool m_emulateShadow = false;
+
+    // Software emulation of the ambient occlusion pass over m_emulator
+    Emulator::AmbientOcclusion m_emulatedAO;
+    Emulator::AOBlur m_emulatedAOBlur;
+    bool m_emulateAO = false;
+
+    // Auto-exposure and tone mapping of m_emulatedLighting's output
+    Emulator::ToneMapper m_toneMapper;
+    bool m_emulateToneMap = false;
+
+    // Coarse occlusion culling of the object hierarchy
+    Emulator::OcclusionBuffer m_occlusion;
+    bool m_occlusionCulling = false;
+
+    virtual ~SceneGraph() = default;
+
+    void Initialize(const int _width, const int _height);
+    void BuildSceneGraph();
+    void UpdateTransforms();
+
+    void SetBlurWidth(const int _width);
+    void EmulateShadow();
+    void BuildOcclusion();
+    void EmulateGeometry();
+    void BuildLightClusters();
+    void EmulateLighting();
+    void EmulateAO();
+    void EmulateToneMap(const float _seconds);
+
+protected:
+    // The GPU copy of a shape built from _vertices and _indices, for
+    // Object::Draw, or null when there is nothing to draw with.
+    virtual std::shared_ptr<DirectX::GeometricPrimitive> CreateShape(
+        const DirectX::GeometricPrimitive::VertexCollection& _vertices,
+        const DirectX::GeometricPrimitive::IndexCollection& _indices
+    ) {
+        return nullptr;
+    }
+
+    // The GPU copy of _image, likewise.
+    virtual std::shared_ptr<Texture> CreateTexture(const Image& _image) {
+        return nullptr;
+    }
+};
@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////
+// Moment shadow evaluation on the CPU; see shadow.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "shadow.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+// The rows of the float4x4 in GetOptimizedDepth, which undoes
+// OptimizeMatrix in moments.cpp, and the bias it takes off first
+static const float RawMatrix[4][4] = {
+    { 0.2227744146f,  0.1549679261f,  0.1451988946f,  0.163127443f },
+    { 0.0771972861f,  0.1394629426f,  0.2120202157f,  0.2591432266f },
+    { 0.7926986636f,  0.7963415838f,  0.7258694464f,  0.6539092497f },
+    { 0.0319417555f, -0.1722823173f, -0.2758014811f, -0.3376131734f },
+};
+static const float OptimizeBias = 0.035955884801f;
+
+// CholeskyDecomposition's lower bound on the diagonal
+static const float MinDiagonal = 0.0001f;
+
+Vector4 Emulator::MomentShadowEvaluator::RawMoments(const Vector4& _optimized) {
+    float optimized[4] = { _optimized.x - OptimizeBias, _optimized.y, _optimized.z, _optimized.w };
+    float raw[4];
+    for (int j = 0; j < 4; j++)
+        raw[j] = optimized[0] * RawMatrix[0][j] + optimized[1] * RawMatrix[1][j]
+            + optimized[2] * RawMatrix[2][j] + optimized[3] * RawMatrix[3][j];
+    return Vector4(raw[0], raw[1], raw[2], raw[3]);
+}
+
+// The Cholesky factorization of the Hankel matrix of (1, b1, b2, b3,
+// b4) is written out with its first diagonal entry, sqrt(1), folded
+// away.  The shader's steps are otherwise kept in order.
+float Emulator::MomentShadowEvaluator::Intensity(const Vector4& _optimized, float _depth, float _momentBias, float _depthBias) {
+    Vector4 raw = RawMoments(_optimized);
+    const float keep = 1.0f - _momentBias;
+    const float bias = _momentBias * 0.5f;
+    float b1 = keep * raw.x + bias;
+    float b2 = keep * raw.y + bias;
+    float b3 = keep * raw.z + bias;
+    float b4 = keep * raw.w + bias;
+    float t = _depth - _depthBias;
+
+    float d = std::max(std::sqrt(std::abs(b2 - b1 * b1)), MinDiagonal);
+    float e = (b3 - b1 * b2) / d;
+    float f = std::max(std::sqrt(std::abs(b4 - b2 * b2 - e * e)), MinDiagonal);
+    float ch2 = (t - b1) / d;
+    float ch3 = (t * t - b2 - e * ch2) / f;
+    float c3 = ch3 / f;
+    float c2 = (ch2 - e * c3) / d;
+    float c1 = 1.0f - b1 * c2 - b2 * c3;
+
+    // Roots of c1 + c2 z + c3 z^2, the other two support points.  The
+    // shader takes them in the order the formula gives, which swaps
+    // them whenever c3 is negative, as it is for a receiver just behind
+    // a single occluder.  They are sorted here.
+    float det = std::sqrt(std::max(c2 * c2 - 4.0f * c3 * c1, 0.0f));
+    float root0 = (-c2 - det) / (2.0f * c3);
+    float root1 = (-c2 + det) / (2.0f * c3);
+    float z2 = root0 < root1 ? root0 : root1;
+    float z3 = root0 < root1 ? root1 : root0;
+
+    float intensity;
+    if (t <= z2)
+        intensity = 0;
+    else if (t <= z3)
+        intensity = (t * z3 - b1 * (t + z3) + b2) / ((z3 - z2) * (t - z2));
+    else
+        intensity = 1.0f - (z2 * z3 - b1 * (z2 + z3) + b2) / ((t - z2) * (t - z3));
+
+    // Written so a NaN comes out as 0, like the AVX2 max
+    intensity = intensity > 0 ? intensity : 0;
+    return intensity < 1 ? intensity : 1;
+}
+
+void Emulator::MomentShadowEvaluator::Evaluate(
+    const ShaderData::Constants& _constants, const Vector4* _moments, const float* _depths, float* _intensities, int _count
+) {
+    m_momentBias = _constants.momentBias;
+    m_depthBias = _constants.depthBias;
+
+    static const Simd::Level supported = Simd::Detect();
+    if (std::min(m_simdLevel, supported) == Simd::Level::AVX2)
+        EvaluateAVX2(_moments, _depths, _intensities, _count);
+    else
+        EvaluateScalar(_moments, _depths, _intensities, _count);
+}
+
+void Emulator::MomentShadowEvaluator::EvaluateScalar(
+    const Vector4* _moments, const float* _depths, float* _intensities, int _count
+) const {
+    for (int i = 0; i < _count; i++)
+        _intensities[i] = Intensity(_moments[i], _depths[i], m_momentBias, m_depthBias);
+}
+
+// Eight fragments per iteration.  Multiplies and adds are kept
+// separate, in the scalar order, so both paths round the same way as
+// long as the compiler doesn't fuse them.
+SIMD_TARGET_AVX2 void Emulator::MomentShadowEvaluator::EvaluateAVX2(
+    const Vector4* _moments, const float* _depths, float* _intensities, int _count
+) const {
+#if SIMD_X86
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 minDiagonal = _mm256_set1_ps(MinDiagonal);
+    const __m256 keep = _mm256_set1_ps(1.0f - m_momentBias);
+    const __m256 bias = _mm256_set1_ps(m_momentBias * 0.5f);
+    const __m256 depthBias = _mm256_set1_ps(m_depthBias);
+
+    int i = 0;
+    for (; i + 8 <= _count; i += 8) {
+        // Eight RGBA texels to channel planes.  Fragments i and i + 4
+        // share a register, so the 4x4 transposes within the 128 bit
+        // halves leave every plane in order.
+        const float* texels = &_moments[i].x;
+        __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels)), _mm_loadu_ps(texels + 16), 1);
+        __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 4)), _mm_loadu_ps(texels + 20), 1);
+        __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 8)), _mm_loadu_ps(texels + 24), 1);
+        __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 12)), _mm_loadu_ps(texels + 28), 1);
+        __m256 xy01 = _mm256_unpacklo_ps(r0, r1);  // x0 x1 y0 y1 | x4 x5 y4 y5
+        __m256 zw01 = _mm256_unpackhi_ps(r0, r1);  // z0 z1 w0 w1 | z4 z5 w4 w5
+        __m256 xy23 = _mm256_unpacklo_ps(r2, r3);
+        __m256 zw23 = _mm256_unpackhi_ps(r2, r3);
+        __m256 optimized[4] = {
+            _mm256_sub_ps(_mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_set1_ps(OptimizeBias)),
+            _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2)),
+            _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(1, 0, 1, 0)),
+            _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(3, 2, 3, 2)),
+        };
+
+        __m256 b[4];
+        for (int j = 0; j < 4; j++) {
+            __m256 raw = _mm256_mul_ps(optimized[0], _mm256_set1_ps(RawMatrix[0][j]));
+            raw = _mm256_add_ps(raw, _mm256_mul_ps(optimized[1], _mm256_set1_ps(RawMatrix[1][j])));
+            raw = _mm256_add_ps(raw, _mm256_mul_ps(optimized[2], _mm256_set1_ps(RawMatrix[2][j])));
+            raw = _mm256_add_ps(raw, _mm256_mul_ps(optimized[3], _mm256_set1_ps(RawMatrix[3][j])));
+            b[j] = _mm256_add_ps(_mm256_mul_ps(keep, raw), bias);
+        }
+        const __m256 b1 = b[0], b2 = b[1], b3 = b[2], b4 = b[3];
+        __m256 t = _mm256_sub_ps(_mm256_loadu_ps(_depths + i), depthBias);
+
+        __m256 d = _mm256_sub_ps(b2, _mm256_mul_ps(b1, b1));
+        d = _mm256_max_ps(_mm256_sqrt_ps(_mm256_and_ps(d, absMask)), minDiagonal);
+        __m256 e = _mm256_div_ps(_mm256_sub_ps(b3, _mm256_mul_ps(b1, b2)), d);
+        __m256 f = _mm256_sub_ps(_mm256_sub_ps(b4, _mm256_mul_ps(b2, b2)), _mm256_mul_ps(e, e));
+        f = _mm256_max_ps(_mm256_sqrt_ps(_mm256_and_ps(f, absMask)), minDiagonal);
+        __m256 ch2 = _mm256_div_ps(_mm256_sub_ps(t, b1), d);
+        __m256 ch3 = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(t, t), b2), _mm256_mul_ps(e, ch2)), f);
+        __m256 c3 = _mm256_div_ps(ch3, f);
+        __m256 c2 = _mm256_div_ps(_mm256_sub_ps(ch2, _mm256_mul_ps(e, c3)), d);
+        __m256 c1 = _mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(b1, c2)), _mm256_mul_ps(b2, c3));
+
+        __m256 det = _mm256_sub_ps(_mm256_mul_ps(c2, c2), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), c3), c1));
+        det = _mm256_sqrt_ps(_mm256_max_ps(det, zero));
+        __m256 twoC3 = _mm256_mul_ps(_mm256_set1_ps(2.0f), c3);
+        __m256 negC2 = _mm256_sub_ps(zero, c2);
+        __m256 root0 = _mm256_div_ps(_mm256_sub_ps(negC2, det), twoC3);
+        __m256 root1 = _mm256_div_ps(_mm256_add_ps(negC2, det), twoC3);
+        __m256 sorted = _mm256_cmp_ps(root0, root1, _CMP_LT_OQ);
+        __m256 z2 = _mm256_blendv_ps(root1, root0, sorted);
+        __m256 z3 = _mm256_blendv_ps(root0, root1, sorted);
+
+        // Both of the shader's lit cases, then the blends between them
+        __m256 between = _mm256_div_ps(
+            _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(t, z3), _mm256_mul_ps(b1, _mm256_add_ps(t, z3))), b2),
+            _mm256_mul_ps(_mm256_sub_ps(z3, z2), _mm256_sub_ps(t, z2))
+        );
+        __m256 beyond = _mm256_sub_ps(one, _mm256_div_ps(
+            _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(z2, z3), _mm256_mul_ps(b1, _mm256_add_ps(z2, z3))), b2),
+            _mm256_mul_ps(_mm256_sub_ps(t, z2), _mm256_sub_ps(t, z3))
+        ));
+        __m256 intensity = _mm256_blendv_ps(beyond, between, _mm256_cmp_ps(t, z3, _CMP_LE_OQ));
+        intensity = _mm256_blendv_ps(intensity, zero, _mm256_cmp_ps(t, z2, _CMP_LE_OQ));
+        intensity = _mm256_min_ps(_mm256_max_ps(intensity, zero), one);
+        _mm256_storeu_ps(_intensities + i, intensity);
+    }
+    if (i < _count)
+        EvaluateScalar(_moments + i, _depths + i, _intensities + i, _count - i);
+#else
+    EvaluateScalar(_moments, _depths, _intensities, _count);
+#endif
+}
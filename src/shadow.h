@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////
+// The CPU equivalent of ComputeShadowCoefficient in
+// lightingPhongPixel.hlsl: the shadow intensity of a fragment from the
+// filtered moments of a 4MSM shadow map, as in "Moment Shadow Mapping"
+// (Peters and Klein 2015).
+//
+// Fragments come in batches of optimized moments, as a moment shadow
+// map stores them, and relative light depths.  The shader's
+// momentBias and depthBias are taken from the frame's constants.
+// Batches are evaluated eight fragments at a time with AVX2, with the
+// shader's branches turned into blends, or one at a time where that is
+// not available.  Both paths round the same way, so long as the
+// compiler doesn't fuse multiplies and adds; CMakeLists.txt turns that
+// off for GCC and Clang.  Headless --self-test checks both.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <directxtk12/SimpleMath.h>
+
+#include "../ShaderData.h"
+#include "simd.h"
+
+namespace Emulator {
+    class MomentShadowEvaluator {
+    public:
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        // GetOptimizedDepth: optimized moments back to the powers of depth.
+        static DirectX::SimpleMath::Vector4 RawMoments(const DirectX::SimpleMath::Vector4& _optimized);
+
+        // One fragment at relative depth _depth.  0 is lit and 1 fully
+        // shadowed; the result is saturated, unlike the shader's.
+        static float Intensity(
+            const DirectX::SimpleMath::Vector4& _optimized, float _depth, float _momentBias, float _depthBias
+        );
+
+        // Writes the intensities of _count fragments.
+        void Evaluate(
+            const ShaderData::Constants& _constants,
+            const DirectX::SimpleMath::Vector4* _moments, const float* _depths, float* _intensities, int _count
+        );
+
+    private:
+        void EvaluateScalar(
+            const DirectX::SimpleMath::Vector4* _moments, const float* _depths, float* _intensities, int _count
+        ) const;
+        void EvaluateAVX2(
+            const DirectX::SimpleMath::Vector4* _moments, const float* _depths, float* _intensities, int _count
+        ) const;
+
+        float m_momentBias = 0, m_depthBias = 0;
+    };
+}
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////
+// Helpers for the SIMD code paths of the CPU renderer: detection of
+// the instruction sets the running processor supports, markers for
+// functions that use instructions beyond the compiler's baseline, and
+// storage aligned for full width loads.
+//
+// Every SIMD kernel comes with a scalar twin; callers pick one at run
+// time from Simd::Detect() so a single binary runs everywhere.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+// MSVC lets any function use any intrinsic.  GCC and Clang need the
+// functions that use wider instruction sets to say so.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace Simd {
+    enum class Level {
+        Scalar,
+        SSE41,
+        AVX2    // Includes FMA
+    };
+
+    inline const char* Name(Level _level) {
+        switch (_level) {
+        case Level::SSE41: return "SSE4.1";
+        case Level::AVX2: return "AVX2";
+        default: return "Scalar";
+        }
+    }
+
+    // The widest instruction set both the processor and the OS support.
+    inline Level Detect() {
+#if SIMD_X86
+        uint32_t regs[4] = {};
+        auto cpuid = [&regs](uint32_t _leaf) {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuidex(info, static_cast<int>(_leaf), 0);
+            for (int i = 0; i < 4; i++)
+                regs[i] = static_cast<uint32_t>(info[i]);
+#else
+            __cpuid_count(_leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        };
+
+        cpuid(0);
+        uint32_t maxLeaf = regs[0];
+        cpuid(1);
+        bool sse41 = (regs[2] >> 19) & 1;
+        bool fma = (regs[2] >> 12) & 1;
+        bool osxsave = (regs[2] >> 27) & 1;
+        bool avx = (regs[2] >> 28) & 1;
+        bool avx2 = false;
+        if (maxLeaf >= 7) {
+            cpuid(7);
+            avx2 = (regs[1] >> 5) & 1;
+        }
+
+        // The OS must save the YMM registers on a context switch
+        bool ymmState = false;
+        if (osxsave) {
+#if defined(_MSC_VER)
+            uint64_t xcr0 = _xgetbv(0);
+#else
+            uint32_t lo, hi;
+            __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            uint64_t xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+            ymmState = (xcr0 & 6) == 6;
+        }
+
+        if (avx && avx2 && fma && ymmState)
+            return Level::AVX2;
+        if (sse41)
+            return Level::SSE41;
+#endif
+        return Level::Scalar;
+    }
+
+#if SIMD_X86
+    // Fast AVX2 approximations of exp2, log2 and pow for eight lanes.
+    // Exp2 is within about 1e-6 relative and Log2 1e-5 absolute, plenty
+    // for shading.  Polynomials are minimax fits of 2^f on [0, 1) and of
+    // log2(m) / (m - 1) on [1, 2).
+    SIMD_TARGET_AVX2 inline __m256 Exp2(__m256 _x) {
+        _x = _mm256_min_ps(_mm256_max_ps(_x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+        __m256 whole = _mm256_floor_ps(_x);
+        __m256 f = _mm256_sub_ps(_x, whole);
+        __m256 p = _mm256_set1_ps(1.8775767e-3f);
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(8.9893397e-3f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(5.5826318e-2f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(2.4015361e-1f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(6.9315308e-1f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(9.9999994e-1f));
+        __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+    }
+
+    // Only for positive, normal inputs
+    SIMD_TARGET_AVX2 inline __m256 Log2(__m256 _x) {
+        __m256i bits = _mm256_castps_si256(_x);
+        __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+        __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+            _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)
+        ));
+        __m256 p = _mm256_set1_ps(-3.4436006e-2f);
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(3.1821337e-1f));
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(-1.2315303f));
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(2.5988452f));
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(-3.3241990f));
+        p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(3.1157899f));
+        return _mm256_fmadd_ps(p, _mm256_sub_ps(m, _mm256_set1_ps(1.0f)), exponent);
+    }
+
+    // _x ^ _y for _x >= 0; 0 ^ _y is 0.
+    SIMD_TARGET_AVX2 inline __m256 Pow(__m256 _x, __m256 _y) {
+        __m256 x = _mm256_max_ps(_x, _mm256_set1_ps(FLT_MIN));
+        __m256 result = Exp2(_mm256_mul_ps(_y, Log2(x)));
+        return _mm256_and_ps(result, _mm256_cmp_ps(_x, _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+#endif
+
+    // Allocator for buffers streamed with SIMD loads.  64 bytes is a
+    // cache line and covers every vector width used here.
+    template <typename T, size_t Alignment = 64>
+    struct AlignedAllocator {
+        using value_type = T;
+
+        template <typename U>
+        struct rebind {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() = default;
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+        T* allocate(size_t _count) {
+            return static_cast<T*>(::operator new(_count * sizeof(T), std::align_val_t(Alignment)));
+        }
+        void deallocate(T* _pointer, size_t) {
+            ::operator delete(_pointer, std::align_val_t(Alignment));
+        }
+
+        template <typename U>
+        bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+        template <typename U>
+        bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+    };
+
+    template <typename T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+}
@@ -80,37 +80,23 @@ Texture Texture::LoadRGBE(
     std::unique_ptr<DirectX::DescriptorPile>& _heap, 
     const std::string& filename
 ) {
-    Texture texture{};
-    FILE* file = nullptr;
-    fopen_s(&file, filename.c_str(), "rb");
-
-    if (!file)
-        throw std::runtime_error("failed to open file");
-
-    int width = 0;
-    int height = 0;
-    rgbe_header_info info{};
-    if (RGBE_ReadHeader(file, &width, &height, &info) != RGBE_RETURN_SUCCESS) {
-        fclose(file);
-        throw std::runtime_error("failed to read header");
-    }
+    return Create(_device, _queue, _heap, Image::LoadRGBE(filename));
+}
 
-    bool validProgram = (info.valid & RGBE_VALID_PROGRAMTYPE) == RGBE_VALID_PROGRAMTYPE;
-    bool validGamma = (info.valid & RGBE_VALID_GAMMA) == RGBE_VALID_GAMMA;
-    bool validExposure = (info.valid & RGBE_VALID_EXPOSURE) == RGBE_VALID_EXPOSURE;
-    bool validOrientation = (info.valid & RGBE_VALID_ORIENTATION) == RGBE_VALID_ORIENTATION;
-    
-    int numPixels = width * height;
-    float* pixels = new float[width * height * 4];
-
-    if (RGBE_ReadPixels_RLE(file, pixels, width, height) != RGBE_RETURN_SUCCESS) {
-        fclose(file);
-        delete[] pixels;
-        throw std::runtime_error("failed to read pixels");
-    }
+Texture Texture::Create(
+    Microsoft::WRL::ComPtr<ID3D12Device>& _device,
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue>& _queue,
+    std::unique_ptr<DirectX::DescriptorPile>& _heap,
+    const Image& _image
+) {
+    Texture texture{};
+    int width = _image.m_width;
+    int height = _image.m_height;
+    texture.m_width = width;
+    texture.m_height = height;
 
     D3D12_SUBRESOURCE_DATA subresourceData{
-        .pData = pixels,
+        .pData = _image.m_pixels.data(),
         .RowPitch = width * 4 * sizeof(float),
     };
 
@@ -132,8 +118,6 @@ Texture Texture::LoadRGBE(
         throw std::runtime_error("failed to create texture from memory");
     }
     uploadBatch.End(_queue.Get()).wait();
-    delete[] pixels;
-    fclose(file);
 
     texture.m_textureID = _heap->Allocate();
     DirectX::CreateShaderResourceView(
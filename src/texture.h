@@ -17,6 +17,7 @@
 #include <wrl.h>
 #include <directxtk12/DescriptorHeap.h>
 #include <memory>
+#include "image.h"
 struct CommandList;
 class Texture
 {
@@ -24,7 +25,6 @@ class Texture
     Microsoft::WRL::ComPtr<ID3D12Resource> m_texture = nullptr;
     size_t m_textureID = 0;
     int m_width = 0, m_height = 0, m_depth = 0;
-    unsigned char* image = nullptr;
     Texture();
     Texture(
         Microsoft::WRL::ComPtr<ID3D12Device>& _device,
@@ -45,7 +45,15 @@ class Texture
         const std::string& filename
     );
 
-    operator bool() {
+    // A float texture of _image's texels
+    static Texture Create(
+        Microsoft::WRL::ComPtr<ID3D12Device>& _device,
+        Microsoft::WRL::ComPtr<ID3D12CommandQueue>& _queue,
+        std::unique_ptr<DirectX::DescriptorPile>& _heap,
+        const Image& _image
+    );
+
+    operator bool() const {
         return m_texture != nullptr;
     }
 };
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////
+// A small pool of worker threads shared by the CPU side of the
+// renderer.  Work is handed out as a ParallelFor over an index range;
+// the calling thread joins in and the call returns once every index
+// has been processed.
+////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+
+static thread_local bool insideJob = false;
+
+ThreadPool& ThreadPool::Get() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool(uint32_t _threadCount) {
+    if (_threadCount == 0)
+        _threadCount = 1;
+    for (uint32_t i = 1; i < _threadCount; i++)
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::RunJobs() {
+    insideJob = true;
+    for (uint32_t i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1))
+        (*m_job)(i);
+    insideJob = false;
+}
+
+void ThreadPool::WorkerLoop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+        if (m_quit)
+            return;
+        seen = m_generation;
+        lock.unlock();
+        RunJobs();
+        lock.lock();
+        if (--m_pending == 0)
+            m_done.notify_all();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t _count, const std::function<void(uint32_t)>& _job) {
+    if (_count == 0)
+        return;
+    if (insideJob || m_workers.empty() || _count == 1) {
+        for (uint32_t i = 0; i < _count; i++)
+            _job(i);
+        return;
+    }
+
+    // Only one ParallelFor can own the workers at a time.
+    std::lock_guard<std::mutex> owner(m_ownerMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &_job;
+        m_count = _count;
+        m_next = 0;
+        m_pending = static_cast<uint32_t>(m_workers.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    RunJobs();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Every worker checks in for every generation, so none of them can
+    // still be looking at this job once the next one is published.
+    m_done.wait(lock, [&] { return m_pending == 0; });
+    m_job = nullptr;
+}
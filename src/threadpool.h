@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////
+// A small pool of worker threads shared by the CPU side of the
+// renderer.  Work is handed out as a ParallelFor over an index range;
+// the calling thread joins in and the call returns once every index
+// has been processed.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // The process wide pool, sized to the number of hardware threads.
+    static ThreadPool& Get();
+
+    explicit ThreadPool(uint32_t _threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that take part in a ParallelFor, including the caller.
+    uint32_t ThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+    // Calls _job(i) for every i in [0, _count).  Calls made from inside a
+    // job run serially on the calling thread instead of deadlocking.
+    void ParallelFor(uint32_t _count, const std::function<void(uint32_t)>& _job);
+
+private:
+    void WorkerLoop();
+    void RunJobs();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_ownerMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(uint32_t)>* m_job = nullptr;
+    uint32_t m_count = 0;
+    uint64_t m_generation = 0;
+    std::atomic<uint32_t> m_next{ 0 };
+    uint32_t m_pending = 0;
+    bool m_quit = false;
+};
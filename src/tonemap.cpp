@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////
+// Auto-exposure and tone mapping on the CPU; see tonemap.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "tonemap.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static const float BinsPerStop = (Emulator::ToneMapper::Bins - 1) / (Emulator::ToneMapper::MaxLog2 - Emulator::ToneMapper::MinLog2);
+
+// Rec. 709 luminance
+static const float LumaR = 0.2126f, LumaG = 0.7152f, LumaB = 0.0722f;
+
+// Exposed values are clamped to this before x / (x + 1), which would
+// make infinity NaN
+static const float MaxExposed = 1e30f;
+
+float Emulator::ToneMapper::Filmic(float _x) {
+    _x = std::max(_x, 0.0f);
+    float curve = (_x * (2.51f * _x + 0.03f)) / (_x * (2.43f * _x + 0.59f) + 0.14f);
+    return std::pow(std::clamp(curve, 0.0f, 1.0f), 1.0f / 2.2f);
+}
+
+// Entry i is the curve at x / (x + 1) = i / (LutSize - 1); the last one
+// is its limit, 2.51 / 2.43, clamped to 1.  The copy after it lets a
+// lookup interpolate without a bounds check.
+const std::vector<float>& Emulator::ToneMapper::BuildLut() {
+    if (!m_lut.empty())
+        return m_lut;
+    m_lut.resize(LutSize + 1);
+    for (int i = 0; i < LutSize - 1; i++) {
+        float t = static_cast<float>(i) / (LutSize - 1);
+        m_lut[i] = Filmic(t / (1.0f - t));
+    }
+    m_lut[LutSize - 1] = m_lut[LutSize] = 1.0f;
+    return m_lut;
+}
+
+void Emulator::ToneMapper::Resolve(const Image& _hdr, float _seconds) {
+    static const Simd::Level supported = Simd::Detect();
+    m_level = std::min(m_simdLevel, supported) == Simd::Level::AVX2 ? Simd::Level::AVX2 : Simd::Level::Scalar;
+    BuildLut();
+
+    const Vector4* pixels = _hdr.m_pixels.data();
+    const size_t width = _hdr.m_width;
+    const uint32_t tasks = (_hdr.m_height + RowsPerTask - 1) / RowsPerTask;
+    m_taskHistograms.resize(tasks);
+    ThreadPool::Get().ParallelFor(tasks, [&](uint32_t _task) {
+        std::array<uint32_t, Bins>& histogram = m_taskHistograms[_task];
+        histogram.fill(0);
+        const size_t begin = _task * RowsPerTask * width;
+        const size_t end = std::min<size_t>(begin + RowsPerTask * width, _hdr.m_pixels.size());
+        if (m_level == Simd::Level::AVX2)
+            BinAVX2(pixels + begin, end - begin, histogram.data());
+        else
+            BinScalar(pixels + begin, 0, end - begin, histogram.data());
+    });
+    m_histogram.fill(0);
+    for (const auto& histogram : m_taskHistograms)
+        for (int i = 0; i < Bins; i++)
+            m_histogram[i] += histogram[i];
+
+    Expose();
+    if (!m_adapted || _seconds <= 0) {
+        m_exposure = m_targetExposure;
+        m_adapted = true;
+    }
+    else {
+        float current = std::log2(m_exposure), target = std::log2(m_targetExposure);
+        float rate = target < current ? m_adaptDarker : m_adaptBrighter;
+        current += (target - current) * (1.0f - std::exp2(-rate * _seconds));
+        m_exposure = std::exp2(current);
+    }
+
+    if (m_output.m_width != _hdr.m_width || m_output.m_height != _hdr.m_height)
+        m_output = Image(_hdr.m_width, _hdr.m_height);
+    Vector4* out = m_output.m_pixels.data();
+    ThreadPool::Get().ParallelFor(tasks, [&](uint32_t _task) {
+        const size_t begin = _task * RowsPerTask * width;
+        const size_t end = std::min<size_t>(begin + RowsPerTask * width, _hdr.m_pixels.size());
+        if (m_level == Simd::Level::AVX2)
+            MapAVX2(pixels + begin, out + begin, end - begin);
+        else
+            MapScalar(pixels + begin, out + begin, 0, end - begin);
+    });
+}
+
+// The mean log2 luminance of the bins between the percentiles, counting
+// bins partly inside in part.  With nothing brighter than bin 0, the
+// target is left as it was.
+void Emulator::ToneMapper::Expose() {
+    uint64_t counted = 0;
+    for (int i = 1; i < Bins; i++)
+        counted += m_histogram[i];
+    if (counted == 0)
+        return;
+
+    const double low = static_cast<double>(m_lowPercentile) * counted;
+    const double high = std::max(static_cast<double>(m_highPercentile) * counted, low + 1.0);
+    double below = 0, sum = 0, weight = 0;
+    for (int i = 1; i < Bins; i++) {
+        double begin = std::max(below, low), end = std::min(below + m_histogram[i], high);
+        below += m_histogram[i];
+        if (end <= begin)
+            continue;
+        double center = MinLog2 + (i - 0.5) / BinsPerStop;
+        sum += center * (end - begin);
+        weight += end - begin;
+    }
+    if (weight == 0)
+        return;
+    m_averageLog2 = static_cast<float>(sum / weight);
+    m_targetExposure = std::exp2(std::log2(m_key) - m_averageLog2 + m_compensation);
+}
+
+void Emulator::ToneMapper::BinScalar(const Vector4* _pixels, size_t _begin, size_t _end, uint32_t* _histogram) const {
+    for (size_t i = _begin; i < _end; i++) {
+        const Vector4& p = _pixels[i];
+        float luminance = LumaR * p.x + LumaG * p.y + LumaB * p.z;
+        int bin = 0;
+        if (luminance > 0) {
+            float position = (std::log2(luminance) - MinLog2) * BinsPerStop + 1.0f;
+            bin = static_cast<int>(std::clamp(position, 0.0f, Bins - 1.0f));
+        }
+        _histogram[bin]++;
+    }
+}
+
+// Eight pixels per iteration, transposed to planes as they are loaded,
+// the rest one at a time.  Only the increments are scalar.
+SIMD_TARGET_AVX2 void Emulator::ToneMapper::BinAVX2(const Vector4* _pixels, size_t _count, uint32_t* _histogram) const {
+#if SIMD_X86
+    const __m256 minLuminance = _mm256_set1_ps(FLT_MIN);
+    const __m256 offset = _mm256_set1_ps(1.0f - MinLog2 * BinsPerStop);
+    const __m256 lastBin = _mm256_set1_ps(Bins - 1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    alignas(32) int32_t bins[8];
+
+    size_t i = 0;
+    for (; i + 8 <= _count; i += 8) {
+        const float* texels = &_pixels[i].x;
+        __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels)), _mm_loadu_ps(texels + 16), 1);
+        __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 4)), _mm_loadu_ps(texels + 20), 1);
+        __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 8)), _mm_loadu_ps(texels + 24), 1);
+        __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(texels + 12)), _mm_loadu_ps(texels + 28), 1);
+        __m256 xy01 = _mm256_unpacklo_ps(r0, r1);
+        __m256 zw01 = _mm256_unpackhi_ps(r0, r1);
+        __m256 xy23 = _mm256_unpacklo_ps(r2, r3);
+        __m256 zw23 = _mm256_unpackhi_ps(r2, r3);
+        __m256 r = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 g = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 b = _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(1, 0, 1, 0));
+
+        __m256 luminance = _mm256_mul_ps(r, _mm256_set1_ps(LumaR));
+        luminance = _mm256_fmadd_ps(g, _mm256_set1_ps(LumaG), luminance);
+        luminance = _mm256_fmadd_ps(b, _mm256_set1_ps(LumaB), luminance);
+        __m256 lit = _mm256_cmp_ps(luminance, zero, _CMP_GT_OQ);
+        __m256 position = _mm256_fmadd_ps(Simd::Log2(_mm256_max_ps(luminance, minLuminance)), _mm256_set1_ps(BinsPerStop), offset);
+        position = _mm256_and_ps(_mm256_min_ps(_mm256_max_ps(position, zero), lastBin), lit);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bins), _mm256_cvttps_epi32(position));
+        for (int j = 0; j < 8; j++)
+            _histogram[bins[j]]++;
+    }
+    _mm256_zeroupper(); // As in MapAVX2
+    BinScalar(_pixels, i, _count, _histogram);
+#else
+    BinScalar(_pixels, 0, _count, _histogram);
+#endif
+}
+
+void Emulator::ToneMapper::MapScalar(const Vector4* _in, Vector4* _out, size_t _begin, size_t _end) const {
+    auto map = [&](float _value) {
+        float x = std::min(std::max(0.0f, _value * m_exposure), MaxExposed); // NaN to 0
+        float position = x / (x + 1.0f) * (LutSize - 1);
+        int i = static_cast<int>(position);
+        float t = position - i;
+        return m_lut[i] + (m_lut[i + 1] - m_lut[i]) * t;
+    };
+    for (size_t i = _begin; i < _end; i++)
+        _out[i] = Vector4(map(_in[i].x), map(_in[i].y), map(_in[i].z), 1.0f);
+}
+
+// Two pixels, all eight channels, per iteration; alpha is mapped along
+// with the rest and then replaced by 1.
+SIMD_TARGET_AVX2 void Emulator::ToneMapper::MapAVX2(const Vector4* _in, Vector4* _out, size_t _count) const {
+#if SIMD_X86
+    const __m256 exposure = _mm256_set1_ps(m_exposure);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 maxExposed = _mm256_set1_ps(MaxExposed);
+    const __m256 scale = _mm256_set1_ps(LutSize - 1.0f);
+    const float* lut = m_lut.data();
+
+    size_t i = 0;
+    for (; i + 2 <= _count; i += 2) {
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&_in[i].x), exposure), zero), maxExposed);
+        __m256 position = _mm256_mul_ps(_mm256_div_ps(x, _mm256_add_ps(x, one)), scale);
+        __m256i index = _mm256_cvttps_epi32(position);
+        __m256 t = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+        __m256 a = _mm256_i32gather_ps(lut, index, 4);
+        __m256 b = _mm256_i32gather_ps(lut + 1, index, 4);
+        __m256 result = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+        _mm256_storeu_ps(&_out[i].x, _mm256_blend_ps(result, one, 0x88));
+    }
+
+    // The tail is a tail call, which can skip the compiler's own
+    // vzeroupper and leave every SSE instruction after it paying for
+    // the dirty upper halves
+    _mm256_zeroupper();
+    MapScalar(_in, _out, i, _count);
+#else
+    MapScalar(_in, _out, 0, _count);
+#endif
+}
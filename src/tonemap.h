@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////
+// Automatic exposure and filmic tone mapping of the emulated lighting
+// pass's HDR output, in place of the fixed e = 10 Reinhard curve left
+// commented out at the end of lightingPhongPixel.hlsl.
+//
+// Each frame builds a histogram of log2 luminance: blocks of rows are
+// binned in parallel into histograms of their own, which are then added
+// up in order.  The mean log luminance of the pixels between two
+// percentiles, so a few highlights or a black background don't swing
+// it, gives the exposure that maps it to m_key.  The exposure applied
+// moves toward that exponentially in EV, faster toward darker exposures
+// than brighter ones, as eyes adapt faster to light than to dark.
+//
+// The curve is Narkowicz's fit of the ACES filmic tone curve followed
+// by the shader's 1 / 2.2 gamma, baked into a table over x / (x + 1) so
+// it covers all of [0, inf) and is finest near black.  AVX2 bins eight
+// pixels and maps two at a time, looking the table up with gathers.
+//
+// ToneMapShader.hlsl does the same on the GPU for the interactive
+// program, through the same table.
+////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+#include "simd.h"
+
+namespace Emulator {
+    class ToneMapper {
+    public:
+        static constexpr int Bins = 128;           // Bin 0 holds everything darker than MinLog2
+        static constexpr float MinLog2 = -10.0f;   // Luminance range of the other bins
+        static constexpr float MaxLog2 = 6.0f;
+        static constexpr int LutSize = 1024;
+        static constexpr int RowsPerTask = 16;
+
+        Simd::Level m_simdLevel = Simd::Detect();
+
+        float m_key = 0.18f;            // Where the mean luminance lands before the curve
+        float m_compensation = 0.0f;    // In EV, added to the automatic exposure
+        float m_lowPercentile = 0.5f;   // Pixels averaged for the exposure
+        float m_highPercentile = 0.95f;
+        float m_adaptDarker = 3.0f;     // EV per second, roughly, toward a darker exposure
+        float m_adaptBrighter = 1.0f;   // and toward a brighter one
+
+        std::array<uint32_t, Bins> m_histogram{};
+        float m_averageLog2 = 0.0f;     // Of the last frame's luminance
+        float m_targetExposure = 1.0f;  // What that frame alone asks for
+        float m_exposure = 1.0f;        // Applied, after adaptation
+
+        Image m_output; // Display values in [0, 1], alpha 1
+
+        // Tone maps _hdr, _seconds after the last frame.  The first frame
+        // after Reset, or one with _seconds <= 0, takes the target
+        // exposure straight away.
+        void Resolve(const Image& _hdr, float _seconds);
+        void Reset() { m_adapted = false; }
+
+        // The curve, gamma included, for an exposed value.
+        static float Filmic(float _x);
+
+        // Filmic's table, LutSize entries and a copy of the last, built
+        // on first use.
+        const std::vector<float>& BuildLut();
+
+    private:
+        void BinScalar(const DirectX::SimpleMath::Vector4* _pixels, size_t _begin, size_t _end, uint32_t* _histogram) const;
+        void BinAVX2(const DirectX::SimpleMath::Vector4* _pixels, size_t _count, uint32_t* _histogram) const;
+        void MapScalar(const DirectX::SimpleMath::Vector4* _in, DirectX::SimpleMath::Vector4* _out, size_t _begin, size_t _end) const;
+        void MapAVX2(const DirectX::SimpleMath::Vector4* _in, DirectX::SimpleMath::Vector4* _out, size_t _count) const;
+        void Expose();
+
+        std::vector<float> m_lut;
+        std::vector<std::array<uint32_t, Bins>> m_taskHistograms;
+        Simd::Level m_level = Simd::Level::Scalar;
+        bool m_adapted = false;
+    };
+}